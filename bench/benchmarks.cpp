@@ -0,0 +1,269 @@
+// Benchmarks of the hot paths, on the grimpcore code the editor runs.
+// Machine readable results to compare two builds:
+//   EpiGrimp_bench --benchmark_format=json --benchmark_out=before.json
+// (or --benchmark_out_format=csv), then e.g. benchmark's compare.py.
+
+#include <benchmark/benchmark.h>
+
+#include <QBuffer>
+#include <QHash>
+#include <QCoreApplication>
+#include <QDir>
+#include <QImage>
+#include <QImageWriter>
+#include <QPainter>
+#include <QTemporaryFile>
+
+#include "blendkernels.h"
+#include "brushengine.h"
+#include "convolution.h"
+#include "imageimport.h"
+#include "imageops.h"
+#include "mippyramid.h"
+#include "pixelkernels.h"
+#include "tiledimage.h"
+#include "undohistory.h"
+
+#include <cmath>
+
+namespace {
+
+// semi transparent gradients and noise, so no kernel hits only its fast paths
+QImage testImage(int w, int h)
+{
+    QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+    quint32 seed = 12345;
+    for (int y = 0; y < h; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < w; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            const int a = (x * 255 / std::max(1, w - 1) + int(seed >> 28)) & 0xff;
+            line[x] = qPremultiply(qRgba(x & 0xff, y & 0xff, int(seed >> 24), a));
+        }
+    }
+    return img;
+}
+
+// shared copy of a cached layer: the tiles are only duplicated when written
+TiledImage testLayer(int size)
+{
+    static QHash<int, TiledImage> cache;
+    if (!cache.contains(size)) cache.insert(size, TiledImage::fromImage(testImage(size, size)));
+    return cache.value(size);
+}
+
+qint64 pixelBytes(int w, int h) { return qint64(w) * h * 4; }
+
+// ---------------- compositing ----------------
+// what compositeLayers() does on a full refresh: every layer blended in turn
+void BM_Composite(benchmark::State &state)
+{
+    const int layerCount = int(state.range(0));
+    const int size = int(state.range(1));
+    const QVector<TiledImage> layers(layerCount, testLayer(size)); // shared tiles, real work
+    QImage dst(size, size, QImage::Format_ARGB32_Premultiplied);
+    for (auto _ : state) {
+        dst.fill(Qt::transparent);
+        for (int i = 0; i < layerCount; ++i)
+            BlendKernels::blendLayer(dst, layers[i], dst.rect(), BlendMode::Normal, i == 0 ? 1.0 : 0.8);
+        benchmark::DoNotOptimize(dst.constBits());
+    }
+    state.SetBytesProcessed(state.iterations() * layerCount * pixelBytes(size, size));
+}
+BENCHMARK(BM_Composite)->ArgsProduct({{2, 8, 32}, {1024, 2048, 4096}})->Unit(benchmark::kMillisecond);
+
+void BM_CompositeMode(benchmark::State &state)
+{
+    const BlendMode mode = BlendMode(state.range(0));
+    const TiledImage layer = testLayer(2048);
+    QImage base = testImage(2048, 2048);
+    for (auto _ : state) {
+        QImage dst = base;
+        BlendKernels::blendLayer(dst, layer, dst.rect(), mode, 0.8);
+        benchmark::DoNotOptimize(dst.constBits());
+    }
+    state.SetLabel(BlendKernels::modeName(mode).toStdString());
+    state.SetBytesProcessed(state.iterations() * pixelBytes(2048, 2048));
+}
+BENCHMARK(BM_CompositeMode)->DenseRange(0, int(BlendMode::Difference))->Unit(benchmark::kMillisecond);
+
+// ---------------- filter kernels ----------------
+template <class Op>
+void runFilter(benchmark::State &state, Op op)
+{
+    const int size = int(state.range(0));
+    for (auto _ : state) {
+        TiledImage img = testLayer(size); // every tile detaches, like a real filter run
+        op(img);
+        benchmark::DoNotOptimize(img.tile(0).constBits());
+    }
+    state.SetLabel(PixelKernels::implementationName());
+    state.SetBytesProcessed(state.iterations() * pixelBytes(size, size));
+}
+
+void BM_Invert(benchmark::State &state) { runFilter(state, [](TiledImage &img) { ImageOps::invert(img); }); }
+void BM_Grayscale(benchmark::State &state) { runFilter(state, [](TiledImage &img) { ImageOps::grayscale(img); }); }
+void BM_ChannelMix(benchmark::State &state)
+{
+    const PixelKernels::ChannelMatrix sepia = {{{101, 197, 48}, {89, 176, 43}, {70, 137, 34}}};
+    runFilter(state, [&](TiledImage &img) { ImageOps::channelMix(img, sepia); });
+}
+void BM_BrightnessContrast(benchmark::State &state)
+{
+    quint8 lut[256];
+    PixelKernels::makeBrightnessContrastLut(lut, 20, 30);
+    runFilter(state, [&](TiledImage &img) { ImageOps::applyLut(img, lut); });
+}
+void BM_Rotate(benchmark::State &state)
+{
+    runFilter(state, [](TiledImage &img) { img = ImageOps::reoriented(img, ImageOps::Orientation::RotateRight); });
+}
+BENCHMARK(BM_Invert)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Grayscale)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ChannelMix)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BrightnessContrast)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Rotate)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+// running sums: the time should not grow with the radius
+void BM_GaussianBlur(benchmark::State &state)
+{
+    const double sigma = double(state.range(1));
+    runFilter(state, [&](TiledImage &img) { Convolution::gaussianBlur(img, sigma); });
+}
+void BM_Sobel(benchmark::State &state) { runFilter(state, [](TiledImage &img) { Convolution::sobel(img); }); }
+BENCHMARK(BM_GaussianBlur)->ArgsProduct({{1024, 4096}, {2, 20, 200}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Sobel)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+// ---------------- undo ----------------
+// one stroke-sized edit turned into a delta, then undone and redone
+void BM_UndoPushPop(benchmark::State &state)
+{
+    const int editSize = int(state.range(0));
+    TiledImage img = testLayer(4096);
+    LayerHistory history;
+    QTransform transform;
+    for (auto _ : state) {
+        history.begin(img, transform, true);
+        img.paint(QRect(100, 100, editSize, editSize), [&](QPainter &p) {
+            p.fillRect(QRect(100, 100, editSize, editSize), QColor(255, 0, 0, 128));
+        });
+        history.commit(img, transform, true);
+        history.undo(img, transform);
+        history.redo(img, transform);
+        if (history.byteSize() > (qint64(256) << 20)) history.clear(); // keep memory flat
+    }
+}
+BENCHMARK(BM_UndoPushPop)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+
+// ---------------- brush ----------------
+// a 2000 px wavy stroke, rasterized and merged into the layer
+void BM_BrushStroke(benchmark::State &state)
+{
+    BrushSettings brush;
+    brush.diameter = qreal(state.range(0));
+    brush.hardness = state.range(1) / 100.0;
+    brush.color = QColor(20, 40, 200, 200);
+    for (auto _ : state) {
+        TiledImage layer(QSize(2048, 2048));
+        BrushEngine engine;
+        engine.begin(layer.size(), brush, QPointF(24, 1024), 1.0);
+        for (int i = 1; i <= 400; ++i) {
+            const qreal x = 24 + i * 5.0;
+            engine.strokeTo(QPointF(x, 1024 + 300 * std::sin(x / 150.0)), 0.5 + 0.5 * std::sin(i / 40.0));
+        }
+        engine.finish(layer);
+        benchmark::DoNotOptimize(layer.storedTileCount());
+    }
+}
+BENCHMARK(BM_BrushStroke)->ArgsProduct({{4, 32, 128}, {0, 100}})->Unit(benchmark::kMillisecond);
+
+// ---------------- display ----------------
+// Canvas::renderDisplayCache: composite (or its mip level) scaled into a widget-sized cache
+void BM_ZoomedBlit(benchmark::State &state)
+{
+    const double zoom = state.range(0) / 100.0;
+    const TiledImage composite = testLayer(4096);
+    MipPyramid pyramid;
+    pyramid.setBase(&composite);
+    QImage view(1600, 1000, QImage::Format_ARGB32_Premultiplied);
+
+    for (auto _ : state) {
+        const int n = zoom < 1.0 ? pyramid.levelForScale(zoom) : 0;
+        const double z = zoom * (1 << n);
+        QRect src = QRectF(0, 0, view.width() / z, view.height() / z).toAlignedRect();
+        const TiledImage &img = pyramid.level(n, src);
+        src &= img.rect();
+        QPainter p(&view);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.scale(z, z);
+        img.draw(p, src);
+        p.end();
+        benchmark::DoNotOptimize(view.constBits());
+    }
+    state.SetBytesProcessed(state.iterations() * pixelBytes(view.width(), view.height()));
+}
+BENCHMARK(BM_ZoomedBlit)->Arg(10)->Arg(25)->Arg(50)->Arg(100)->Arg(200)->Arg(400)->Unit(benchmark::kMicrosecond);
+
+// full pyramid rebuild after an edit of the whole composite
+void BM_MipRebuild(benchmark::State &state)
+{
+    const TiledImage composite = testLayer(4096);
+    MipPyramid pyramid;
+    pyramid.setBase(&composite);
+    for (auto _ : state) {
+        pyramid.markDirty(composite.rect());
+        const int n = pyramid.levelForScale(0.05);
+        benchmark::DoNotOptimize(pyramid.level(n, QRect(0, 0, composite.width() >> n, composite.height() >> n)).storedTileCount());
+    }
+}
+BENCHMARK(BM_MipRebuild)->Unit(benchmark::kMillisecond);
+
+// ---------------- PNG ----------------
+QByteArray encodePng(const QImage &img, int compression)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, "png");
+    writer.setCompression(compression);
+    writer.write(img);
+    return data;
+}
+
+void BM_PngSave(benchmark::State &state)
+{
+    const QImage img = testLayer(2048).toImage();
+    qint64 bytes = 0;
+    for (auto _ : state) bytes = encodePng(img, int(state.range(0))).size();
+    state.counters["file_bytes"] = double(bytes);
+    state.SetBytesProcessed(state.iterations() * pixelBytes(img.width(), img.height()));
+}
+BENCHMARK(BM_PngSave)->Arg(1)->Arg(6)->Arg(9)->Unit(benchmark::kMillisecond);
+
+// File > Open of a png: importImage() reading and tiling it from disk
+void BM_PngLoad(benchmark::State &state)
+{
+    QTemporaryFile file(QDir::tempPath() + "/epigrimp-bench-XXXXXX.png");
+    if (!file.open() || file.write(encodePng(testLayer(2048).toImage(), 6)) < 0 || !file.flush()) {
+        state.SkipWithError("cannot write the test png");
+        return;
+    }
+    for (auto _ : state) {
+        const ImportedImage r = importImage(file.fileName());
+        benchmark::DoNotOptimize(r.image.storedTileCount());
+    }
+    state.SetBytesProcessed(state.iterations() * pixelBytes(2048, 2048));
+}
+BENCHMARK(BM_PngLoad)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv); // image plugins
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef ADJUSTMENT_H
+#define ADJUSTMENT_H
+
+#include <QHash>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Adjustment layers: a filter kept in the layer stack instead of baked into
+// the pixels. The compositor applies it to what the layers under it blend
+// to, one document tile at a time, and keeps the result per tile (see
+// AdjustmentCache), so painting under it only recomputes the tiles whose
+// input changed. Changing its values costs a recomputation, no pixel undo.
+enum class AdjustmentKind { None, Grayscale, Invert, BrightnessContrast };
+
+struct Adjustment {
+    AdjustmentKind kind = AdjustmentKind::None; // None = a pixel layer
+    QVector<int> values;                        // BrightnessContrast: brightness, contrast (-100..100)
+
+    bool isNull() const { return kind == AdjustmentKind::None; }
+};
+
+namespace Adjustments {
+
+// order = AdjustmentKind, None excluded
+QStringList kindNames();
+QString kindName(AdjustmentKind kind);
+// defaults for a new adjustment of that kind
+QVector<int> defaultValues(AdjustmentKind kind);
+
+// a on a Format_ARGB32_Premultiplied image, in place
+void apply(const Adjustment &a, QImage &img);
+
+// changes with the kind or any value, for the cache keys
+quint64 version(const Adjustment &a);
+
+} // namespace Adjustments
+
+// Composite tiles up to and including one adjustment layer, one entry per
+// document tile. The key is a version of everything under the adjustment
+// in that tile (layer tiles, opacities, modes, transforms) and of the
+// adjustment itself, so an entry is simply replaced once it no longer
+// matches; nothing has to be invalidated by hand. The memory manager trims
+// the least recently used entries over its budget (see trim()).
+class AdjustmentCache {
+public:
+    const QImage *find(int tile, quint64 key) const; // nullptr on a miss, a hit counts as a use
+    void insert(int tile, quint64 key, const QImage &img);
+    void clear();
+    // least recently used entries dropped until at most maxBytes are left
+    void trim(qint64 maxBytes);
+    qint64 byteSize() const { return bytes; }
+
+private:
+    struct Entry {
+        quint64 key = 0;
+        QImage image;
+        mutable quint64 used = 0; // clock of the last find() / insert()
+    };
+    QHash<int, Entry> entries;
+    qint64 bytes = 0;
+    mutable quint64 clock = 0;
+};
+
+#endif // ADJUSTMENT_H
@@ -0,0 +1,28 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QStringList>
+
+// Headless mode, no widget is created:
+//   EpiGrimp --batch pipeline.json [-o outdir] [--prefetch N] files...
+//
+// pipeline.json:
+//   { "steps": [ {"op": "invert"}, {"op": "grayscale"},
+//                {"op": "rotate", "direction": "left" | "right"},
+//                {"op": "flip", "axis": "horizontal" | "vertical"},
+//                {"op": "brightnessContrast", "brightness": 10, "contrast": -5},
+//                {"op": "composite", "file": "logo.png", "mode": "multiply", "opacity": 0.8} ],
+//     "format": "png", "pngCompression": 6, "jpegQuality": 90 }
+//
+// Files go through decode -> steps -> encode as a pipeline: the next files
+// are decoded and the previous ones encoded on worker threads while one is
+// processed (itself spread over all cores). At most N files are held in
+// each of the decode and encode queues, which bounds the memory used.
+namespace BatchRunner {
+
+// arguments as given by QCoreApplication::arguments(); returns the exit code
+int run(const QStringList &arguments);
+
+} // namespace BatchRunner
+
+#endif // BATCHRUNNER_H
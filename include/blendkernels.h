@@ -0,0 +1,49 @@
+#ifndef BLENDKERNELS_H
+#define BLENDKERNELS_H
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+#include <QTransform>
+
+#include "tiledimage.h"
+
+// layer blend modes (separable W3C compositing formulas), order = modeNames()
+enum class BlendMode { Normal, Multiply, Screen, Overlay, Darken, Lighten, Add, Difference };
+
+// Compositing of premultiplied ARGB32 pixels: src goes over dst through a
+// blend mode, weighted by an opacity. One span kernel is instantiated per
+// (mode, full opacity) pair, so the pixel loops test neither of them;
+// transparent source runs are skipped and opaque Normal runs are copied.
+namespace BlendKernels {
+
+QStringList modeNames();
+QString modeName(BlendMode mode);
+
+// n pixels, opacity 0..255
+void blendSpan(quint32 *dst, const quint32 *src, int n, BlendMode mode, int opacity);
+
+// same as QPainter::drawImage(pos, src, srcRect) with the blend mode;
+// dst must be Format_ARGB32_Premultiplied, src too
+void blendImage(QImage &dst, const QPoint &pos, const QImage &src, const QRect &srcRect,
+                BlendMode mode, double opacity);
+// area r of layer into dst at the same position, unstored tiles cost nothing
+void blendLayer(QImage &dst, const TiledImage &layer, const QRect &r, BlendMode mode, double opacity);
+// same with the layer placed by layerToDst (Layer::transform); only the part
+// of the layer under r is read and resampled, exactly for 90 degree steps
+void blendLayer(QImage &dst, const TiledImage &layer, const QTransform &layerToDst, const QRect &r,
+                BlendMode mode, double opacity);
+// src (a part of some layer, its top-left at srcOrigin in layer coordinates) placed by layerToDst
+void blendTransformed(QImage &dst, const QImage &src, const QPoint &srcOrigin, const QTransform &layerToDst,
+                      const QRect &r, BlendMode mode, double opacity);
+// the same two into dst holding the document area at dstOrigin (a composite tile), r in document coordinates
+void blendLayer(QImage &dst, const QPoint &dstOrigin, const TiledImage &layer, const QTransform &layerToDst,
+                const QRect &r, BlendMode mode, double opacity);
+void blendTransformed(QImage &dst, const QPoint &dstOrigin, const QImage &src, const QPoint &srcOrigin,
+                      const QTransform &layerToDst, const QRect &r, BlendMode mode, double opacity);
+
+} // namespace BlendKernels
+
+#endif // BLENDKERNELS_H
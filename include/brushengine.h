@@ -0,0 +1,64 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+
+#include "tiledimage.h"
+
+struct BrushSettings {
+    qreal diameter = 6;
+    qreal hardness = 1.0;  // 0 = soft falloff from the centre, 1 = hard edge (1px antialiasing)
+    qreal spacing = 0.15;  // distance between dabs, fraction of the diameter
+    QColor color = Qt::black;
+    bool eraser = false;
+    bool pressureSize = true; // pressure scales the diameter
+};
+
+// Stroke rasterizer: input points are resampled into evenly spaced dabs,
+// stamped from cached tip masks into a sparse coverage buffer (max of the
+// dabs, so overlaps do not darken). The layer itself is only written once,
+// by finish(); until then drawLayer() shows the layer with the stroke on top.
+class BrushEngine {
+public:
+    // all return the image area whose look changed
+    QRect begin(const QSize &imageSize, const BrushSettings &settings, const QPointF &pos, qreal pressure = 1.0);
+    QRect strokeTo(const QPointF &pos, qreal pressure = 1.0);
+    QRect finish(TiledImage &layer); // merges the buffer (brush = source-over, eraser = destination-out)
+    void cancel();
+
+    bool isActive() const { return active; }
+    QRect bounds() const { return strokeBounds; }
+
+    // area r of layer with the pending stroke applied, drawn at the same position in p
+    void drawLayer(QPainter &p, const TiledImage &layer, const QRect &r) const;
+
+private:
+    QRect stamp(const QPointF &center, qreal pressure);
+    const QImage &tip(qreal diameter, int phaseX, int phaseY);
+    // applies the coverage of area r (image coords) to dst, whose top-left is at origin
+    void applyTo(QImage &dst, const QPoint &origin, const QRect &r) const;
+
+    QSize size;
+    int cols = 0;
+    BrushSettings brush;
+    quint32 premulColor = 0;
+    bool active = false;
+
+    QPointF lastPos;
+    qreal lastPressure = 1.0;
+    qreal toNextDab = 0; // distance left along the path before the next dab
+
+    QHash<int, QImage> coverage; // Format_Alpha8 tiles, index as in TiledImage
+    QRect strokeBounds;
+
+    QHash<quint64, QImage> tips; // Alpha8 masks by size / hardness / sub-pixel phase
+    qreal tipHardness = -1;
+};
+
+#endif // BRUSHENGINE_H
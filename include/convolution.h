@@ -0,0 +1,28 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QVector>
+
+#include "tiledimage.h"
+
+// Neighbourhood filters on Format_ARGB32_Premultiplied layers. Blurs are
+// separable: a horizontal then a vertical pass, each one tile per task with
+// the halo of pixels it needs read from the neighbouring tiles. Box passes
+// use running sums, so their cost per pixel does not depend on the radius;
+// the Gaussian is approximated by three of them. Pixels outside the layer
+// repeat its edge.
+namespace Convolution {
+
+void boxBlur(TiledImage &img, int radius);
+void gaussianBlur(TiledImage &img, double sigma);
+// img + amount % of (img - blur), where the difference reaches threshold (0..255)
+void unsharpMask(TiledImage &img, double sigma, int amount, int threshold);
+// gradient magnitude of every colour channel (3x3 Sobel), alpha kept
+void sobel(TiledImage &img);
+
+// box radii whose successive passes approximate a Gaussian of sigma
+QVector<int> gaussianBoxes(double sigma, int passes = 3);
+
+} // namespace Convolution
+
+#endif // CONVOLUTION_H
@@ -0,0 +1,44 @@
+#ifndef FILTERDIALOG_H
+#define FILTERDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+#include "tiledimage.h"
+
+struct FilterParam {
+    QString label;
+    int minimum = 0;
+    int maximum = 100;
+    int value = 0;
+};
+
+// applies the filter in place, with one value per FilterParam; called from
+// worker threads, so it must only touch the image it is given
+using FilterFn = std::function<void(TiledImage &img, const QVector<int> &values)>;
+
+// Preview dialog for a layer filter. The preview runs on a downscaled proxy
+// of the layer, so it follows the sliders live; the full resolution result
+// is a background job once accepted (see filterjob.h), nothing blocks here.
+class FilterDialog : public QDialog {
+public:
+    FilterDialog(const QString &title, const TiledImage &source, const QVector<FilterParam> &params,
+                 FilterFn fn, QWidget *parent = nullptr);
+
+    QVector<int> values() const;
+
+private:
+    void updatePreview();
+
+    TiledImage proxy;
+    FilterFn fn;
+
+    QLabel *imgLabel = nullptr;
+    QVector<QSlider*> sliders;
+};
+
+#endif // FILTERDIALOG_H
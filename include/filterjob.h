@@ -0,0 +1,37 @@
+#ifndef FILTERJOB_H
+#define FILTERJOB_H
+
+#include <QFuture>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include "filterdialog.h"
+#include "selectionmask.h"
+#include "tiledimage.h"
+
+// A filter applied to a layer in the background. The tiles are done in
+// blocks, those nearest to the visible area first. Each block is reported
+// (QFutureWatcher::resultReadyAt) as soon as it is ready, so the canvas
+// fills in progressively. Cancelling the future stops it at the next block.
+struct FilterJobSpec {
+    TiledImage source;   // the layer as the filter reads it (ARGB32)
+    QVector<int> tiles;  // tiles to produce, see filterJobTiles()
+    FilterFn fn;
+    QVector<int> values;
+    int halo = 0;        // pixels around a tile the filter reads (blur radius), 0 for per-pixel ops
+    SelectionMask mask;  // layer coords; empty = tiles replaced, else merged by coverage
+    QRect focus;         // layer coords, usually the visible area
+};
+
+struct FilterBatch {
+    QVector<int> indices;  // layer tiles
+    QVector<QImage> tiles; // their new content, null = transparent
+};
+
+// every tile the filter may change: stored ones and, with a halo, those it reaches
+QVector<int> filterJobTiles(const TiledImage &source, int halo, const SelectionMask &mask);
+
+QFuture<FilterBatch> startFilterJob(const FilterJobSpec &spec);
+
+#endif // FILTERJOB_H
@@ -0,0 +1,51 @@
+#ifndef GLCANVASVIEW_H
+#define GLCANVASVIEW_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLWidget>
+#include <QRect>
+#include <QVector>
+
+class Canvas;
+struct Layer;
+
+// OpenGL view laid over a Canvas: every layer tile is a texture, blended with
+// its layer opacity while zoom and pan are applied by the shader. A texture is
+// only (re)uploaded when its tile is visible and its cacheKey changed, so
+// panning, zooming and opacity changes never touch the CPU pixels.
+// Mouse input goes through to the Canvas underneath.
+class GLCanvasView : public QOpenGLWidget, protected QOpenGLFunctions {
+public:
+    explicit GLCanvasView(Canvas *canvas);
+    ~GLCanvasView() override;
+
+    void setLayers(const QVector<Layer> *layers, int activeIndex);
+    void layersChanged(const QRect &imageRect); // image coords
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    struct GpuTile {
+        GLuint texture = 0;
+        qint64 key = 0; // cacheKey of the uploaded tile, StrokeKey = stroke preview
+    };
+    static constexpr qint64 StrokeKey = -1;
+
+    void upload(GpuTile &t, const QImage &tile, qint64 key);
+    void releaseTextures();
+
+    Canvas *canvas;
+    const QVector<Layer> *layers = nullptr;
+    int active = -1;
+    QVector<QVector<GpuTile>> textures; // [layer][tile index]
+    QRect strokeDirty;                  // area of the active layer to re-upload from the stroke
+    QOpenGLShaderProgram program;
+    QOpenGLBuffer quad;
+    bool ready = false;
+};
+
+#endif // GLCANVASVIEW_H
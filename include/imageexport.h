@@ -0,0 +1,25 @@
+#ifndef IMAGEEXPORT_H
+#define IMAGEEXPORT_H
+
+#include <QImage>
+#include <QString>
+
+#include "tiledimage.h"
+
+// compression vs speed, chosen in File > Export Settings
+struct ExportSettings {
+    int pngCompression = 6;   // zlib level 0 (fastest, biggest) .. 9 (smallest, slowest)
+    int jpegQuality = 90;     // 0..100
+    bool jpegOptimize = false; // optimized Huffman tables: a bit smaller, a bit slower
+};
+
+// Encodes img into fileName (format from the suffix). The file is replaced
+// only once fully written. Safe to call from worker threads; img is expected
+// to be a shared snapshot, the caller may keep modifying its own copy.
+// Returns an error message, empty on success.
+// PNG is encoded band by band (with libpng), other formats in one go.
+QString exportImage(const QImage &img, const QString &fileName, const ExportSettings &settings);
+// same from a layer: a PNG never needs a flat copy of it
+QString exportImage(const TiledImage &img, const QString &fileName, const ExportSettings &settings);
+
+#endif // IMAGEEXPORT_H
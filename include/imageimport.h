@@ -0,0 +1,18 @@
+#ifndef IMAGEIMPORT_H
+#define IMAGEIMPORT_H
+
+#include <QString>
+
+#include "tiledimage.h"
+
+struct ImportedImage {
+    QString fileName;
+    TiledImage image;
+    QString error; // empty on success
+};
+
+// Decodes a file straight into layer tiles. Safe to call from worker threads
+// (QtConcurrent::mapped over the dropped / selected files).
+ImportedImage importImage(const QString &fileName);
+
+#endif // IMAGEIMPORT_H
@@ -0,0 +1,45 @@
+#ifndef IMAGEOPS_H
+#define IMAGEOPS_H
+
+#include <QImage>
+#include <QSize>
+#include <QTransform>
+#include <functional>
+
+#include "pixelkernels.h"
+#include "tiledimage.h"
+
+// Whole-layer pixel operations, spread over all cores by WorkScheduler.
+// Transparent (unstored) tiles are skipped, so they stay free.
+namespace ImageOps {
+
+// fn on every stored tile, in parallel; writes stay local to the given tile
+void forEachTile(TiledImage &img, const std::function<void(QImage &tile)> &fn);
+
+// the pixel ops below expect Format_ARGB32_Premultiplied layers
+void invert(TiledImage &img);
+void grayscale(TiledImage &img);
+void channelMix(TiledImage &img, const PixelKernels::ChannelMatrix &matrix);
+void applyLut(TiledImage &img, const quint8 lut[256]);
+
+// exact 90 degree rotations and mirrors, built tile by tile
+enum class Orientation { RotateLeft, RotateRight, FlipHorizontal, FlipVertical };
+TiledImage reoriented(const TiledImage &img, Orientation o);
+// what reoriented() does to an image of that size, as a transform (keeps it at the origin)
+QTransform orientationTransform(Orientation o, const QSize &size);
+// 90 degree rotations and mirrors (any translation): pixels map one to one
+bool isLossless(const QTransform &t);
+// pixels resampled into the space t maps them to, placed at the origin;
+// lossless transforms go through reoriented(), others are smooth-filtered
+TiledImage transformed(const TiledImage &img, const QTransform &t);
+
+// every stored tile opaque over the image area (can be repacked to Grayscale8)
+bool isOpaque(const TiledImage &img);
+
+// small flat copy fitted into bound (previews): stored tiles are box-halved
+// in parallel, then the result is smooth-scaled to the exact size
+QImage downscaled(const TiledImage &img, const QSize &bound);
+
+} // namespace ImageOps
+
+#endif // IMAGEOPS_H
@@ -14,35 +14,71 @@
 #include <QListWidget>
 #include <QSlider>
 #include <QStack>
+#include <QRegion>
+#include <QTimer>
+#include <QTransform>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QLockFile>
+#include <QThreadPool>
+#include <QPushButton>
+#include <memory>
+
+#include "adjustment.h"
+#include "blendkernels.h"
+#include "brushengine.h"
+#include "filterdialog.h"
+#include "filterjob.h"
+#include "imageexport.h"
+#include "imageimport.h"
+#include "imageops.h"
+#include "mippyramid.h"
+#include "projectfile.h"
+#include "selectionmask.h"
+#include "textcache.h"
+#include "textitem.h"
+#include "tiledimage.h"
+#include "tilestore.h"
+#include "undohistory.h"
 
 
-struct TextItem {
-    QString text;
-    QPoint position;      // en coordonnées image
-    QFont font;
-    QColor color;
-    QRect boundingRect;   // pour sélection / déplacement
-    bool selected = false;
-};
-
 struct Layer {
     QString name;
-    QImage image;
-    QVector<QImage> undoStack;
-    QVector<QImage> redoStack;
+    TiledImage image;
+    LayerHistory history;  // tile deltas, shares its byte budget with the other layers
     double opacity = 1.0;
+    BlendMode blendMode = BlendMode::Normal;
+    // layer pixels -> image, applied when compositing: rotating or flipping a
+    // layer only changes it (lossless 90 degree steps, kept at the origin)
+    QTransform transform;
+    quint64 lastUsed = 0;  // when it was last the active layer (memory manager order)
+    // adjustment layer: no pixels, the filter is applied to the layers under it
+    Adjustment adjustment;
+    QSharedPointer<AdjustmentCache> adjustmentCache; // created by the compositor, dropped with the layer
+    // packed layer (Alpha8, Grayscale8, RGBA64) being edited in ARGB32: the layer before
+    // and what it was widened to, so that only the tiles the edit wrote get repacked
+    TiledImage packedBase;
+    TiledImage widenedBase;
+
+    bool isAdjustment() const { return !adjustment.isNull(); }
 };
 
+class GLCanvasView;
+
 class Canvas : public QWidget {
     Q_OBJECT
 public:
     explicit Canvas(QWidget *parent = nullptr);
 
-    // set the composited image to display (read-only)
-    void setCompositeImage(const QImage &composite);
+    // set the composited image to display: read in place, never copied, so it must stay alive
+    // dirtyRect (image coords) limits the refresh to the area that changed; null = whole image.
+    // Only visibleImageRect() has to be up to date, see viewChanged()
+    void setCompositeImage(const TiledImage *composite, const QRect &dirtyRect = QRect());
 
     // set pointer to the active layer image (Canvas will draw into this image)
-    void setTargetImage(QImage *target);
+    // transform: the layer's, pointer input and text are mapped into layer pixels with it
+    // paintable = false (adjustment layers): only selections, nothing is written into it
+    void setTargetImage(TiledImage *target, const QTransform &transform = QTransform(), bool paintable = true);
 
     // image access
     QImage getDisplayedImage() const;
@@ -51,55 +87,57 @@ public:
     void setPenColor(const QColor &c);
     void setPenWidth(int w);
     void setEraserMode(bool on);
+    void setBrushHardness(qreal h) { brushHardness = h; }
+
+    // optional OpenGL backend (GLCanvasView): layers are blended from GPU tile
+    // textures instead of the CPU composite. Returns false if not available.
+    bool setGpuBackend(bool on);
+    bool gpuBackend() const { return gpuView != nullptr; }
+    void setLayerStack(const QVector<Layer> *layers, int activeIndex);
+    void layersChanged(const QRect &imageRect); // GPU backend: layer pixels changed in imageRect
 
-    // mainwindow.h, dans Canvas
-    bool isRectSelection() const { return currentTool == RECT_SELECT && _hasSelection; }
-    bool isLassoSelection() const { return currentTool == LASSO_SELECT && _hasSelection; }
-    QPolygon getLassoPolygon() const { return lassoPolygon; }
+    // performance overlay (frame / composite times, dirty area, undo memory), see Profiler
+    void setHudVisible(bool on);
 
+    // stroke being painted (not yet merged into the target), nullptr if none
+    const BrushEngine *activeStroke() const { return brushEngine.isActive() ? &brushEngine : nullptr; }
 
     // zoom
     void setZoom(double z);
+    QRect visibleImageRect() const; // image area shown in the widget (image coords)
 
     // tools
     enum Tool { BRUSH, ERASER, LINE, RECTANGLE, CIRCLE, RECT_SELECT, LASSO_SELECT, TEXT };
     void setTool(Tool t);
     bool hasSelection() const { return _hasSelection; }
     QRect getSelectionRect() const { return selectionRect; }
-    QImage getSelectionImage() const
-    {
-        if (!hasSelection() || !targetImg) return QImage();
-
-        if (currentTool == RECT_SELECT) {
-            return targetImg->copy(selectionRect);
-        } 
-        else if (currentTool == LASSO_SELECT) {
-            if (lassoPolygon.isEmpty()) return QImage();
-            QImage img(selectionRect.size(), QImage::Format_ARGB32_Premultiplied);
-            img.fill(Qt::transparent);
-
-            QPainter painter(&img);
-            QPolygon poly;
-            for (const QPoint &p : lassoPolygon)
-                poly << (p - selectionRect.topLeft());  // position relative à selectionRect
-            painter.setClipRegion(QRegion(poly));
-            painter.drawImage(-selectionRect.topLeft(), *targetImg);
-
-            return img;
-        }
-
-        return QImage();
-    }
+    QImage getSelectionImage() const; // selected pixels of the target, as displayed
+    // selection coverage, image coords / in the target layer's own pixels
+    const SelectionMask &selectionMask() const { return selection; }
+    SelectionMask selectionInTarget() const { return selection.mapped(imageToTarget); }
+
+    // pasted pixels floating above the target: shared with the clipboard buffer,
+    // moved with any tool, written into the layer (one undo step) only when anchored
+    void setFloatingPaste(const QImage &img, const QPoint &pos); // image coords
+    bool hasFloatingPaste() const { return !floatingImage.isNull(); }
+    void commitFloatingPaste();
+    void discardFloatingPaste();
 
     void commitTextItems();
+    // text items still editable (saved in projects)
+    QVector<TextItem> getTextItems() const { return textItems; }
+    void setTextItems(const QVector<TextItem> &items);
 
 signals:
     void strokeStarted(); // emitted on mouse press (before modifying)
-    void strokeFinished(); // emitted on mouse release (after modifying)
+    void strokeFinished(const QRect &dirtyRect); // emitted after modifying; dirtyRect in image coords (empty = no pixel change)
+    void gpuBackendChanged(bool on);
+    void viewChanged(); // visibleImageRect() moved or grew (zoom, resize)
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    void tabletEvent(QTabletEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
@@ -108,10 +146,32 @@ protected:
 private:
     QRect selectionRect;
     QPolygon lassoPolygon;   // pour lasso
+    SelectionMask selection; // built on release from selectionRect / lassoPolygon
     bool selecting = false;
-    QImage composite;  
-    QPoint imageOffset;  // composited image for display
-    QImage *targetImg;  // pointer to active layer image (may be nullptr)
+    TiledImage blankComposite;     // shown until the first setCompositeImage()
+    const TiledImage *composite;   // composited image for display (MainWindow's, not owned)
+    QPoint imageOffset;
+    QImage displayCache;   // composite resampled at current zoom, widget-sized
+    QRegion displayDirty;  // widget areas of displayCache that must be resampled
+    MipPyramid pyramid;    // downscaled tiles of composite, only those shown when zoom < 1
+    TiledImage *targetImg;  // pointer to active layer image (may be nullptr)
+    bool targetPaintable = true;  // false: an adjustment layer, no tool writes into it
+    QTransform targetTransform; // its layer -> image transform
+    QTransform imageToTarget;   // inverse, image -> layer pixels
+    QSize targetSize() const;   // displayed size of the target
+    BrushEngine brushEngine; // brush/eraser stroke, merged into targetImg on release
+
+    // pointer input between two frames
+    struct PointerSample {
+        QPointF pos;      // image coords
+        qreal pressure;
+    };
+    QVector<PointerSample> pendingSamples; // brush samples not rasterized yet
+    qreal tabletPressure = 0.0;            // of the pen's last press / move, 0 = up or a mouse
+    qreal pressureOf(const QMouseEvent *event) const;
+    bool overlayChanged = false;           // selection / text moved, repaint at next frame
+    QTimer frameTimer;                     // single shot, one composite + repaint per display frame
+    qreal brushHardness = 1.0;
     QPoint lastPoint;   // widget coords
     QPoint startPoint;  // for shapes
     int penWidth;
@@ -119,16 +179,39 @@ private:
     bool eraserMode;
 
     QVector<TextItem> textItems;
+    TextItemCache textCache; // rasters + grid over textItems
     int activeTextIndex = -1;
 
+    QImage floatingImage;      // floating paste, null if none
+    QPoint floatingPos;        // its top left, image coords
+    bool movingFloating = false;
+
 
     double zoom;
 
     Tool currentTool;
     bool _hasSelection = false;
 
-    void ensureTargetSizeMatchesWidget();
+    void ensureTargetCoversDocument();
     QPoint widgetToImage(const QPoint &p, const QSize &imgSize);
+    QPointF widgetToImageF(const QPointF &p) const; // sub-pixel, not clamped
+    void scheduleFrame();
+    void processFrame();
+    void paintOverlay(QPainter &painter); // text items + selection outline, widget coords
+    void paintHud(QPainter &painter);
+    void refreshView();
+    void refreshView(const QRect &widgetRect);
+    QRect imageToWidget(const QRect &r) const;
+    void renderDisplayCache(const QRect &widgetRect);
+
+    friend class GLCanvasView;
+    GLCanvasView *gpuView = nullptr;
+    const QVector<Layer> *gpuLayers = nullptr;
+    int gpuActive = -1;
+
+    bool hudVisible = false;
+    QElapsedTimer frameClock; // between two displayed frames
+    double frameMs = 0.0;
 };
 
 class MainWindow : public QMainWindow {
@@ -137,10 +220,18 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow() override;
 
+protected:
+    void dragEnterEvent(QDragEnterEvent *event) override;
+    void dropEvent(QDropEvent *event) override;
+
 private slots:
     // file actions
     void openFile();
     void saveFile();
+    void openProject();
+    void saveProject();
+    void saveProjectAs();
+    void editExportSettings();
     void clearCanvas();
 
     // layer actions
@@ -161,7 +252,7 @@ private slots:
 
     // canvas events
     void onStrokeStarted();
-    void onStrokeFinished();
+    void onStrokeFinished(const QRect &dirtyRect);
 
     // Day 5 transforms
     void zoomIn();
@@ -174,16 +265,31 @@ private slots:
     // Day 8 filters
     void grayscale();
     void invertColors();
+    void brightnessContrast();
+    void levels();
+    void channelMixer();
+    void gaussianBlur();
+    void boxBlur();
+    void unsharpMask();
+    void edgeDetect();
 
     void pasteSelection();
     void copySelection();
     void cutSelection();
+    void anchorPaste();    // floating paste written into the active layer
+    void fillSelection();  // brush colour, weighted by the selection coverage
 
     void onLayerContextMenu(const QPoint &pos);
     void duplicateLayer();
     void deleteLayer();
     void renameLayer();
     void changeLayerOpacity();
+    void changeLayerBlendMode();
+    void applyActiveLayerTransform(); // resample the layer, its transform becomes identity
+    void changeLayerFormat();
+    void setActiveLayerFormat(QImage::Format format); // repack (undoable), Grayscale8 needs an opaque layer
+    void addAdjustmentLayer(AdjustmentKind kind); // on top, applied to everything under it
+    void editAdjustment();                        // values of the active adjustment layer, previewed
 
 
 private:
@@ -192,11 +298,58 @@ private:
     void setupToolbarAndPalette();
     void setupLayerPanel();
     void openPNGAsNewLayer();
+    void startImport(const QStringList &files, bool asNewLayers); // decoded on worker threads
+    void onImportFinished();
+    void addLayerFromImport(const ImportedImage &imported);
+    bool loadProjectFile(const QString &fileName);
+    ProjectData projectSnapshot() const; // shares every tile, cheap
+    void startProjectSave(const QString &fileName);
+    void setupAutosave();
+    void autosave();                     // checkpoint into the journal if anything changed
+    void recoverSession();
 
     // layers & compositing
+    QSize documentSize() const;          // bottom layer as displayed
+    void growDocument(const QSize &size); // every layer extended to at least size (image coords)
+    void targetActiveLayer();            // canvas tools write into the active layer (not an adjustment one)
+    bool activeLayerHasPixels(const QString &what); // false (says so) on an adjustment layer; what = the verb refused
     void compositeLayers();              // recompute composite (paint layers bottom->top)
-    void pushUndoForActiveLayer();       // push snapshot into undo stack (called at stroke start)
+    void compositeLayers(const QRect &dirtyRect); // re-blend only dirtyRect (image coords)
+    void blendComposite(const QRect &r);  // CPU blend into composite
+    QRect blendStale(const QRect &r);     // blend the part of r not up to date, returns its bounds
+    // layer i over dst in r (document coords, dst holding the area at origin), with the stroke being painted
+    void blendLayerInto(QImage &dst, const QPoint &origin, int i, const QRect &r);
+    void placeTile(int t, const QRect &r, const QImage &img); // area r of composite tile t = img's (null = transparent)
+    bool hasAdjustmentLayers() const;
+    qint64 adjustmentCacheBytes() const;  // every adjustment layer's cached tiles
+    void blendAdjustedComposite(const QRect &r); // per tile, from the topmost adjustment cache still valid
+    void blendPlainLayers(int t, const QRect &r); // layers under cachePlainTop into composite tile t, from the caches
+    TiledImage flattenedBelow(int i);     // layers under i, whole document (adjustment preview)
+    TiledImage flattenedComposite();      // up to date composite, also off screen and with the GPU backend
+    void invalidateCompositeCache();     // below/above caches must be rebuilt (layer stack changed)
+    void rebuildCompositeCache();
+    void cacheTile(int t);                // flatten the below / above caches in composite tile t
+    void trimComposite();                 // drop composite tiles out of sight over the budget
+    void updateCompositeCache(int layer, const QRect &r); // layer changed in r (document), the cache holding it is blended again there
+    // push snapshot into undo stack (called at stroke start); writesPixels: a packed layer is edited in ARGB32
+    void pushUndoForActiveLayer(bool writesPixels = true);
     void clearRedoForActiveLayer();
+    void repackLayer(int i);             // a widened packed layer back to its format, once its edit is over
+    // preview dialog, then one undo step filled in the background (see FilterJobSpec); false if canceled
+    // halo: pixels each tile reads around it, for the accepted values
+    bool applyFilter(const QString &title, const QString &doneText, const QString &cancelText,
+                     const QVector<FilterParam> &params, const FilterFn &fn,
+                     const std::function<int(const QVector<int> &)> &halo = nullptr);
+    void submitFilterJob(const TiledImage &source, const QVector<int> &tiles);
+    void onFilterBatchReady(int index);  // tiles written into the layer as their block is done
+    void onFilterJobFinished();
+    void interruptFilterJob();           // its layer is edited: stop, the rest is redone afterwards
+    void resubmitFilterJob();
+    void cancelFilterJob();              // layer replaced / stack changed: keep what is written, drop the rest
+    void enforceUndoBudget();            // drop the oldest steps of all layers until under budget
+    void trimLayerMemory();              // compress / spill the least recently used inactive layers until under budget
+    void historyChanged(const Layer &L, const QTransform &before, const QRect &layerRect); // after undo / redo
+    void orientActiveLayer(ImageOps::Orientation o, const QString &doneText); // O(1), only the layer transform
 
     Canvas *canvas;
     QLabel *statusLabel;
@@ -205,6 +358,60 @@ private:
 
     QVector<Layer> layers;
     int activeLayerIndex;
+    // flattened layers as tiles, updated in place by compositeLayers(). Only the tiles
+    // shown (or saved) are blended, and those out of sight dropped over the budget, so
+    // it takes memory in proportion to the view, not to the document
+    TiledImage composite;
+    TiledImage belowCache;               // layers under activeLayerIndex, pre-flattened per tile
+    TiledImage aboveCache;               // layers above activeLayerIndex, pre-flattened (null if not all Normal)
+    QVector<char> cachedTiles;           // per composite tile: caches flattened there
+    int cacheActiveIndex = -1;           // active layer the caches were built for (-1 = invalid)
+    int cachePlainTop = 0;               // first adjustment layer then (layer count if none), the caches stop under it
+    QRegion staleComposite;              // area of composite not blended yet (off screen, GPU backend)
+
+    qint64 undoBudgetBytes = qint64(512) << 20; // shared by every layer's history
+    bool compressUndo = true;                   // zlib the steps below the top one
+
+    // inactive layers over the budget go to the tile store (zlib, then a scratch file)
+    QSharedPointer<TileStore> tileStore;
+    QTimer memoryTimer;
+    qint64 layerBudgetBytes = qint64(4096) << 20; // uncompressed layer pixels
+    quint64 useClock = 0;
+
+    // running filter: one job at a time, its blocks stream into filterLayer
+    QFutureWatcher<FilterBatch> filterWatcher;
+    FilterJobSpec filterSpec;            // the current submission
+    TiledImage filterOriginal;           // the layer as the filter was accepted, read again on resubmit
+    QVector<char> filterPending;         // per tile: still to be written
+    int filterLayer = -1;                // -1 = no job
+    QString filterDoneText;
+    std::function<void()> filterOnDone;  // once every tile is written
+    QTimer filterResubmitTimer;          // single shot, after an edit interrupted the job
+
+    // background import (open / drop)
+    QFutureWatcher<ImportedImage> importWatcher;
+    bool importAsLayers = false;
+    QPushButton *cancelImportBtn = nullptr;
+
+    // background saves, each encodes its own snapshot of the composite
+    ExportSettings exportSettings;
+    QList<QFutureWatcher<QString>*> saveJobs;
+
+    // open .grimp project: the next save to it only appends the changed tiles
+    ProjectFileState project;
+    QFutureWatcher<ProjectSaveResult> projectSaveWatcher;
+    bool compressProject = false; // zlib tiles: smaller file, slower to save and open
+
+    // crash recovery: a journal in the .grimp format, each checkpoint appends the
+    // tiles changed since the previous one, written by one low priority thread
+    QTimer autosaveTimer;
+    QThreadPool autosavePool;
+    QFutureWatcher<ProjectSaveResult> autosaveWatcher;
+    ProjectFileState autosaveState;
+    std::unique_ptr<QLockFile> autosaveLock; // null: another instance owns the journal
+    QString autosaveFileName;
+    bool autosavePending = false;            // changed since the last checkpoint (undo snapshots, layer stack edits)
+    int autosaveSeconds = 60;                // 0 = off
 
     // current tool state
     int brushSize;
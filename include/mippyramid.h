@@ -0,0 +1,43 @@
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QVector>
+
+#include "tiledimage.h"
+
+// Chain of half-size copies (1/2, 1/4, ...) of a tiled base image, each
+// tiled too and built lazily: a level only recomputes the tiles it is asked
+// for that were marked dirty since, so a view costs the tiles it shows, not
+// the document.
+class MipPyramid {
+public:
+    // base (ARGB32 premultiplied) is not owned and must stay alive; every level becomes dirty
+    void setBase(const TiledImage *base);
+    // baseRect (level 0 coords) changed in the base image
+    void markDirty(const QRect &baseRect);
+
+    // deepest level whose scale (1 / 2^n) is still >= scale, 0 = base
+    int levelForScale(double scale) const;
+    // level n (0 = base itself) with area r (level n coords) up to date
+    const TiledImage &level(int n, const QRect &r);
+
+    qint64 memoryBytes() const; // tiles of the levels, not the base
+
+    // box-filtered half-size copy of src
+    static QImage halved(const QImage &src);
+
+private:
+    void refresh(int i, const QRect &r);
+    static void downsample(const QImage &src, QImage &dst, const QRect &dstRect);
+    int maxLevel() const;
+
+    const TiledImage *base = nullptr;
+    QVector<TiledImage> levels; // levels[i] = level i + 1
+    QVector<QRegion> dirty;     // per entry of levels, in that level's coords
+};
+
+#endif // MIPPYRAMID_H
@@ -0,0 +1,37 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QImage>
+#include <QtGlobal>
+
+// Per-pixel operations on premultiplied ARGB32 scanlines (Format_ARGB32_Premultiplied),
+// applied in place on n pixels. The fastest implementation the CPU supports
+// (AVX2 / SSE2 / NEON, scalar fallback) is picked once at first use.
+namespace PixelKernels {
+
+// 3x3 colour matrix in 8.8 fixed point (256 = 1.0), rows = output r, g, b
+struct ChannelMatrix {
+    qint16 m[3][3];
+};
+
+// linear ops, computed directly on premultiplied values
+void invert(quint32 *px, int n);
+void grayscale(quint32 *px, int n);                 // qGray weights (11, 16, 5) / 32
+void channelMix(quint32 *px, int n, const ChannelMatrix &matrix);
+
+// non linear ops go through a 256 entry table on unpremultiplied r, g, b
+// (vectorized for opaque pixels: AVX2 gathers, NEON table lookups)
+void applyLut(quint32 *px, int n, const quint8 lut[256]);
+void makeBrightnessContrastLut(quint8 lut[256], int brightness, int contrast); // both -100..100
+void makeLevelsLut(quint8 lut[256], int inBlack, int inWhite, double gamma, int outBlack, int outWhite);
+
+// n pixels of a packed layer (Alpha8, Grayscale8, RGBA64_Premultiplied or
+// ARGB32_Premultiplied itself) as premultiplied ARGB32, for blending in place
+void unpackToArgb32(quint32 *dst, const uchar *src, int n, QImage::Format format);
+
+// "avx2", "sse2", "neon" or "scalar"
+const char *implementationName();
+
+} // namespace PixelKernels
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Lightweight instrumentation, meant to stay in release builds.
+// EPIGRIMP_PROFILE_SCOPE("name") times the enclosing block. While the
+// profiler is off (default, see setEnabled / EPIGRIMP_PROFILE=1) a scope
+// costs one relaxed atomic load; defining EPIGRIMP_NO_PROFILER removes
+// them entirely. Names must be string literals (kept as pointers).
+namespace Profiler {
+
+namespace detail {
+extern std::atomic<bool> enabled;
+qint64 now(); // ns since the profiler was started
+void record(const char *name, qint64 start, qint64 end);
+void recordCounter(const char *name, qint64 value);
+} // namespace detail
+
+inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool on);
+
+class Scope {
+public:
+    explicit Scope(const char *name) : name(isEnabled() ? name : nullptr)
+    {
+        if (this->name) start = detail::now();
+    }
+    ~Scope()
+    {
+        if (name) detail::record(name, start, detail::now());
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name;
+    qint64 start = 0;
+};
+
+// value over time (dirty area, memory...), shown as a track in the trace
+inline void counter(const char *name, qint64 value)
+{
+    if (isEnabled()) detail::recordCounter(name, value);
+}
+
+// HUD readouts: last duration of a scope in ms / last counter value, -1 if none yet
+double lastMs(const char *name);
+qint64 lastCounter(const char *name);
+
+// recorded events as Chrome trace-event JSON (chrome://tracing, Perfetto),
+// returns an error message, empty on success
+QString saveTrace(const QString &fileName);
+void clear();
+
+} // namespace Profiler
+
+#ifdef EPIGRIMP_NO_PROFILER
+#define EPIGRIMP_PROFILE_SCOPE(name)
+#else
+#define EPIGRIMP_PROFILE_CONCAT2(a, b) a##b
+#define EPIGRIMP_PROFILE_CONCAT(a, b) EPIGRIMP_PROFILE_CONCAT2(a, b)
+#define EPIGRIMP_PROFILE_SCOPE(name) const Profiler::Scope EPIGRIMP_PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,73 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QTransform>
+#include <QVector>
+
+#include "adjustment.h"
+#include "blendkernels.h"
+#include "textitem.h"
+#include "tiledimage.h"
+
+// Native .grimp projects: layers with their opacity / blend mode (or the
+// settings of an adjustment layer), and the text items not yet rasterized.
+//
+// File layout: a fixed header, tile chunks (raw, in the layer's storage format, or
+// zlib), then an index (QDataStream) that the header points to. Opening
+// only reads the index and maps the file; a tile is read from the mapping
+// (raw chunks are used in place, without copy) the first time it is
+// composited or painted. Saving again to the same file appends only the
+// tiles that changed since the last save, then a new index, and switches
+// the header last, so an interrupted save leaves the previous state.
+// The file is rewritten from scratch once more than half of it is stale.
+
+struct ProjectLayer {
+    QString name;
+    TiledImage image;
+    double opacity = 1.0;
+    BlendMode blendMode = BlendMode::Normal;
+    QTransform transform; // Layer::transform, tiles are stored untransformed
+    Adjustment adjustment; // adjustment layer: no tile stored, the filter and its values
+};
+
+struct ProjectData {
+    QSize size;
+    QVector<ProjectLayer> layers; // bottom first
+    int activeLayer = 0;
+    QVector<TextItem> texts;
+};
+
+// where a tile lives in a project file
+struct ProjectChunk {
+    qint64 offset = 0;
+    qint32 size = 0;       // bytes in the file
+    quint8 encoding = 0;   // 0 = raw, 1 = zlib
+};
+
+// what a project file already holds, kept between saves of an open project
+struct ProjectFileState {
+    QString fileName;
+    quint64 generation = 0;               // changes when the file is rewritten
+    QHash<qint64, ProjectChunk> chunks;   // tile cacheKey -> chunk holding those pixels
+    qint64 liveBytes = 0;                 // chunk bytes the current index uses
+};
+
+// index only: the layers page their tiles in from the mapped file
+QString loadProject(const QString &fileName, ProjectData *data, ProjectFileState *state);
+
+struct ProjectSaveResult {
+    QString error;          // empty on success
+    ProjectFileState state; // replaces the previous one on success
+    int tilesWritten = 0;
+    int tilesReused = 0;
+    bool rewritten = false; // full write instead of an append
+};
+
+// data is a snapshot (shared tiles), so the save can run on a worker thread
+ProjectSaveResult saveProject(const ProjectData &data, const QString &fileName,
+                              const ProjectFileState &previous, bool compress);
+
+#endif // PROJECTFILE_H
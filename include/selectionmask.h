@@ -0,0 +1,61 @@
+#ifndef SELECTIONMASK_H
+#define SELECTIONMASK_H
+
+#include <QColor>
+#include <QImage>
+#include <QPolygon>
+#include <QRect>
+#include <QTransform>
+#include <QVector>
+#include <functional>
+
+#include "tiledimage.h"
+
+// Selection as 8 bit coverage, stored as run-length spans per row: memory and
+// work follow the outline, not the area. Every operation walks the spans
+// only (tile rows in parallel), pixels outside the selection are never read
+// and their tiles stay shared.
+class SelectionMask {
+public:
+    struct Span {
+        int x0, x1;       // [x0, x1) on its row
+        quint8 coverage;  // 255 = fully selected
+    };
+
+    SelectionMask() = default;
+    static SelectionMask fromRect(const QRect &r);
+    static SelectionMask fromPolygon(const QPolygon &poly); // odd-even, pixel centers inside
+    // lasso points reduced to the ones that change the outline by more than tolerance (pixels)
+    static QPolygon simplified(const QPolygon &poly, qreal tolerance);
+
+    bool isEmpty() const { return box.isEmpty(); }
+    QRect bounds() const { return box; }
+    const QVector<Span> &spans(int y) const; // empty outside bounds()
+    quint8 coverageAt(int x, int y) const;
+    // the same pixels through t (layer transforms): 90 degree steps, flips and whole
+    // pixel moves map the spans themselves, anything else samples every pixel
+    SelectionMask mapped(const QTransform &t) const;
+    SelectionMask clipped(const QRect &r) const; // the part inside r
+
+    // pixels under the mask, bounds() sized, transparent where not selected
+    QImage copy(const TiledImage &img) const;
+    void clear(TiledImage &img) const;                  // cut
+    void fill(TiledImage &img, const QColor &color) const;
+    // copy of img holding only the tiles the mask touches and their neighbours (shared):
+    // filters run on those only
+    TiledImage selectedTiles(const TiledImage &img) const;
+    // selected pixels of src into dst, weighted by coverage (filter result back into the layer)
+    void merge(TiledImage &dst, const TiledImage &src) const;
+
+private:
+    SelectionMask sampled(const QTransform &t) const; // mapped() pixel by pixel
+    // fn on every span segment within one tile; tiles are made writable (and
+    // allocated when create) before the workers start
+    void forEachSegment(TiledImage &img, bool create,
+                        const std::function<void(quint32 *px, int n, int x, int y, quint8 coverage)> &fn) const;
+
+    QRect box;
+    QVector<QVector<Span>> rows; // rows[y - box.top()]
+};
+
+#endif // SELECTIONMASK_H
@@ -0,0 +1,49 @@
+#ifndef TEXTCACHE_H
+#define TEXTCACHE_H
+
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "textitem.h"
+
+// Text items rasterized once (per text / font / color / scale) and indexed in a
+// uniform grid, so that painting and hit testing follow what is visible or
+// clicked, not the number of items. Indices are those of the canvas list.
+class TextItemCache {
+public:
+    static QRect itemRect(const TextItem &t) { return t.boundingRect.translated(t.position); } // image coords
+    static QRect paddedRect(const TextItem &t) { return itemRect(t).adjusted(-2, -2, 2, 2); }  // antialiased edges
+
+    void reset(const QVector<TextItem> &items); // list replaced or cleared
+    void append(const TextItem &item);          // index = previous count
+    void update(int index, const QRect &oldRect, const TextItem &item); // moved or edited
+
+    QVector<int> itemsIn(const QRect &r) const; // intersecting r, ascending = paint order
+    int itemAt(const QVector<TextItem> &items, const QPoint &p) const; // topmost containing p, -1 if none
+
+    // the item drawn at scale, premultiplied, covering paddedRect(item) * scale
+    const QImage &raster(int index, const TextItem &item, qreal scale);
+
+private:
+    static constexpr int CellSize = 256; // image pixels
+    void insert(int index, const QRect &r);
+    void remove(int index, const QRect &r);
+
+    struct Raster {
+        QString text;
+        QFont font;
+        QColor color;
+        QRect box;
+        qreal scale = 0;
+        QImage image;
+    };
+    QHash<quint64, QVector<int>> cells; // cell (x, y) -> items touching it
+    QVector<Raster> rasters;
+};
+
+#endif // TEXTCACHE_H
@@ -0,0 +1,20 @@
+#ifndef TEXTITEM_H
+#define TEXTITEM_H
+
+#include <QColor>
+#include <QFont>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+
+// text not yet rasterized into a layer (Text tool), kept in project files
+struct TextItem {
+    QString text;
+    QPoint position;      // en coordonnées image
+    QFont font;
+    QColor color;
+    QRect boundingRect;   // pour sélection / déplacement
+    bool selected = false;
+};
+
+#endif // TEXTITEM_H
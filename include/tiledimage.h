@@ -0,0 +1,139 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QColor>
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+// Read-only store of tiles that are only brought into memory on first use
+// (project files). tile() may be called from several threads at once; the
+// returned reference stays valid as long as the source lives.
+class TileSource {
+public:
+    TileSource() : id(nextId.fetch_add(1, std::memory_order_relaxed)) {}
+    virtual ~TileSource() = default;
+
+    const quint64 id; // never given to another source, unlike its address (cache keys)
+    virtual const QImage &tile(int chunk) const = 0; // null = transparent
+
+    // decoded tiles it keeps, not those pointing into a mapped file (memory budget)
+    virtual qint64 residentBytes() const { return 0; }
+    // the same tiles with nothing decoded yet, null if it cannot; the memory
+    // manager swaps it in for this one to drop what it keeps
+    virtual QSharedPointer<const TileSource> reopened() const { return {}; }
+    // source and chunk the pixels of chunk are really read from (views reading another source through)
+    virtual const TileSource *origin(int chunk, int *originChunk) const
+    {
+        *originChunk = chunk;
+        return this;
+    }
+
+private:
+    static std::atomic<quint64> nextId;
+};
+
+// Sparse layer storage: the image is split into TileSize x TileSize tiles,
+// all in format() (Format_ARGB32_Premultiplied unless repacked, see
+// convertedTo()). Fully transparent tiles are not stored (null QImage).
+// Tiles are implicitly shared, so copying a TiledImage is cheap and only the
+// tiles written afterwards get duplicated (copy-on-write).
+class TiledImage {
+public:
+    static constexpr int TileSize = 256;
+
+    TiledImage() = default;
+    explicit TiledImage(const QSize &size, QImage::Format format = QImage::Format_ARGB32_Premultiplied); // no tile stored
+    static TiledImage fromImage(const QImage &img);
+    // rows y.. of the image replaced by src (any format, full width), e.g. a
+    // band from a streaming decoder; y a multiple of TileSize, and so is
+    // src.height() unless it reaches the bottom. ARGB32 images only.
+    void setRows(int y, const QImage &src);
+    // tile i is chunks[i] of source (-1 = transparent), read when first used
+    static TiledImage fromSource(const QSize &size, const QSharedPointer<const TileSource> &source,
+                                 const QVector<int> &chunks, QImage::Format format = QImage::Format_ARGB32_Premultiplied);
+
+    QSize size() const { return sz; }
+    int width() const { return sz.width(); }
+    int height() const { return sz.height(); }
+    QRect rect() const { return QRect(QPoint(0, 0), sz); }
+    bool isNull() const { return sz.isEmpty(); }
+
+    // storage: ARGB32_Premultiplied (what editing works on), Alpha8 (masks,
+    // colour dropped), Grayscale8 (opaque gray) or RGBA64_Premultiplied
+    QImage::Format format() const { return fmt; }
+    static bool isStorageFormat(QImage::Format f);
+    static int bytesPerPixel(QImage::Format f);
+    TiledImage convertedTo(QImage::Format f) const; // every tile converted, transparent ones stay unstored
+
+    // grow/shrink the canvas, existing pixels keep their position
+    void resize(const QSize &size);
+    // transparent drops every tile, any other colour shares a single tile
+    void fill(const QColor &color);
+
+    // flat ARGB32 premultiplied copies (transparent where no tile is stored)
+    QImage toImage() const;
+    QImage copy(const QRect &r) const;
+
+    // draw area r of the image at the same position in painter coordinates
+    void draw(QPainter &p, const QRect &r) const;
+
+    // paint inside r: fn gets a painter per touched tile, translated and clipped
+    // so that it can draw in image coordinates. With createMissing = false,
+    // transparent tiles are skipped (e.g. erasing).
+    void paint(const QRect &r, const std::function<void(QPainter &)> &fn, bool createMissing = true);
+
+    // drop tiles inside r that became fully transparent
+    void squeeze(const QRect &r);
+
+    // tile access, index = row * tileColumns() + column
+    int tileColumns() const { return cols; }
+    int tileRows() const { return rows; }
+    int tileCount() const { return tiles.size(); }
+    QRect tileRect(int index) const;
+    const QImage &tile(int index) const                     // null = transparent
+    {
+        return tiles[index].isNull() && source ? sourceTile(index) : tiles[index];
+    }
+    QImage &tileForWrite(int index);                        // detached, allocated if missing
+    void setTile(int index, const QImage &img);
+    QVector<int> tilesIn(const QRect &r) const;             // indices of tiles touching r
+
+    // same pixels in both images (shared or same source chunk), without paging anything in
+    bool sameTile(const TiledImage &other, int index) const;
+    // stands for the pixels of tile index without paging them in; changes when
+    // the tile is written, 0 = transparent (cache keys, see AdjustmentCache)
+    quint64 tileVersion(int index) const;
+    // chunk of tileSource() tile index still comes from, -1 if written since (or no source)
+    int sourceChunk(int index) const { return source && tiles[index].isNull() ? chunks[index] : -1; }
+    const TileSource *tileSource() const { return source.data(); }
+    QSharedPointer<const TileSource> sharedTileSource() const { return source; }
+    // the same image reading its chunks from s, which must hold the same tiles (see TileSource::reopened())
+    TiledImage withSource(const QSharedPointer<const TileSource> &s) const;
+
+    int storedTileCount() const;
+    qint64 memoryBytes() const; // tiles held by the image itself, not the ones its source keeps
+
+    static bool isTransparent(const QImage &tile); // never for Grayscale8
+
+private:
+    QImage blankTile() const;
+    const QImage &sourceTile(int index) const;
+    void dropSource(int index);
+
+    QSize sz = QSize(0, 0);
+    QImage::Format fmt = QImage::Format_ARGB32_Premultiplied;
+    int cols = 0;
+    int rows = 0;
+    QVector<QImage> tiles;
+    // lazily read tiles: used where tiles[i] is null and chunks[i] >= 0
+    QSharedPointer<const TileSource> source;
+    QVector<int> chunks;
+};
+
+#endif // TILEDIMAGE_H
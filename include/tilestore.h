@@ -0,0 +1,93 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QTemporaryFile>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+#include "tiledimage.h"
+
+// Tiles the memory manager took out of inactive layers. Each chunk is zlib
+// data (fast level) kept in RAM until spill() moves the least recently used
+// ones to a scratch file. Chunks are counted by the views (StoreTileSource)
+// using them and freed with the last one. Thread safe.
+class TileStore {
+public:
+    TileStore();
+
+    int put(const QImage &tile); // compressed in the calling thread, no reference yet
+    void addRef(int chunk);
+    void release(int chunk);
+    QImage get(int chunk, QImage::Format format) const; // decompressed, read back from disk if spilled
+
+    // oldest used chunks to the scratch file until at most maxRamBytes stay compressed in RAM
+    void spill(qint64 maxRamBytes);
+
+    struct Stats {
+        qint64 ramBytes = 0;  // compressed, in memory
+        qint64 diskBytes = 0; // compressed, in the scratch file
+        int chunks = 0;
+    };
+    Stats stats() const;
+
+private:
+    struct Chunk {
+        QByteArray data;     // empty once spilled
+        qint64 offset = -1;  // in the scratch file, -1 = in RAM
+        qint32 size = 0;
+        mutable quint64 lastUse = 0;
+        int refs = 0;
+    };
+
+    mutable QMutex mutex;
+    QVector<Chunk> chunks;
+    QVector<int> freeIds;
+    mutable QTemporaryFile file; // opened at the first spill
+    qint64 fileEnd = 0;
+    mutable quint64 clock = 0;
+    Stats totals;
+};
+
+// tiles of one layer in a TileStore, decompressed on first use and kept as
+// long as the view lives (the memory manager replaces the view to drop them).
+// Tiles still in the layer's earlier source (a project file) are not copied:
+// the view reads them from base, which keeps its own cache.
+class StoreTileSource : public TileSource {
+public:
+    StoreTileSource(const QSharedPointer<TileStore> &store, const QVector<int> &chunks, QImage::Format format,
+                    const QSharedPointer<const TileSource> &base = {}, const QVector<int> &baseChunks = {});
+    ~StoreTileSource() override;
+
+    const QImage &tile(int chunk) const override;
+    qint64 residentBytes() const override { return resident.load(std::memory_order_relaxed); }
+    const TileSource *origin(int chunk, int *originChunk) const override;
+
+    const QSharedPointer<TileStore> store;
+    const QVector<int> chunks; // store chunk of each local chunk, -1 = read from base
+    const QImage::Format format;
+    const QSharedPointer<const TileSource> base;
+    const QVector<int> baseChunks; // chunk of base for the local chunks read from it
+
+private:
+    mutable QVector<QImage> cache;
+    mutable std::unique_ptr<std::atomic<bool>[]> ready;
+    mutable std::atomic<qint64> resident{0};
+    mutable QMutex cacheMutex;
+};
+
+// img with every tile moved into store (shared tiles once, tiles already
+// in that store not written again); tiles still in another source (the
+// project file) stay there, and transparent tiles stay unstored
+TiledImage storedIn(const TiledImage &img, const QSharedPointer<TileStore> &store);
+
+// every image reading decoded tiles from a source that can be reopened
+// (project files, also through store views) gets the reopened one, the same
+// one for all images sharing a source, so what was decoded is freed
+void dropDecodedTiles(const QVector<TiledImage *> &images);
+
+#endif // TILESTORE_H
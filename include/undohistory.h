@@ -0,0 +1,80 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QTransform>
+#include <QVector>
+
+#include "tiledimage.h"
+
+// One undo step: only the tiles that differ between two states of a layer,
+// and its transform when that changed. Applying it swaps them with the
+// layer's, so the same object then holds the step in the other direction
+// (undo <-> redo).
+class UndoDelta {
+public:
+    static UndoDelta between(const TiledImage &before, const QTransform &beforeTransform,
+                             const TiledImage &after, const QTransform &afterTransform);
+
+    bool isEmpty() const { return indices.isEmpty() && !whole && !hasTransform; }
+    qint64 byteSize() const;
+    QRect affectedRect() const; // layer area covered by the stored tiles
+
+    void swapWith(TiledImage &img, QTransform &layerTransform);
+    void compress();   // keep the tiles as zlib data until the next swap
+
+private:
+    static UndoDelta wholeImage(const TiledImage &img);
+    void unpack();
+
+    QSize size;             // size of the image the tiles come from
+    QImage::Format format = QImage::Format_ARGB32_Premultiplied; // and its storage format
+    bool whole = false;     // size or format changed: tiles describe the entire image
+    bool compressed = false;
+    QVector<int> indices;
+    QVector<QImage> tiles;  // null = transparent tile
+    QVector<QByteArray> packed;
+    bool hasTransform = false; // transform: the layer's before this step
+    QTransform transform;
+};
+
+// Undo/redo of one layer. begin() only keeps a shared snapshot; it is turned
+// into a delta the next time the history is used (commit()).
+class LayerHistory {
+public:
+    void begin(const TiledImage &current, const QTransform &transform, bool compressOlder);
+    void commit(const TiledImage &current, const QTransform &transform, bool compressOlder);
+
+    bool canUndo() const { return !undoSteps.isEmpty(); }
+    bool canRedo() const { return !redoSteps.isEmpty(); }
+    // both return the area that changed in img (layer coordinates)
+    QRect undo(TiledImage &img, QTransform &transform);
+    QRect redo(TiledImage &img, QTransform &transform);
+
+    void clear();
+    void clearRedo() { redoSteps.clear(); }
+
+    qint64 byteSize() const;
+    // serial of the oldest undo step (global order across layers), false if none
+    bool oldestSerial(quint64 *serial) const;
+    qint64 dropOldest(); // returns the bytes released
+    void compressAll();  // every step, top one included (layer put aside)
+
+private:
+    struct Step {
+        UndoDelta delta;
+        quint64 serial;
+    };
+    static quint64 nextSerial;
+
+    QVector<Step> undoSteps;
+    QVector<Step> redoSteps;
+    TiledImage pendingBase;
+    QTransform pendingTransform;
+    bool pending = false;
+};
+
+#endif // UNDOHISTORY_H
@@ -0,0 +1,26 @@
+#ifndef WORKSCHEDULER_H
+#define WORKSCHEDULER_H
+
+#include <functional>
+
+// Shared CPU work splitting on top of QThreadPool::globalInstance().
+// The calling thread takes part in the work and the calls return once every
+// item is done, so callers see plain synchronous functions.
+//
+// Items run concurrently: fn must only write data owned by its item. Take
+// QImage::bits()/scanLine() pointers before the call, not inside fn, since
+// those detach (and are not safe to call on one QImage from several threads).
+namespace WorkScheduler {
+
+// threads used by a parallel call, the caller included
+int threadCount();
+
+// fn(i) for every i in [0, count)
+void parallelFor(int count, const std::function<void(int)> &fn);
+
+// fn(y0, y1) on bands [y0, y1) of at least minRows rows covering [begin, end)
+void parallelForRows(int begin, int end, const std::function<void(int, int)> &fn, int minRows = 32);
+
+} // namespace WorkScheduler
+
+#endif // WORKSCHEDULER_H
@@ -0,0 +1,92 @@
+#include "adjustment.h"
+#include "pixelkernels.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Adjustments {
+
+QStringList kindNames()
+{
+    return {"Grayscale", "Invert", "Brightness / Contrast"};
+}
+
+QString kindName(AdjustmentKind kind)
+{
+    return kindNames().value(int(kind) - 1);
+}
+
+QVector<int> defaultValues(AdjustmentKind kind)
+{
+    return kind == AdjustmentKind::BrightnessContrast ? QVector<int>{0, 0} : QVector<int>();
+}
+
+void apply(const Adjustment &a, QImage &img)
+{
+    quint8 lut[256];
+    if (a.kind == AdjustmentKind::BrightnessContrast)
+        PixelKernels::makeBrightnessContrastLut(lut, a.values.value(0), a.values.value(1));
+
+    uchar *bits = img.bits(); // detach here, not in the workers
+    const qsizetype bpl = img.bytesPerLine();
+    const int w = img.width();
+    WorkScheduler::parallelForRows(0, img.height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(bits + y * bpl);
+            switch (a.kind) {
+            case AdjustmentKind::Grayscale: PixelKernels::grayscale(line, w); break;
+            case AdjustmentKind::Invert: PixelKernels::invert(line, w); break;
+            case AdjustmentKind::BrightnessContrast: PixelKernels::applyLut(line, w, lut); break;
+            case AdjustmentKind::None: break;
+            }
+        }
+    }, 64);
+}
+
+quint64 version(const Adjustment &a)
+{
+    quint64 h = 0xcbf29ce484222325ULL; // FNV-1a, one word at a time
+    h = (h ^ quint64(a.kind)) * 0x100000001b3ULL;
+    for (int v : a.values) h = (h ^ quint64(quint32(v))) * 0x100000001b3ULL;
+    return h;
+}
+
+} // namespace Adjustments
+
+const QImage *AdjustmentCache::find(int tile, quint64 key) const
+{
+    const auto it = entries.constFind(tile);
+    if (it == entries.cend() || it->key != key) return nullptr;
+    it->used = ++clock;
+    return &it->image;
+}
+
+void AdjustmentCache::insert(int tile, quint64 key, const QImage &img)
+{
+    Entry &e = entries[tile];
+    bytes += img.sizeInBytes() - e.image.sizeInBytes();
+    e.key = key;
+    e.image = img;
+    e.used = ++clock;
+}
+
+void AdjustmentCache::trim(qint64 maxBytes)
+{
+    if (bytes <= maxBytes) return;
+    QVector<std::pair<quint64, int>> byUse; // (last use, tile), oldest first
+    byUse.reserve(entries.size());
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it) byUse.append({it->used, it.key()});
+    std::sort(byUse.begin(), byUse.end());
+    for (const auto &u : byUse) {
+        if (bytes <= maxBytes) break;
+        bytes -= entries.constFind(u.second)->image.sizeInBytes();
+        entries.remove(u.second);
+    }
+}
+
+void AdjustmentCache::clear()
+{
+    entries.clear();
+    bytes = 0;
+}
@@ -0,0 +1,205 @@
+#include "batchrunner.h"
+#include "blendkernels.h"
+#include "imageexport.h"
+#include "imageimport.h"
+#include "imageops.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QQueue>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <cstdio>
+#include <functional>
+
+namespace BatchRunner {
+
+namespace {
+
+using Step = std::function<void(TiledImage &)>;
+
+struct Pipeline {
+    QVector<Step> steps;
+    QString format;          // empty = same as the input file
+    ExportSettings settings;
+};
+
+QTextStream &err()
+{
+    static QTextStream s(stderr);
+    return s;
+}
+
+// one step from its json object, error filled on failure
+Step parseStep(const QJsonObject &o, QString *error)
+{
+    const QString op = o.value("op").toString();
+    if (op == "invert") return [](TiledImage &img) { ImageOps::invert(img); };
+    if (op == "grayscale") return [](TiledImage &img) { ImageOps::grayscale(img); };
+
+    if (op == "rotate" || op == "flip") {
+        const QString arg = o.value(op == "rotate" ? "direction" : "axis").toString();
+        ImageOps::Orientation orient;
+        if (op == "rotate" && arg == "left") orient = ImageOps::Orientation::RotateLeft;
+        else if (op == "rotate" && arg == "right") orient = ImageOps::Orientation::RotateRight;
+        else if (op == "flip" && arg == "horizontal") orient = ImageOps::Orientation::FlipHorizontal;
+        else if (op == "flip" && arg == "vertical") orient = ImageOps::Orientation::FlipVertical;
+        else {
+            *error = QString("%1: invalid \"%2\"").arg(op, arg);
+            return Step();
+        }
+        return [orient](TiledImage &img) { img = ImageOps::reoriented(img, orient); };
+    }
+
+    if (op == "brightnessContrast") {
+        QVector<quint8> lut(256);
+        PixelKernels::makeBrightnessContrastLut(lut.data(), o.value("brightness").toInt(), o.value("contrast").toInt());
+        return [lut](TiledImage &img) { ImageOps::applyLut(img, lut.constData()); };
+    }
+
+    if (op == "composite") {
+        // the overlay is decoded once and shared by every file
+        const ImportedImage overlay = importImage(o.value("file").toString());
+        if (!overlay.error.isEmpty()) {
+            *error = "composite: " + overlay.fileName + ": " + overlay.error;
+            return Step();
+        }
+        const QString wanted = o.value("mode").toString("Normal").toLower();
+        const QStringList names = BlendKernels::modeNames();
+        int mode = -1;
+        for (int m = 0; m < names.size(); ++m)
+            if (names[m].toLower() == wanted) mode = m;
+        if (mode < 0) {
+            *error = "composite: unknown mode " + o.value("mode").toString();
+            return Step();
+        }
+        const double opacity = o.value("opacity").toDouble(1.0);
+        const TiledImage layer = overlay.image;
+        return [layer, mode, opacity](TiledImage &img) {
+            QImage flat = img.toImage();
+            BlendKernels::blendLayer(flat, layer, flat.rect(), BlendMode(mode), opacity);
+            img = TiledImage::fromImage(flat);
+        };
+    }
+
+    *error = op.isEmpty() ? QString("step without \"op\"") : "unknown op " + op;
+    return Step();
+}
+
+bool loadPipeline(const QString &fileName, Pipeline *p, QString *error)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        *error = f.errorString();
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonObject root = QJsonDocument::fromJson(f.readAll(), &parseError).object();
+    if (parseError.error != QJsonParseError::NoError) {
+        *error = parseError.errorString();
+        return false;
+    }
+
+    for (const QJsonValue &v : root.value("steps").toArray()) {
+        Step s = parseStep(v.toObject(), error);
+        if (!s) return false;
+        p->steps.append(s);
+    }
+    p->format = root.value("format").toString();
+    p->settings.pngCompression = root.value("pngCompression").toInt(p->settings.pngCompression);
+    p->settings.jpegQuality = root.value("jpegQuality").toInt(p->settings.jpegQuality);
+    p->settings.jpegOptimize = root.value("jpegOptimize").toBool(p->settings.jpegOptimize);
+    return true;
+}
+
+int usage()
+{
+    err() << "usage: EpiGrimp --batch pipeline.json [-o outdir] [--prefetch N] files...\n";
+    return 2;
+}
+
+} // namespace
+
+int run(const QStringList &arguments)
+{
+    QString pipelineFile, outDir = ".";
+    int prefetch = 2;
+    QStringList files;
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString &a = arguments[i];
+        const bool hasValue = i + 1 < arguments.size();
+        if (a == "--batch" && hasValue) pipelineFile = arguments[++i];
+        else if (a == "-o" && hasValue) outDir = arguments[++i];
+        else if (a == "--prefetch" && hasValue) prefetch = qMax(1, arguments[++i].toInt());
+        else if (a.startsWith('-')) return usage();
+        else files.append(a);
+    }
+    if (pipelineFile.isEmpty() || files.isEmpty()) return usage();
+
+    Pipeline pipeline;
+    QString error;
+    if (!loadPipeline(pipelineFile, &pipeline, &error)) {
+        err() << pipelineFile << ": " << error << "\n";
+        return 2;
+    }
+    if (!QDir().mkpath(outDir)) {
+        err() << "cannot create " << outDir << "\n";
+        return 2;
+    }
+
+    QTextStream out(stdout);
+    int failed = 0, done = 0;
+    QQueue<QFuture<ImportedImage>> decoding;
+    QQueue<QPair<QString, QFuture<QString>>> encoding;
+    auto finishOldestEncode = [&]() {
+        const auto job = encoding.dequeue();
+        const QString e = job.second.result();
+        ++done;
+        if (e.isEmpty()) {
+            out << "[" << done << "/" << files.size() << "] " << job.first << "\n";
+        } else {
+            err() << job.first << ": " << e << "\n";
+            ++failed;
+        }
+        out.flush();
+    };
+
+    int next = 0;
+    for (int i = 0; i < files.size(); ++i) {
+        while (next < files.size() && decoding.size() < prefetch)
+            decoding.enqueue(QtConcurrent::run(importImage, files[next++]));
+
+        ImportedImage in = decoding.dequeue().result();
+        if (!in.error.isEmpty()) {
+            err() << in.fileName << ": " << in.error << "\n";
+            ++failed;
+            ++done;
+            continue;
+        }
+
+        for (const Step &s : pipeline.steps) s(in.image);
+
+        const QFileInfo info(in.fileName);
+        const QString suffix = pipeline.format.isEmpty() ? info.suffix() : pipeline.format;
+        const QString target = QDir(outDir).filePath(info.completeBaseName() + "." + suffix);
+        const TiledImage result = in.image; // tiles shared, PNG is encoded from them band by band
+        in.image = TiledImage();
+
+        if (encoding.size() >= prefetch) finishOldestEncode();
+        const ExportSettings settings = pipeline.settings;
+        encoding.enqueue({target, QtConcurrent::run([result, target, settings]() {
+                              return exportImage(result, target, settings);
+                          })});
+    }
+    while (!encoding.isEmpty()) finishOldestEncode();
+
+    if (failed) err() << failed << " of " << files.size() << " files failed\n";
+    return failed ? 1 : 0;
+}
+
+} // namespace BatchRunner
@@ -0,0 +1,213 @@
+#include "blendkernels.h"
+#include "imageops.h"
+#include "pixelkernels.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace BlendKernels {
+
+namespace {
+
+inline int div255(int x) { return (x + 127) / 255; }
+
+// premultiplied blend term of one channel, in 255 * 255 units: the part of
+// the result where source and destination overlap (sa * da * B(s, d))
+template <BlendMode M>
+inline int overlap(int sc, int dc, int sa, int da)
+{
+    if constexpr (M == BlendMode::Normal) return sc * da;
+    else if constexpr (M == BlendMode::Multiply) return sc * dc;
+    else if constexpr (M == BlendMode::Screen) return sc * da + dc * sa - sc * dc;
+    else if constexpr (M == BlendMode::Overlay)
+        return 2 * dc <= da ? 2 * sc * dc : sa * da - 2 * (da - dc) * (sa - sc);
+    else if constexpr (M == BlendMode::Darken) return std::min(sc * da, dc * sa);
+    else if constexpr (M == BlendMode::Lighten) return std::max(sc * da, dc * sa);
+    else if constexpr (M == BlendMode::Add) return sc * da + dc * sa; // clamped to alpha below
+    else return std::abs(sc * da - dc * sa);                         // Difference
+}
+
+template <BlendMode M>
+inline quint32 blendPixel(quint32 s, quint32 d)
+{
+    const int sa = int(s >> 24), da = int(d >> 24);
+    const int ra = sa + da - div255(sa * da);
+    auto channel = [&](int shift) {
+        const int sc = int((s >> shift) & 0xff), dc = int((d >> shift) & 0xff);
+        const int t = sc * (255 - da) + dc * (255 - sa) + overlap<M>(sc, dc, sa, da);
+        return quint32(std::clamp(div255(t), 0, ra)) << shift; // stays a valid premultiplied value
+    };
+    return (quint32(ra) << 24) | channel(16) | channel(8) | channel(0);
+}
+
+inline quint32 scaled(quint32 p, int opacity)
+{
+    // all four premultiplied channels by opacity / 255, two at a time
+    quint32 rb = (p & 0x00ff00ff) * quint32(opacity);
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+    quint32 ag = ((p >> 8) & 0x00ff00ff) * quint32(opacity);
+    ag = (ag + ((ag >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+    return ag | rb;
+}
+
+template <BlendMode M, bool FullOpacity>
+void spanKernel(quint32 *dst, const quint32 *src, int n, int opacity)
+{
+    int i = 0;
+    while (i < n) {
+        while (i < n && (src[i] >> 24) == 0) ++i; // nothing to blend
+        int end = i;
+        while (end < n && (src[end] >> 24) != 0) ++end;
+
+        if constexpr (M == BlendMode::Normal && FullOpacity) {
+            // covered pixels: opaque runs replace dst outright
+            while (i < end) {
+                int run = i;
+                while (run < end && (src[run] >> 24) == 0xff) ++run;
+                std::memcpy(dst + i, src + i, size_t(run - i) * 4);
+                for (i = run; i < end && (src[i] >> 24) != 0xff; ++i)
+                    dst[i] = blendPixel<M>(src[i], dst[i]);
+            }
+        } else {
+            for (; i < end; ++i)
+                dst[i] = blendPixel<M>(FullOpacity ? src[i] : scaled(src[i], opacity), dst[i]);
+        }
+    }
+}
+
+using SpanFn = void (*)(quint32 *, const quint32 *, int, int);
+
+template <BlendMode M>
+constexpr SpanFn kernelPair[2] = {spanKernel<M, false>, spanKernel<M, true>};
+
+const SpanFn *const Kernels[] = {
+    kernelPair<BlendMode::Normal>, kernelPair<BlendMode::Multiply>, kernelPair<BlendMode::Screen>,
+    kernelPair<BlendMode::Overlay>, kernelPair<BlendMode::Darken>, kernelPair<BlendMode::Lighten>,
+    kernelPair<BlendMode::Add>, kernelPair<BlendMode::Difference>,
+};
+
+inline SpanFn kernelFor(BlendMode mode, int opacity)
+{
+    return Kernels[int(mode)][opacity >= 255 ? 1 : 0];
+}
+
+inline int opacity255(double opacity) { return std::clamp(int(opacity * 255.0 + 0.5), 0, 255); }
+
+} // namespace
+
+QStringList modeNames()
+{
+    return {"Normal", "Multiply", "Screen", "Overlay", "Darken", "Lighten", "Add", "Difference"};
+}
+
+QString modeName(BlendMode mode)
+{
+    return modeNames().value(int(mode));
+}
+
+void blendSpan(quint32 *dst, const quint32 *src, int n, BlendMode mode, int opacity)
+{
+    if (opacity <= 0) return;
+    kernelFor(mode, opacity)(dst, src, n, opacity);
+}
+
+void blendImage(QImage &dst, const QPoint &pos, const QImage &src, const QRect &srcRect,
+                BlendMode mode, double opacity)
+{
+    const int op = opacity255(opacity);
+    // clip against both images, in dst coordinates
+    const QRect area = srcRect.intersected(src.rect()).translated(pos - srcRect.topLeft()).intersected(dst.rect());
+    if (op == 0 || area.isEmpty()) return;
+
+    const SpanFn fn = kernelFor(mode, op);
+    const QPoint delta = srcRect.topLeft() - pos; // dst -> src
+    uchar *bits = dst.bits(); // detach here, not in the workers
+    const qsizetype bpl = dst.bytesPerLine();
+    WorkScheduler::parallelForRows(area.top(), area.bottom() + 1, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            quint32 *d = reinterpret_cast<quint32 *>(bits + y * bpl) + area.left();
+            const quint32 *s = reinterpret_cast<const quint32 *>(src.constScanLine(y + delta.y())) + area.left() + delta.x();
+            fn(d, s, area.width(), op);
+        }
+    });
+}
+
+void blendLayer(QImage &dst, const TiledImage &layer, const QRect &r, BlendMode mode, double opacity)
+{
+    blendLayer(dst, QPoint(), layer, QTransform(), r, mode, opacity);
+}
+
+void blendLayer(QImage &dst, const TiledImage &layer, const QTransform &layerToDst, const QRect &r,
+                BlendMode mode, double opacity)
+{
+    blendLayer(dst, QPoint(), layer, layerToDst, r, mode, opacity);
+}
+
+void blendLayer(QImage &dst, const QPoint &dstOrigin, const TiledImage &layer, const QTransform &layerToDst,
+                const QRect &r, BlendMode mode, double opacity)
+{
+    if (!layerToDst.isIdentity()) {
+        // a pixel of margin for the filtered (non 90 degree) case
+        const int margin = ImageOps::isLossless(layerToDst) ? 0 : 1;
+        const QRect src = layerToDst.inverted().mapRect(r).adjusted(-margin, -margin, margin, margin)
+                              .intersected(layer.rect());
+        if (src.isEmpty()) return;
+        blendTransformed(dst, dstOrigin, layer.copy(src), src.topLeft(), layerToDst, r, mode, opacity);
+        return;
+    }
+
+    const int op = opacity255(opacity);
+    const QRect area = r.intersected(layer.rect()).intersected(dst.rect().translated(dstOrigin));
+    if (op == 0 || area.isEmpty()) return;
+
+    const int T = TiledImage::TileSize;
+    const SpanFn fn = kernelFor(mode, op);
+    uchar *bits = dst.bits();
+    const qsizetype bpl = dst.bytesPerLine();
+    const QImage::Format format = layer.format();
+    const int bpp = TiledImage::bytesPerPixel(format);
+    WorkScheduler::parallelForRows(area.top(), area.bottom() + 1, [&](int y0, int y1) {
+        quint32 wide[TiledImage::TileSize]; // a packed tile row, widened just before blending
+        for (int y = y0; y < y1; ++y) {
+            const int row = y / T;
+            quint32 *d = reinterpret_cast<quint32 *>(bits + (y - dstOrigin.y()) * bpl) - dstOrigin.x();
+            for (int col = area.left() / T; col <= area.right() / T; ++col) {
+                const QImage &tile = layer.tile(row * layer.tileColumns() + col);
+                if (tile.isNull()) continue; // transparent
+                const int x0 = std::max(area.left(), col * T);
+                const int x1 = std::min(area.right() + 1, (col + 1) * T);
+                const uchar *line = tile.constScanLine(y - row * T) + (x0 - col * T) * bpp;
+                if (format == QImage::Format_ARGB32_Premultiplied) {
+                    fn(d + x0, reinterpret_cast<const quint32 *>(line), x1 - x0, op);
+                } else {
+                    PixelKernels::unpackToArgb32(wide, line, x1 - x0, format);
+                    fn(d + x0, wide, x1 - x0, op);
+                }
+            }
+        }
+    });
+}
+
+void blendTransformed(QImage &dst, const QImage &src, const QPoint &srcOrigin, const QTransform &layerToDst,
+                      const QRect &r, BlendMode mode, double opacity)
+{
+    blendTransformed(dst, QPoint(), src, srcOrigin, layerToDst, r, mode, opacity);
+}
+
+void blendTransformed(QImage &dst, const QPoint &dstOrigin, const QImage &src, const QPoint &srcOrigin,
+                      const QTransform &layerToDst, const QRect &r, BlendMode mode, double opacity)
+{
+    const QTransform t = QTransform::fromTranslate(srcOrigin.x(), srcOrigin.y()) * layerToDst;
+    const bool exact = ImageOps::isLossless(t);
+    // transformed() drops the translation: the result covers the mapped bounds
+    const QImage placed = src.transformed(t, exact ? Qt::FastTransformation : Qt::SmoothTransformation)
+                              .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QPoint pos = t.mapRect(QRectF(src.rect())).toAlignedRect().topLeft();
+    const QRect part = QRect(pos, placed.size()).intersected(r);
+    if (part.isEmpty()) return;
+    blendImage(dst, part.topLeft() - dstOrigin, placed, part.translated(-pos), mode, opacity);
+}
+
+} // namespace BlendKernels
@@ -0,0 +1,196 @@
+#include "brushengine.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int T = TiledImage::TileSize;
+constexpr int Phases = 4;     // sub-pixel tip positions per axis
+constexpr int MaxTips = 512;  // cache entries before it is flushed
+
+// x * a / 255 on the four channels at once
+inline quint32 byteMul(quint32 x, quint32 a)
+{
+    quint32 t = (x & 0x00ff00ff) * a;
+    t = ((t + ((t >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+    x = ((x >> 8) & 0x00ff00ff) * a;
+    x = (x + ((x >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+    return x | t;
+}
+
+qreal dabDiameter(const BrushSettings &b, qreal pressure)
+{
+    const qreal d = b.pressureSize ? b.diameter * std::clamp<qreal>(pressure, 0.0, 1.0) : b.diameter;
+    return std::max<qreal>(1.0, d);
+}
+
+qreal dabSpacing(const BrushSettings &b, qreal diameter)
+{
+    return std::max<qreal>(0.5, b.spacing * diameter);
+}
+
+} // namespace
+
+QRect BrushEngine::begin(const QSize &imageSize, const BrushSettings &settings, const QPointF &pos, qreal pressure)
+{
+    cancel();
+    size = imageSize;
+    cols = (size.width() + T - 1) / T;
+    brush = settings;
+    premulColor = qPremultiply(settings.color.rgba());
+    if (tipHardness != brush.hardness) {
+        tips.clear(); // masks depend on hardness
+        tipHardness = brush.hardness;
+    }
+
+    active = true;
+    lastPos = pos;
+    lastPressure = pressure;
+    const QRect dirty = stamp(pos, pressure);
+    toNextDab = dabSpacing(brush, dabDiameter(brush, pressure));
+    return dirty;
+}
+
+QRect BrushEngine::strokeTo(const QPointF &pos, qreal pressure)
+{
+    if (!active) return QRect();
+
+    // dabs at fixed distances along the path, whatever the event rate
+    const QPointF delta = pos - lastPos;
+    const qreal len = std::hypot(delta.x(), delta.y());
+    QRect dirty;
+    qreal at = toNextDab;
+    while (at <= len) {
+        const qreal t = at / len;
+        const qreal p = lastPressure + (pressure - lastPressure) * t;
+        dirty |= stamp(lastPos + delta * t, p);
+        at += dabSpacing(brush, dabDiameter(brush, p));
+    }
+    toNextDab = at - len;
+    lastPos = pos;
+    lastPressure = pressure;
+    return dirty;
+}
+
+QRect BrushEngine::finish(TiledImage &layer)
+{
+    if (!active) return QRect();
+    EPIGRIMP_PROFILE_SCOPE("strokeMerge");
+    for (auto it = coverage.cbegin(); it != coverage.cend(); ++it) {
+        const int i = it.key();
+        if (brush.eraser && layer.tile(i).isNull()) continue; // nothing to erase
+        const QRect tr = layer.tileRect(i);
+        applyTo(layer.tileForWrite(i), tr.topLeft(), tr);
+    }
+    const QRect r = strokeBounds;
+    cancel();
+    return r;
+}
+
+void BrushEngine::cancel()
+{
+    active = false;
+    coverage.clear();
+    strokeBounds = QRect();
+}
+
+void BrushEngine::drawLayer(QPainter &p, const TiledImage &layer, const QRect &r) const
+{
+    QImage area = layer.copy(r);
+    applyTo(area, r.topLeft(), r);
+    p.drawImage(r.topLeft(), area);
+}
+
+QRect BrushEngine::stamp(const QPointF &center, qreal pressure)
+{
+    const qreal d = dabDiameter(brush, pressure);
+    const int ix = int(std::floor(center.x())), iy = int(std::floor(center.y()));
+    const int px = std::min(Phases - 1, int((center.x() - ix) * Phases));
+    const int py = std::min(Phases - 1, int((center.y() - iy) * Phases));
+    const QImage &m = tip(d, px, py);
+
+    const int e = (m.width() - 2) / 2;
+    const QRect dab(ix - e, iy - e, m.width(), m.height());
+    const QRect area = dab.intersected(QRect(QPoint(0, 0), size));
+    if (area.isEmpty()) return QRect();
+
+    for (int ty = area.top() / T; ty <= area.bottom() / T; ++ty) {
+        for (int tx = area.left() / T; tx <= area.right() / T; ++tx) {
+            QImage &buf = coverage[ty * cols + tx];
+            if (buf.isNull()) {
+                buf = QImage(T, T, QImage::Format_Alpha8);
+                buf.fill(0);
+            }
+            const QRect part = area.intersected(QRect(tx * T, ty * T, T, T));
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                uchar *dst = buf.scanLine(y - ty * T) + (part.left() - tx * T);
+                const uchar *src = m.constScanLine(y - dab.top()) + (part.left() - dab.left());
+                for (int x = 0; x < part.width(); ++x)
+                    dst[x] = std::max(dst[x], src[x]);
+            }
+        }
+    }
+    strokeBounds |= area;
+    return area;
+}
+
+const QImage &BrushEngine::tip(qreal diameter, int phaseX, int phaseY)
+{
+    const int quarterPx = int(std::lround(diameter * 4)); // pressure sizes share masks per 1/4 px
+    const quint64 key = (quint64(quarterPx) << 16) | (quint64(phaseX) << 8) | quint64(phaseY);
+    auto it = tips.constFind(key);
+    if (it != tips.constEnd()) return *it;
+    if (tips.size() >= MaxTips) tips.clear();
+
+    // mask pixel (i, j) covers image pixel (floor(cx) - e + i, floor(cy) - e + j)
+    const qreal radius = quarterPx / 8.0;
+    const int e = int(std::ceil(radius + 1));
+    const qreal fx = (phaseX + 0.5) / Phases, fy = (phaseY + 0.5) / Phases;
+    const qreal outer = radius + 0.5;
+    const qreal inner = std::min(radius * brush.hardness, radius - 0.5); // hard = 1px antialiased edge
+
+    QImage m(2 * e + 2, 2 * e + 2, QImage::Format_Alpha8);
+    for (int j = 0; j < m.height(); ++j) {
+        uchar *line = m.scanLine(j);
+        const qreal dy = j - e + 0.5 - fy;
+        for (int i = 0; i < m.width(); ++i) {
+            const qreal dx = i - e + 0.5 - fx;
+            const qreal r = std::sqrt(dx * dx + dy * dy);
+            const qreal a = r <= inner ? 1.0 : r >= outer ? 0.0 : (outer - r) / (outer - inner);
+            line[i] = uchar(std::lround(a * 255));
+        }
+    }
+    return *tips.insert(key, m);
+}
+
+void BrushEngine::applyTo(QImage &dst, const QPoint &origin, const QRect &r) const
+{
+    const QRect area = r.intersected(strokeBounds);
+    if (area.isEmpty()) return;
+
+    uchar *bits = dst.bits();
+    const qsizetype bpl = dst.bytesPerLine();
+    for (int ty = area.top() / T; ty <= area.bottom() / T; ++ty) {
+        for (int tx = area.left() / T; tx <= area.right() / T; ++tx) {
+            auto it = coverage.constFind(ty * cols + tx);
+            if (it == coverage.constEnd()) continue;
+            const QRect part = area.intersected(QRect(tx * T, ty * T, T, T));
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                const uchar *mask = it->constScanLine(y - ty * T) + (part.left() - tx * T);
+                quint32 *px = reinterpret_cast<quint32 *>(bits + (y - origin.y()) * bpl) + (part.left() - origin.x());
+                for (int x = 0; x < part.width(); ++x) {
+                    const quint32 m = mask[x];
+                    if (!m) continue;
+                    if (brush.eraser) {
+                        px[x] = byteMul(px[x], 255 - m); // destination-out
+                    } else {
+                        const quint32 s = byteMul(premulColor, m);
+                        px[x] = s + byteMul(px[x], 255 - (s >> 24)); // source-over
+                    }
+                }
+            }
+        }
+    }
+}
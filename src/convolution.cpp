@@ -0,0 +1,289 @@
+#include "convolution.h"
+#include "profiler.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace Convolution {
+
+namespace {
+
+constexpr int T = TiledImage::TileSize;
+
+inline int channel(quint32 p, int c) { return int((p >> (8 * c)) & 0xff); }
+
+// pixels [x0, x0 + n) of row y, outside the image the nearest edge pixel
+void readRow(const TiledImage &img, int y, int x0, int n, quint32 *out)
+{
+    const int w = img.width();
+    y = std::clamp(y, 0, img.height() - 1);
+    const int ty = y / T;
+    const auto pixel = [&](int x) -> quint32 {
+        const QImage &tile = img.tile(ty * img.tileColumns() + x / T);
+        return tile.isNull() ? 0 : reinterpret_cast<const quint32 *>(tile.constScanLine(y - ty * T))[x % T];
+    };
+
+    const int a = std::max(x0, 0), b = std::min(x0 + n, w); // inside the image
+    if (a >= b) {
+        std::fill(out, out + n, pixel(std::clamp(x0, 0, w - 1)));
+        return;
+    }
+    for (int x = a; x < b;) {
+        const int tx = x / T;
+        const int end = std::min(b, (tx + 1) * T);
+        const QImage &tile = img.tile(ty * img.tileColumns() + tx);
+        quint32 *dst = out + (x - x0);
+        if (tile.isNull()) std::fill(dst, dst + (end - x), 0u);
+        else std::memcpy(dst, reinterpret_cast<const quint32 *>(tile.constScanLine(y - ty * T)) + (x - tx * T),
+                         size_t(end - x) * 4);
+        x = end;
+    }
+    std::fill(out, out + (a - x0), out[a - x0]);
+    std::fill(out + (b - x0), out + n, out[b - x0 - 1]);
+}
+
+// running sums of the four channels
+struct Sums {
+    quint32 s[4] = {0, 0, 0, 0};
+    void add(quint32 p) { for (int c = 0; c < 4; ++c) s[c] += channel(p, c); }
+    void sub(quint32 p) { for (int c = 0; c < 4; ++c) s[c] -= channel(p, c); }
+    // mul = 2^32 / window, rounded: no division per pixel
+    quint32 mean(quint64 mul) const
+    {
+        quint32 p = 0;
+        for (int c = 0; c < 4; ++c) p |= quint32((s[c] * mul + (quint64(1) << 31)) >> 32) << (8 * c);
+        return p;
+    }
+};
+
+inline quint64 reciprocal(int window) { return ((quint64(1) << 32) + quint64(window) / 2) / quint64(window); }
+
+// out[i] = mean of in[i .. i + 2r], n - 2r outputs (the mean of premultiplied
+// pixels is premultiplied too)
+void boxLine(const quint32 *in, int n, int r, quint32 *out)
+{
+    const int d = 2 * r + 1;
+    const quint64 mul = reciprocal(d);
+    Sums s;
+    for (int i = 0; i < d; ++i) s.add(in[i]);
+    for (int i = 0; i + d <= n; ++i) {
+        out[i] = s.mean(mul);
+        if (i + d == n) break;
+        s.add(in[i + d]);
+        s.sub(in[i]);
+    }
+}
+
+// same down the columns of a w x n block, n - 2r rows out; a row of sums
+// at a time, so that memory is walked in order
+void boxColumns(const quint32 *in, int w, int n, int r, quint32 *out)
+{
+    const int d = 2 * r + 1;
+    const quint64 mul = reciprocal(d);
+    std::vector<Sums> sums(static_cast<size_t>(w));
+    for (int j = 0; j < d; ++j)
+        for (int x = 0; x < w; ++x) sums[size_t(x)].add(in[size_t(j) * w + x]);
+    for (int j = 0; j + d <= n; ++j) {
+        quint32 *row = out + size_t(j) * w;
+        for (int x = 0; x < w; ++x) row[x] = sums[size_t(x)].mean(mul);
+        if (j + d == n) break;
+        const quint32 *enter = in + size_t(j + d) * w, *leave = in + size_t(j) * w;
+        for (int x = 0; x < w; ++x) {
+            sums[size_t(x)].add(enter[x]);
+            sums[size_t(x)].sub(leave[x]);
+        }
+    }
+}
+
+// one direction of a separable blur, the radii applied one after the other.
+// Output tiles are independent: each reads its halo from src and is written
+// by one task. Tiles with nothing stored within reach stay transparent.
+TiledImage boxPass(const TiledImage &src, const QVector<int> &radii, bool horizontal)
+{
+    int halo = 0;
+    for (int r : radii) halo += r;
+    const int reach = (halo + T - 1) / T; // tiles on each side
+    const int cols = src.tileColumns(), rows = src.tileRows();
+
+    QVector<int> todo;
+    for (int i = 0; i < src.tileCount(); ++i) {
+        const int tx = i % cols, ty = i / cols;
+        bool near = false;
+        for (int k = -reach; k <= reach && !near; ++k) {
+            const int nx = horizontal ? tx + k : tx, ny = horizontal ? ty : ty + k;
+            if (nx >= 0 && nx < cols && ny >= 0 && ny < rows) near = !src.tile(ny * cols + nx).isNull();
+        }
+        if (near) todo.append(i);
+    }
+
+    QVector<QImage> result(todo.size());
+    QImage *res = result.data();
+    WorkScheduler::parallelFor(int(todo.size()), [&](int k) {
+        const QRect part = src.tileRect(todo[k]).intersected(src.rect());
+        const int w = part.width(), h = part.height();
+        QImage tile(T, T, QImage::Format_ARGB32_Premultiplied);
+        tile.fill(0);
+
+        if (horizontal) {
+            std::vector<quint32> a(size_t(w + 2 * halo)), b(a.size());
+            for (int y = 0; y < h; ++y) {
+                readRow(src, part.top() + y, part.left() - halo, w + 2 * halo, a.data());
+                quint32 *in = a.data(), *out = b.data();
+                int n = w + 2 * halo;
+                for (int r : radii) {
+                    boxLine(in, n, r, out);
+                    n -= 2 * r;
+                    std::swap(in, out);
+                }
+                std::memcpy(tile.scanLine(y), in, size_t(w) * 4);
+            }
+        } else {
+            const int n0 = h + 2 * halo;
+            std::vector<quint32> a(size_t(n0) * w), b(a.size());
+            for (int j = 0; j < n0; ++j)
+                readRow(src, part.top() - halo + j, part.left(), w, a.data() + size_t(j) * w);
+            quint32 *in = a.data(), *out = b.data();
+            int n = n0;
+            for (int r : radii) {
+                boxColumns(in, w, n, r, out);
+                n -= 2 * r;
+                std::swap(in, out);
+            }
+            for (int y = 0; y < h; ++y) std::memcpy(tile.scanLine(y), in + size_t(y) * w, size_t(w) * 4);
+        }
+        if (!TiledImage::isTransparent(tile)) res[k] = tile;
+    });
+
+    TiledImage out(src.size());
+    for (int k = 0; k < todo.size(); ++k)
+        if (!result[k].isNull()) out.setTile(todo[k], result[k]);
+    return out;
+}
+
+void separableBlur(TiledImage &img, QVector<int> radii)
+{
+    radii.removeAll(0);
+    if (radii.isEmpty() || img.isNull() || img.format() != QImage::Format_ARGB32_Premultiplied) return;
+    img = boxPass(boxPass(img, radii, true), radii, false);
+}
+
+// fn(tile, index) on every stored tile in parallel, results written back here
+void forEachStoredTile(TiledImage &img, const std::function<void(QImage &tile, int index)> &fn)
+{
+    QVector<int> indices;
+    QVector<QImage> work;
+    for (int i = 0; i < img.tileCount(); ++i) {
+        if (img.tile(i).isNull()) continue;
+        indices.append(i);
+        work.append(img.tile(i));
+    }
+    QImage *tiles = work.data();
+    WorkScheduler::parallelFor(int(work.size()), [&](int k) { fn(tiles[k], indices[k]); });
+    for (int k = 0; k < indices.size(); ++k) img.setTile(indices[k], work[k]);
+}
+
+} // namespace
+
+QVector<int> gaussianBoxes(double sigma, int passes)
+{
+    // widths of the boxes (odd) whose variances add up to sigma^2
+    QVector<int> radii;
+    if (sigma <= 0 || passes <= 0) return radii;
+    const double n = passes;
+    int wl = int(std::floor(std::sqrt(12.0 * sigma * sigma / n + 1.0)));
+    if (wl % 2 == 0) --wl;
+    const int wu = wl + 2;
+    const int m = int(std::lround((12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n) / (-4.0 * wl - 4.0)));
+    for (int i = 0; i < passes; ++i) radii.append(((i < m ? wl : wu) - 1) / 2);
+    return radii;
+}
+
+void boxBlur(TiledImage &img, int radius)
+{
+    EPIGRIMP_PROFILE_SCOPE("boxBlur");
+    if (radius > 0) separableBlur(img, {radius});
+}
+
+void gaussianBlur(TiledImage &img, double sigma)
+{
+    EPIGRIMP_PROFILE_SCOPE("gaussianBlur");
+    separableBlur(img, gaussianBoxes(sigma));
+}
+
+void unsharpMask(TiledImage &img, double sigma, int amount, int threshold)
+{
+    EPIGRIMP_PROFILE_SCOPE("unsharpMask");
+    if (amount <= 0 || img.format() != QImage::Format_ARGB32_Premultiplied) return;
+    TiledImage blurred = img;
+    gaussianBlur(blurred, sigma);
+
+    // transparent tiles would only get negative values: they stay as they are
+    forEachStoredTile(img, [&](QImage &tile, int index) {
+        const QImage &b = blurred.tile(index);
+        uchar *bits = tile.bits();
+        for (int y = 0; y < T; ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(bits + y * tile.bytesPerLine());
+            const quint32 *soft = b.isNull() ? nullptr : reinterpret_cast<const quint32 *>(b.constScanLine(y));
+            for (int x = 0; x < T; ++x) {
+                int v[4];
+                for (int c = 0; c < 4; ++c) {
+                    const int orig = channel(line[x], c);
+                    const int diff = orig - (soft ? channel(soft[x], c) : 0);
+                    v[c] = std::abs(diff) < threshold ? orig : std::clamp(orig + diff * amount / 100, 0, 255);
+                }
+                for (int c = 0; c < 3; ++c) v[c] = std::min(v[c], v[3]); // stays premultiplied
+                line[x] = quint32(v[0]) | quint32(v[1]) << 8 | quint32(v[2]) << 16 | quint32(v[3]) << 24;
+            }
+        }
+    });
+}
+
+void sobel(TiledImage &img)
+{
+    EPIGRIMP_PROFILE_SCOPE("sobel");
+    if (img.isNull() || img.format() != QImage::Format_ARGB32_Premultiplied) return;
+    const TiledImage src = img;
+
+    // alpha is kept, so tiles with nothing stored stay transparent
+    forEachStoredTile(img, [&](QImage &tile, int index) {
+        const QRect part = src.tileRect(index).intersected(src.rect());
+        const int w = part.width(), h = part.height();
+        // (w + 2) x (h + 2) block: the tile and its one pixel halo
+        const int bw = w + 2;
+        std::vector<quint32> block(size_t(bw) * (h + 2));
+        for (int j = 0; j < h + 2; ++j)
+            readRow(src, part.top() - 1 + j, part.left() - 1, bw, block.data() + size_t(j) * bw);
+
+        // separable: [1 2 1] smoothing one way, [-1 0 1] difference the other
+        std::vector<int> smooth(size_t(w) * (h + 2)), diff(smooth.size());
+        uchar *bits = tile.bits();
+        for (int c = 0; c < 3; ++c) {
+            for (int j = 0; j < h + 2; ++j) {
+                const quint32 *row = block.data() + size_t(j) * bw;
+                for (int x = 0; x < w; ++x) {
+                    const int l = channel(row[x], c), m = channel(row[x + 1], c), r = channel(row[x + 2], c);
+                    smooth[size_t(j) * w + x] = l + 2 * m + r;
+                    diff[size_t(j) * w + x] = r - l;
+                }
+            }
+            for (int y = 0; y < h; ++y) {
+                quint32 *line = reinterpret_cast<quint32 *>(bits + y * tile.bytesPerLine());
+                const int *d0 = &diff[size_t(y) * w], *d1 = d0 + w, *d2 = d1 + w;
+                const int *s0 = &smooth[size_t(y) * w], *s2 = s0 + 2 * w;
+                for (int x = 0; x < w; ++x) {
+                    const int gx = d0[x] + 2 * d1[x] + d2[x];
+                    const int gy = s2[x] - s0[x];
+                    const int alpha = channel(line[x], 3);
+                    const int mag = std::min(alpha, int(std::sqrt(double(gx * gx + gy * gy)) / 4.0 + 0.5));
+                    line[x] = (line[x] & ~(0xffu << (8 * c))) | quint32(mag) << (8 * c);
+                }
+            }
+        }
+    });
+}
+
+} // namespace Convolution
@@ -0,0 +1,71 @@
+#include "filterdialog.h"
+#include "imageops.h"
+
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QPixmap>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+namespace {
+const QSize PreviewSize(380, 250);
+}
+
+FilterDialog::FilterDialog(const QString &title, const TiledImage &src, const QVector<FilterParam> &params,
+                           FilterFn filter, QWidget *parent)
+    : QDialog(parent), proxy(TiledImage::fromImage(ImageOps::downscaled(src, PreviewSize))),
+      fn(std::move(filter))
+{
+    setWindowTitle(title);
+    resize(400, 300);
+
+    QVBoxLayout *lay = new QVBoxLayout(this);
+    imgLabel = new QLabel(this);
+    imgLabel->setAlignment(Qt::AlignCenter);
+    imgLabel->setMinimumSize(PreviewSize);
+    lay->addWidget(imgLabel);
+
+    if (!params.isEmpty()) {
+        QFormLayout *form = new QFormLayout();
+        for (const FilterParam &p : params) {
+            QSlider *s = new QSlider(Qt::Horizontal, this);
+            s->setRange(p.minimum, p.maximum);
+            s->setValue(p.value);
+            connect(s, &QSlider::valueChanged, this, [this] { updatePreview(); });
+            form->addRow(p.label, s);
+            sliders.append(s);
+        }
+        lay->addLayout(form);
+    }
+
+    QHBoxLayout *btnLayout = new QHBoxLayout();
+    QPushButton *okBtn = new QPushButton("OK", this);
+    QPushButton *cancelBtn = new QPushButton("Cancel", this);
+    okBtn->setDefault(true);
+    btnLayout->addWidget(okBtn);
+    btnLayout->addWidget(cancelBtn);
+    lay->addLayout(btnLayout);
+
+    connect(okBtn, &QPushButton::clicked, this, &QDialog::accept);
+    connect(cancelBtn, &QPushButton::clicked, this, &QDialog::reject);
+
+    // Enter = OK, Esc = Cancel
+    setWindowFlag(Qt::WindowContextHelpButtonHint, false);
+    setModal(true);
+
+    updatePreview();
+}
+
+QVector<int> FilterDialog::values() const
+{
+    QVector<int> v;
+    for (const QSlider *s : sliders) v.append(s->value());
+    return v;
+}
+
+void FilterDialog::updatePreview()
+{
+    TiledImage p = proxy;
+    fn(p, values());
+    imgLabel->setPixmap(QPixmap::fromImage(p.toImage()));
+}
@@ -0,0 +1,97 @@
+#include "filterjob.h"
+#include "profiler.h"
+
+#include <QHash>
+#include <QPromise>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+
+constexpr int T = TiledImage::TileSize;
+
+inline int reachOf(int halo) { return (halo + T - 1) / T; } // in tiles
+
+// squared pixel distance between two rects, 0 if they touch
+qint64 distance2(const QRect &a, const QRect &b)
+{
+    const qint64 dx = std::max({0, b.left() - a.right(), a.left() - b.right()});
+    const qint64 dy = std::max({0, b.top() - a.bottom(), a.top() - b.bottom()});
+    return dx * dx + dy * dy;
+}
+
+} // namespace
+
+QVector<int> filterJobTiles(const TiledImage &source, int halo, const SelectionMask &mask)
+{
+    const int cols = source.tileColumns(), rows = source.tileRows(), reach = reachOf(halo);
+    QVector<char> wanted(source.tileCount(), 0);
+    for (int i = 0; i < source.tileCount(); ++i) {
+        if (source.tile(i).isNull()) continue;
+        const int tx = i % cols, ty = i / cols;
+        for (int y = std::max(0, ty - reach); y <= std::min(rows - 1, ty + reach); ++y)
+            for (int x = std::max(0, tx - reach); x <= std::min(cols - 1, tx + reach); ++x) wanted[y * cols + x] = 1;
+    }
+    const QRect area = mask.isEmpty() ? source.rect() : mask.bounds();
+    QVector<int> tiles;
+    for (int i = 0; i < source.tileCount(); ++i)
+        if (wanted[i] && source.tileRect(i).intersects(area)) tiles.append(i);
+    return tiles;
+}
+
+QFuture<FilterBatch> startFilterJob(const FilterJobSpec &spec)
+{
+    return QtConcurrent::run([spec](QPromise<FilterBatch> &promise) {
+        EPIGRIMP_PROFILE_SCOPE("filterJob");
+        const TiledImage &src = spec.source;
+        const int cols = src.tileColumns(), rows = src.tileRows(), reach = reachOf(spec.halo);
+
+        // blocks of side x side tiles, each filtered with a ring of reach tiles
+        // around it: the bigger the halo, the bigger the blocks, so that the
+        // ring stays a fraction of the work
+        const int side = std::max(4, 4 * reach);
+        const int blockCols = (cols + side - 1) / side;
+        QHash<int, QVector<int>> blocks;
+        for (int i : spec.tiles) blocks[(i / cols / side) * blockCols + (i % cols) / side].append(i);
+
+        const auto blockRect = [&](int key) {
+            return QRect((key % blockCols) * side * T, (key / blockCols) * side * T, side * T, side * T);
+        };
+        QVector<int> order = blocks.keys();
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            const qint64 da = spec.focus.isEmpty() ? 0 : distance2(blockRect(a), spec.focus);
+            const qint64 db = spec.focus.isEmpty() ? 0 : distance2(blockRect(b), spec.focus);
+            return da != db ? da < db : a < b;
+        });
+
+        for (int key : order) {
+            if (promise.isCanceled()) return;
+            const QVector<int> &batch = blocks[key];
+            const int bx = (key % blockCols) * side, by = (key / blockCols) * side;
+
+            // the block and its ring, shared with the source: the filter only sees those
+            TiledImage in(src.size());
+            for (int y = std::max(0, by - reach); y < std::min(rows, by + side + reach); ++y)
+                for (int x = std::max(0, bx - reach); x < std::min(cols, bx + side + reach); ++x)
+                    in.setTile(y * cols + x, src.tile(y * cols + x));
+            spec.fn(in, spec.values);
+
+            FilterBatch b;
+            b.indices = batch;
+            if (spec.mask.isEmpty()) {
+                for (int i : batch) b.tiles.append(in.tile(i));
+            } else {
+                // filtered pixels over the original ones, weighted by coverage
+                TiledImage merged(src.size());
+                QRect area;
+                for (int i : batch) {
+                    merged.setTile(i, src.tile(i));
+                    area |= src.tileRect(i);
+                }
+                spec.mask.clipped(area).merge(merged, in);
+                for (int i : batch) b.tiles.append(merged.tile(i));
+            }
+            promise.addResult(b);
+        }
+    });
+}
@@ -0,0 +1,213 @@
+#include "glcanvasview.h"
+#include "mainwindow.h"
+#include "profiler.h"
+
+#include <QPainter>
+#include <QVector2D>
+#include <QVector4D>
+
+namespace {
+
+const char *VertexShader = R"(
+attribute vec2 corner;
+uniform vec4 rect;      // widget x, y, w, h
+uniform vec2 viewport;
+uniform vec2 uvOrigin;  // tile coordinates at the rect corners: the part of the tile
+uniform vec2 uvX;       // inside the image, turned by the layer transform
+uniform vec2 uvY;
+varying vec2 uv;
+void main()
+{
+    vec2 pos = rect.xy + corner * rect.zw;
+    gl_Position = vec4(pos.x / viewport.x * 2.0 - 1.0, 1.0 - pos.y / viewport.y * 2.0, 0.0, 1.0);
+    uv = uvOrigin + corner.x * uvX + corner.y * uvY;
+}
+)";
+
+// tiles are uploaded as is: ARGB32 is b, g, r, a in memory (little endian)
+const char *FragmentShader = R"(
+#ifdef GL_ES
+precision mediump float;
+#endif
+uniform sampler2D tile;
+uniform float opacity;
+varying vec2 uv;
+void main()
+{
+    gl_FragColor = texture2D(tile, uv).bgra * opacity; // premultiplied
+}
+)";
+
+} // namespace
+
+GLCanvasView::GLCanvasView(Canvas *c)
+    : QOpenGLWidget(c), canvas(c), quad(QOpenGLBuffer::VertexBuffer)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+}
+
+GLCanvasView::~GLCanvasView()
+{
+    if (!ready) return;
+    makeCurrent();
+    releaseTextures();
+    quad.destroy();
+    doneCurrent();
+}
+
+void GLCanvasView::setLayers(const QVector<Layer> *l, int activeIndex)
+{
+    layers = l;
+    active = activeIndex;
+    update();
+}
+
+void GLCanvasView::layersChanged(const QRect &imageRect)
+{
+    // plain tile writes show up as new cacheKeys; a stroke in progress is not
+    // in the tiles yet, so remember where its preview must be re-uploaded
+    if (canvas->activeStroke())
+        strokeDirty |= imageRect;
+    update();
+}
+
+void GLCanvasView::initializeGL()
+{
+    initializeOpenGLFunctions();
+
+    static const GLfloat corners[] = {0, 0, 1, 0, 0, 1, 1, 1};
+    ready = program.addShaderFromSourceCode(QOpenGLShader::Vertex, VertexShader)
+            && program.addShaderFromSourceCode(QOpenGLShader::Fragment, FragmentShader)
+            && program.link() && quad.create();
+    if (!ready) {
+        // no usable GL: go back to the CPU canvas once we are out of here
+        QMetaObject::invokeMethod(canvas, [c = canvas]() { c->setGpuBackend(false); }, Qt::QueuedConnection);
+        return;
+    }
+    quad.bind();
+    quad.allocate(corners, sizeof(corners));
+    quad.release();
+}
+
+void GLCanvasView::upload(GpuTile &t, const QImage &tile, qint64 key)
+{
+    const int T = TiledImage::TileSize;
+    if (!t.texture) {
+        glGenTextures(1, &t.texture);
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // zoomed out
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);              // pixels when zoomed in
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+    }
+    // packed layers (Alpha8, Grayscale8, RGBA64) are widened when a tile changes, not per frame
+    const QImage px = tile.format() == QImage::Format_ARGB32_Premultiplied
+                          ? tile : tile.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, T, T, 0, GL_RGBA, GL_UNSIGNED_BYTE, px.constBits());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    t.key = key;
+}
+
+void GLCanvasView::releaseTextures()
+{
+    for (QVector<GpuTile> &layerTiles : textures)
+        for (GpuTile &t : layerTiles)
+            if (t.texture) glDeleteTextures(1, &t.texture);
+    textures.clear();
+}
+
+void GLCanvasView::paintGL()
+{
+    EPIGRIMP_PROFILE_SCOPE("paintGL");
+    const QColor bg = canvas->palette().color(canvas->backgroundRole());
+    glClearColor(bg.redF(), bg.greenF(), bg.blueF(), 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!ready || !layers || layers->isEmpty()) return;
+
+    const int T = TiledImage::TileSize;
+    const double zoom = canvas->zoom;
+    const QPointF offset(canvas->imageOffset);
+    const TiledImage &bottom = layers->first().image;
+    const QRect visible = QRectF(canvas->widgetToImageF(QPointF(0, 0)), QSizeF(width() / zoom, height() / zoom))
+                              .toAlignedRect().intersected(bottom.rect());
+
+    if (textures.size() != layers->size()) {
+        releaseTextures();
+        textures.resize(layers->size());
+    }
+
+    const BrushEngine *stroke = canvas->activeStroke();
+    const QRect strokeArea = stroke ? stroke->bounds() : QRect();
+    QImage scratch; // stroke preview of one tile
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // source-over on premultiplied colours
+    glActiveTexture(GL_TEXTURE0);
+    program.bind();
+    program.setUniformValue("tile", 0);
+    program.setUniformValue("viewport", QVector2D(width(), height()));
+    quad.bind();
+    program.enableAttributeArray("corner");
+    program.setAttributeBuffer("corner", GL_FLOAT, 0, 2);
+
+    for (int li = 0; li < layers->size(); ++li) {
+        const TiledImage &img = (*layers)[li].image;
+        QVector<GpuTile> &gpu = textures[li];
+        if (gpu.size() != img.tileCount()) { // resized
+            for (GpuTile &t : gpu)
+                if (t.texture) glDeleteTextures(1, &t.texture);
+            gpu = QVector<GpuTile>(img.tileCount());
+        }
+        program.setUniformValue("opacity", GLfloat(li == 0 ? 1.0 : (*layers)[li].opacity));
+        const QTransform &toImage = (*layers)[li].transform;
+        const QTransform toLayer = toImage.inverted();
+
+        for (int i : img.tilesIn(toLayer.mapRect(visible))) {
+            GpuTile &t = gpu[i];
+            const QRect tr = img.tileRect(i);
+            if (li == active && stroke && tr.intersects(strokeArea)) {
+                if (t.key != StrokeKey || tr.intersects(toLayer.mapRect(strokeDirty))) {
+                    if (scratch.isNull()) scratch = QImage(T, T, QImage::Format_ARGB32_Premultiplied);
+                    scratch.fill(Qt::transparent);
+                    QPainter p(&scratch);
+                    p.translate(-tr.topLeft());
+                    stroke->drawLayer(p, img, tr);
+                    p.end();
+                    upload(t, scratch, StrokeKey);
+                }
+            } else {
+                const QImage &tile = img.tile(i);
+                if (tile.isNull()) continue; // transparent, nothing to draw
+                if (t.key != tile.cacheKey()) upload(t, tile, tile.cacheKey());
+            }
+
+            // the quad covers the tile part as displayed, uv walks it back in the tile
+            const QRectF part = toImage.mapRect(QRectF(tr.intersected(img.rect())));
+            const auto uvAt = [&](qreal cx, qreal cy) {
+                const QPointF p = toLayer.map(QPointF(part.x() + cx * part.width(), part.y() + cy * part.height()));
+                return QVector2D((p - QPointF(tr.topLeft())) / T);
+            };
+            const QVector2D uv0 = uvAt(0, 0);
+            glBindTexture(GL_TEXTURE_2D, t.texture);
+            program.setUniformValue("rect", QVector4D(offset.x() + part.x() * zoom, offset.y() + part.y() * zoom,
+                                                      part.width() * zoom, part.height() * zoom));
+            program.setUniformValue("uvOrigin", uv0);
+            program.setUniformValue("uvX", uvAt(1, 0) - uv0);
+            program.setUniformValue("uvY", uvAt(0, 1) - uv0);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+    }
+    strokeDirty = QRect();
+
+    program.disableAttributeArray("corner");
+    quad.release();
+    program.release();
+    glDisable(GL_BLEND);
+
+    // text items and selection outline, same code as the CPU view
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+    canvas->paintOverlay(painter);
+}
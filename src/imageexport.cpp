@@ -0,0 +1,133 @@
+#include "imageexport.h"
+#include "profiler.h"
+
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <algorithm>
+
+#ifdef EPIGRIMP_HAVE_PNG
+#include <QSysInfo>
+#include <csetjmp>
+#include <png.h>
+#endif
+
+namespace {
+
+// rows converted and encoded at once by the streaming writer: one tile row
+constexpr int BandRows = TiledImage::TileSize;
+
+QByteArray formatOf(const QString &fileName)
+{
+    const QByteArray suffix = QFileInfo(fileName).suffix().toLower().toLatin1();
+    return suffix.isEmpty() ? QByteArray("png") : suffix;
+}
+
+QString writeWhole(const QImage &img, const QString &fileName, const ExportSettings &settings)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) return file.errorString();
+
+    const QByteArray format = formatOf(fileName);
+    QImageWriter writer(&file, format);
+    if (format == "jpg" || format == "jpeg") {
+        writer.setQuality(settings.jpegQuality);
+        writer.setOptimizedWrite(settings.jpegOptimize);
+    } else if (format == "png") {
+        writer.setCompression(settings.pngCompression);
+    }
+
+    if (!writer.write(img)) {
+        file.cancelWriting();
+        return writer.errorString();
+    }
+    if (!file.commit()) return file.errorString();
+    return QString();
+}
+
+#ifdef EPIGRIMP_HAVE_PNG
+struct PngOut {
+    QSaveFile *file;
+    QString error;
+};
+
+void pngWrite(png_structp png, png_bytep data, png_size_t length)
+{
+    auto *out = static_cast<PngOut *>(png_get_io_ptr(png));
+    if (out->file->write(reinterpret_cast<const char *>(data), qint64(length)) != qint64(length))
+        png_error(png, "write failed");
+}
+
+void pngFlush(png_structp) {}
+
+void pngError(png_structp png, png_const_charp message)
+{
+    auto *out = static_cast<PngOut *>(png_get_error_ptr(png));
+    if (out->error.isEmpty()) out->error = out->file->error() != QFileDevice::NoError ? out->file->errorString()
+                                                                                       : QString::fromLatin1(message);
+    png_longjmp(png, 1);
+}
+
+void pngWarning(png_structp, png_const_charp) {}
+
+// 8 bit RGBA rows, unpremultiplied and encoded one band at a time: no
+// full-size conversion, and for tiled sources no flat copy at all
+QString writePng(const QSize &size, const std::function<QImage(const QRect &)> &bandAt, const QString &fileName,
+                 const ExportSettings &settings)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) return file.errorString();
+
+    PngOut out{&file, QString()};
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, &out, pngError, pngWarning);
+    if (!png) return QString("PNG encoder unavailable");
+    png_infop info = png_create_info_struct(png);
+    QImage band; // outside of what png_error() jumps over
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        file.cancelWriting();
+        return out.error.isEmpty() ? QString("PNG encoding failed") : out.error;
+    }
+
+    png_set_write_fn(png, &out, pngWrite, pngFlush);
+    png_set_compression_level(png, settings.pngCompression);
+    png_set_IHDR(png, info, png_uint_32(size.width()), png_uint_32(size.height()), 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    // rows laid out like QImage::Format_ARGB32
+    if (QSysInfo::ByteOrder == QSysInfo::LittleEndian) png_set_bgr(png);
+    else png_set_swap_alpha(png);
+
+    for (int y = 0; y < size.height(); y += BandRows) {
+        const int n = std::min(BandRows, size.height() - y);
+        band = bandAt(QRect(0, y, size.width(), n)).convertToFormat(QImage::Format_ARGB32);
+        for (int k = 0; k < n; ++k) png_write_row(png, band.constScanLine(k));
+    }
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    if (!file.commit()) return file.errorString();
+    return QString();
+}
+#endif
+
+} // namespace
+
+QString exportImage(const QImage &img, const QString &fileName, const ExportSettings &settings)
+{
+    EPIGRIMP_PROFILE_SCOPE("exportImage");
+#ifdef EPIGRIMP_HAVE_PNG
+    if (formatOf(fileName) == "png")
+        return writePng(img.size(), [&img](const QRect &r) { return img.copy(r); }, fileName, settings);
+#endif
+    return writeWhole(img, fileName, settings);
+}
+
+QString exportImage(const TiledImage &img, const QString &fileName, const ExportSettings &settings)
+{
+    EPIGRIMP_PROFILE_SCOPE("exportImage");
+#ifdef EPIGRIMP_HAVE_PNG
+    if (formatOf(fileName) == "png")
+        return writePng(img.size(), [&img](const QRect &r) { return img.copy(r); }, fileName, settings);
+#endif
+    return writeWhole(img.toImage(), fileName, settings); // other encoders need the whole image
+}
@@ -0,0 +1,170 @@
+#include "imageimport.h"
+#include "profiler.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <algorithm>
+
+#ifdef EPIGRIMP_HAVE_PNG
+#include <QSysInfo>
+#include <csetjmp>
+#include <png.h>
+#endif
+#ifdef EPIGRIMP_HAVE_TIFF
+#include <tiffio.h>
+#endif
+
+namespace {
+
+// decoded rows held at once by the streaming readers: one tile row
+constexpr int BandRows = TiledImage::TileSize;
+
+#ifdef EPIGRIMP_HAVE_PNG
+struct PngIo {
+    QFile *file;
+    QString error;
+};
+
+void pngRead(png_structp png, png_bytep data, png_size_t length)
+{
+    auto *io = static_cast<PngIo *>(png_get_io_ptr(png));
+    if (io->file->read(reinterpret_cast<char *>(data), qint64(length)) != qint64(length))
+        png_error(png, "unexpected end of file");
+}
+
+void pngError(png_structp png, png_const_charp message)
+{
+    static_cast<PngIo *>(png_get_error_ptr(png))->error = QString::fromLatin1(message);
+    png_longjmp(png, 1);
+}
+
+void pngWarning(png_structp, png_const_charp) {}
+
+// rows decoded a band at a time straight into tiles. false: not for this
+// reader (not a PNG, or interlaced, which needs the whole image anyway)
+bool importPng(const QString &fileName, ImportedImage &r)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false; // QImageReader reports it
+    png_byte sig[8];
+    if (file.read(reinterpret_cast<char *>(sig), 8) != 8 || png_sig_cmp(sig, 0, 8) != 0) return false;
+
+    PngIo io{&file, QString()};
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &io, pngError, pngWarning);
+    if (!png) return false;
+    png_infop info = png_create_info_struct(png);
+    // everything png_error() may jump over lives out here
+    TiledImage img;
+    QImage band;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        r.error = io.error.isEmpty() ? QString("Invalid PNG file") : io.error;
+        return true;
+    }
+
+    png_set_read_fn(png, &io, pngRead);
+    png_set_sig_bytes(png, 8);
+    png_read_info(png, info);
+    png_uint_32 w = 0, h = 0;
+    int depth = 0, colorType = 0, interlace = 0;
+    png_get_IHDR(png, info, &w, &h, &depth, &colorType, &interlace, nullptr, nullptr);
+    if (interlace != PNG_INTERLACE_NONE) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        return false;
+    }
+
+    // any PNG as 8 bit rows laid out like QImage::Format_ARGB32
+    png_set_expand(png); // palette, low gray depths, tRNS -> alpha
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    if (QSysInfo::ByteOrder == QSysInfo::LittleEndian) {
+        png_set_bgr(png);
+        png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+    } else {
+        png_set_filler(png, 0xff, PNG_FILLER_BEFORE);
+        png_set_swap_alpha(png);
+    }
+    png_read_update_info(png, info);
+
+    img = TiledImage(QSize(int(w), int(h)));
+    band = QImage(int(w), BandRows, QImage::Format_ARGB32);
+    if (band.isNull()) png_error(png, "image too large");
+    for (int y = 0; y < int(h); y += BandRows) {
+        const int n = std::min(BandRows, int(h) - y);
+        for (int k = 0; k < n; ++k) png_read_row(png, band.scanLine(k), nullptr);
+        img.setRows(y, n == BandRows ? band : band.copy(0, 0, int(w), n));
+    }
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &info, nullptr);
+    r.image = img;
+    return true;
+}
+#endif
+
+#ifdef EPIGRIMP_HAVE_TIFF
+// strips or tiles read a band at a time through libtiff's RGBA interface
+// (every photometric, alpha premultiplied); false if not a TIFF
+bool importTiff(const QString &fileName, ImportedImage &r)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix != "tif" && suffix != "tiff") return false;
+    TIFF *tif = TIFFOpen(QFile::encodeName(fileName).constData(), "r");
+    if (!tif) return false;
+
+    char message[1024] = "";
+    TIFFRGBAImage rgba;
+    if (!TIFFRGBAImageOK(tif, message) || !TIFFRGBAImageBegin(&rgba, tif, 0, message)) {
+        TIFFClose(tif);
+        r.error = QString::fromLatin1(message);
+        return true;
+    }
+    rgba.req_orientation = ORIENTATION_TOPLEFT;
+    const int w = int(rgba.width), h = int(rgba.height);
+    TiledImage img(QSize(w, h));
+    // packed A B G R words: ARGB32 with red and blue swapped
+    QImage band(w, BandRows, QImage::Format_ARGB32_Premultiplied);
+    bool ok = !band.isNull();
+    for (int y = 0; ok && y < h; y += BandRows) {
+        const int n = std::min(BandRows, h - y);
+        rgba.row_offset = y;
+        rgba.col_offset = 0;
+        ok = TIFFRGBAImageGet(&rgba, reinterpret_cast<uint32_t *>(band.bits()), uint32_t(w), uint32_t(n)) != 0;
+        if (ok) img.setRows(y, (n == BandRows ? band : band.copy(0, 0, w, n)).rgbSwapped());
+    }
+    TIFFRGBAImageEnd(&rgba);
+    TIFFClose(tif);
+    if (!ok) r.error = band.isNull() ? QString("Image too large") : QString("TIFF decoding failed");
+    else r.image = img;
+    return true;
+}
+#endif
+
+} // namespace
+
+ImportedImage importImage(const QString &fileName)
+{
+    EPIGRIMP_PROFILE_SCOPE("importImage");
+    ImportedImage r;
+    r.fileName = fileName;
+
+    // streamed: memory follows the tiles that hold pixels, not the image size
+#ifdef EPIGRIMP_HAVE_PNG
+    if (importPng(fileName, r)) return r;
+#endif
+#ifdef EPIGRIMP_HAVE_TIFF
+    if (importTiff(fileName, r)) return r;
+#endif
+
+    QImageReader reader(fileName);
+    QImage decoded;
+    if (!reader.read(&decoded)) {
+        r.error = reader.errorString();
+        return r;
+    }
+
+    // converted to premultiplied tile by tile, the decoded buffer is the only full-size one
+    r.image = TiledImage::fromImage(decoded);
+    return r;
+}
@@ -0,0 +1,230 @@
+#include "imageops.h"
+#include "mippyramid.h"
+#include "profiler.h"
+#include "workscheduler.h"
+
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace ImageOps {
+
+void forEachTile(TiledImage &img, const std::function<void(QImage &tile)> &fn)
+{
+    // work on shared copies, one QImage per item; detaching happens in
+    // the worker and the results go back into the layer on this thread
+    QVector<int> indices;
+    QVector<QImage> work;
+    for (int i = 0; i < img.tileCount(); ++i) {
+        if (img.tile(i).isNull()) continue;
+        indices.append(i);
+        work.append(img.tile(i));
+    }
+
+    QImage *tiles = work.data();
+    WorkScheduler::parallelFor(int(work.size()), [&](int k) { fn(tiles[k]); });
+
+    for (int k = 0; k < indices.size(); ++k)
+        img.setTile(indices[k], work[k]);
+}
+
+namespace {
+
+void forEachLine(TiledImage &img, const std::function<void(quint32 *line, int n)> &fn)
+{
+    forEachTile(img, [&](QImage &tile) {
+        uchar *bits = tile.bits(); // detaches once
+        const qsizetype bpl = tile.bytesPerLine();
+        for (int y = 0; y < tile.height(); ++y)
+            fn(reinterpret_cast<quint32 *>(bits + y * bpl), tile.width());
+    });
+}
+
+// source pixel of destination pixel (x, y), w x h = source size
+inline QPoint sourcePoint(Orientation o, int w, int h, int x, int y)
+{
+    switch (o) {
+    case Orientation::RotateRight: return QPoint(y, h - 1 - x);
+    case Orientation::RotateLeft: return QPoint(w - 1 - y, x);
+    case Orientation::FlipHorizontal: return QPoint(w - 1 - x, y);
+    case Orientation::FlipVertical: return QPoint(x, h - 1 - y);
+    }
+    return QPoint(x, y);
+}
+
+} // namespace
+
+void invert(TiledImage &img)
+{
+    EPIGRIMP_PROFILE_SCOPE("invert");
+    forEachLine(img, [](quint32 *line, int n) { PixelKernels::invert(line, n); });
+}
+
+void grayscale(TiledImage &img)
+{
+    EPIGRIMP_PROFILE_SCOPE("grayscale");
+    forEachLine(img, [](quint32 *line, int n) { PixelKernels::grayscale(line, n); });
+}
+
+void channelMix(TiledImage &img, const PixelKernels::ChannelMatrix &matrix)
+{
+    EPIGRIMP_PROFILE_SCOPE("channelMix");
+    forEachLine(img, [&](quint32 *line, int n) { PixelKernels::channelMix(line, n, matrix); });
+}
+
+void applyLut(TiledImage &img, const quint8 lut[256])
+{
+    EPIGRIMP_PROFILE_SCOPE("applyLut");
+    forEachLine(img, [&](quint32 *line, int n) { PixelKernels::applyLut(line, n, lut); });
+}
+
+TiledImage reoriented(const TiledImage &img, Orientation o)
+{
+    EPIGRIMP_PROFILE_SCOPE("reoriented");
+    const bool rotate = o == Orientation::RotateLeft || o == Orientation::RotateRight;
+    const int w = img.width(), h = img.height();
+    TiledImage out(rotate ? img.size().transposed() : img.size());
+
+    QVector<QImage> tiles(out.tileCount());
+    QImage *result = tiles.data();
+    WorkScheduler::parallelFor(out.tileCount(), [&](int i) {
+        const QRect tr = out.tileRect(i);
+        const QRect part = tr.intersected(out.rect());
+        const QRect srcRect = QRect(sourcePoint(o, w, h, part.left(), part.top()),
+                                    sourcePoint(o, w, h, part.right(), part.bottom())).normalized();
+
+        const QVector<int> from = img.tilesIn(srcRect);
+        if (std::all_of(from.cbegin(), from.cend(), [&](int k) { return img.tile(k).isNull(); }))
+            return; // nothing there, the tile stays transparent
+
+        const QImage src = img.copy(srcRect);
+        const uchar *srcBits = src.constBits();
+        const qsizetype srcBpl = src.bytesPerLine();
+
+        QImage tile(TiledImage::TileSize, TiledImage::TileSize, QImage::Format_ARGB32_Premultiplied);
+        tile.fill(Qt::transparent);
+        uchar *bits = tile.bits();
+        const qsizetype bpl = tile.bytesPerLine();
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(bits + (y - tr.top()) * bpl);
+            for (int x = part.left(); x <= part.right(); ++x) {
+                const QPoint s = sourcePoint(o, w, h, x, y) - srcRect.topLeft();
+                line[x - tr.left()] = reinterpret_cast<const quint32 *>(srcBits + s.y() * srcBpl)[s.x()];
+            }
+        }
+        result[i] = tile;
+    });
+
+    for (int i = 0; i < tiles.size(); ++i)
+        if (!tiles[i].isNull()) out.setTile(i, tiles[i]);
+    return out;
+}
+
+QTransform orientationTransform(Orientation o, const QSize &size)
+{
+    const qreal w = size.width(), h = size.height();
+    switch (o) {
+    case Orientation::RotateRight: return QTransform(0, 1, -1, 0, h, 0);
+    case Orientation::RotateLeft: return QTransform(0, -1, 1, 0, 0, w);
+    case Orientation::FlipHorizontal: return QTransform(-1, 0, 0, 1, w, 0);
+    case Orientation::FlipVertical: return QTransform(1, 0, 0, -1, 0, h);
+    }
+    return QTransform();
+}
+
+bool isLossless(const QTransform &t)
+{
+    if (t.type() > QTransform::TxRotate) return false; // shear, projection
+    const qreal m[4] = {t.m11(), t.m12(), t.m21(), t.m22()};
+    int units = 0;
+    for (qreal v : m) {
+        if (v == 1.0 || v == -1.0) ++units;
+        else if (v != 0.0) return false;
+    }
+    return units == 2 && (t.m11() == 0.0) == (t.m22() == 0.0);
+}
+
+TiledImage transformed(const TiledImage &img, const QTransform &t)
+{
+    if (t.isIdentity() || img.isNull()) return img;
+    if (!isLossless(t)) {
+        EPIGRIMP_PROFILE_SCOPE("transformed");
+        return TiledImage::fromImage(img.copy(img.rect()).transformed(t, Qt::SmoothTransformation));
+    }
+
+    // the 8 orientations as at most two exact steps
+    using O = Orientation;
+    const int a = qRound(t.m11()), b = qRound(t.m12()), c = qRound(t.m21()), d = qRound(t.m22());
+    QVector<O> steps;
+    if (a == 0 && b == 1 && c == -1) steps = {O::RotateRight};
+    else if (a == 0 && b == -1 && c == 1) steps = {O::RotateLeft};
+    else if (a == 0 && b == 1 && c == 1) steps = {O::RotateRight, O::FlipHorizontal}; // transpose
+    else if (a == 0 && b == -1 && c == -1) steps = {O::FlipHorizontal, O::RotateRight};
+    else if (a == -1 && d == -1) steps = {O::FlipHorizontal, O::FlipVertical};
+    else if (a == -1) steps = {O::FlipHorizontal};
+    else if (d == -1) steps = {O::FlipVertical};
+
+    TiledImage out = img;
+    for (O o : steps) out = reoriented(out, o);
+    return out;
+}
+
+bool isOpaque(const TiledImage &img)
+{
+    if (img.format() == QImage::Format_Grayscale8) return true;
+    std::atomic<bool> opaque{true};
+    const int bpp = TiledImage::bytesPerPixel(img.format());
+    WorkScheduler::parallelFor(img.tileCount(), [&](int i) {
+        const QImage &t = img.tile(i);
+        if (t.isNull() || !opaque.load(std::memory_order_relaxed)) return;
+        const QRect part = img.tileRect(i).intersected(img.rect()).translated(-img.tileRect(i).topLeft());
+        quint32 line[TiledImage::TileSize];
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            PixelKernels::unpackToArgb32(line, t.constScanLine(y) + part.left() * bpp, part.width(), img.format());
+            for (int x = 0; x < part.width(); ++x) {
+                if (line[x] < 0xff000000) {
+                    opaque.store(false, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    });
+    return opaque.load();
+}
+
+QImage downscaled(const TiledImage &img, const QSize &bound)
+{
+    if (img.isNull()) return QImage();
+    const QSize target = img.size().scaled(bound, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+
+    // halvings that keep the image at least as large as the target (a tile halves 8 times at most)
+    int n = 0;
+    while (n < 8 && (img.width() >> (n + 1)) >= target.width() && (img.height() >> (n + 1)) >= target.height())
+        ++n;
+
+    const int step = TiledImage::TileSize >> n;
+    QImage small(((img.width() - 1) >> n) + 1, ((img.height() - 1) >> n) + 1, QImage::Format_ARGB32_Premultiplied);
+    small.fill(Qt::transparent);
+    uchar *bits = small.bits();
+    const qsizetype bpl = small.bytesPerLine();
+
+    // tile edges fall on even pixels at every level, so halving tiles one by
+    // one matches halving the whole image (up to the last row/column of odd sizes)
+    WorkScheduler::parallelFor(img.tileCount(), [&](int i) {
+        if (img.tile(i).isNull()) return;
+        QImage t = img.tile(i);
+        if (t.format() != QImage::Format_ARGB32_Premultiplied) t = t.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        for (int k = 0; k < n; ++k) t = MipPyramid::halved(t);
+
+        const QPoint at((i % img.tileColumns()) * step, (i / img.tileColumns()) * step);
+        const QRect part = QRect(at, t.size()).intersected(small.rect());
+        for (int y = part.top(); y <= part.bottom(); ++y)
+            std::memcpy(bits + y * bpl + part.left() * 4, t.constScanLine(y - at.y()), size_t(part.width()) * 4);
+    });
+
+    if (small.size() == target) return small;
+    return small.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+} // namespace ImageOps
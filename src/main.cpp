@@ -1,9 +1,21 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include "batchrunner.h"
 #include "mainwindow.h"
 
 int main(int argc, char *argv[])
 {
+    // headless batch processing, no display needed
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--batch") == 0) {
+            QCoreApplication app(argc, argv);
+            return BatchRunner::run(QCoreApplication::arguments());
+        }
+    }
+
     QApplication a(argc, argv);
+    // keep every pointer sample for strokes, the canvas paces its own redraws
+    QApplication::setAttribute(Qt::AA_CompressHighFrequencyEvents, false);
     MainWindow w;
     w.show();
     return a.exec();
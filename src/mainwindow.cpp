@@ -1,4 +1,11 @@
 #include "mainwindow.h"
+#include "convolution.h"
+#include "filterdialog.h"
+#ifdef EPIGRIMP_HAVE_GL
+#include "glcanvasview.h"
+#endif
+#include "imageops.h"
+#include "profiler.h"
 
 #include <QMenuBar>
 #include <QMenu>
@@ -16,8 +23,23 @@
 #include <QPainter>
 #include <QActionGroup>
 #include <QMouseEvent>
+#include <QTabletEvent>
+#include <QPaintEvent>
+#include <QScreen>
+#include <QFormLayout>
+#include <QDialogButtonBox>
+#include <QCheckBox>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QMimeData>
+#include <QClipboard>
+#include <QGuiApplication>
+#include <QUrl>
+#include <QtConcurrent>
 #include <QPushButton>
 #include <QFileInfo>
+#include <QDir>
+#include <QStandardPaths>
 #include <QMessageBox>
 #include <QColorDialog>
 #include <QLabel>
@@ -27,11 +49,17 @@
 #include <QDebug>
 #include <QKeySequence>
 #include <QTransform>
+#include <QSet>
 #include <algorithm>
 
+namespace {
+const QSize DefaultDocumentSize(1600, 1200); // what a new window starts with, then the document decides
+}
+
 // ---------------- Canvas implementation ----------------
 Canvas::Canvas(QWidget *parent)
     : QWidget(parent),
+      composite(&blankComposite),
       targetImg(nullptr),
       penWidth(6),
       penColor(Qt::black),
@@ -40,35 +68,72 @@ Canvas::Canvas(QWidget *parent)
       currentTool(BRUSH)
 {
     // initial blank composite (will be replaced by compositeLayers() from MainWindow)
-    composite = QImage(1200, 800, QImage::Format_ARGB32_Premultiplied);
-    composite.fill(Qt::white);
+    blankComposite = TiledImage(DefaultDocumentSize);
+    blankComposite.fill(Qt::white); // one shared tile
+    pyramid.setBase(composite);
 
     setAttribute(Qt::WA_StaticContents);
+    setAttribute(Qt::WA_TabletTracking); // pen pressure, see tabletEvent()
     setMinimumSize(400, 300);
 
     // initialize offsets and state
     imageOffset = QPoint(0, 0);
     lastPoint = QPoint(-1, -1);
     startPoint = QPoint(-1, -1);
+
+    // input is buffered and rendered at most once per display frame
+    frameTimer.setSingleShot(true);
+    frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&frameTimer, &QTimer::timeout, this, &Canvas::processFrame);
 }
 
-void Canvas::setCompositeImage(const QImage &c)
+void Canvas::setCompositeImage(const TiledImage *c, const QRect &dirtyRect)
 {
-    composite = c;
+    if (dirtyRect.isNull() || c != composite || dirtyRect.contains(c->rect())) {
+        composite = c;
+        pyramid.setBase(composite);
+        displayDirty = rect();
+        refreshView();
+        return;
+    }
 
-    update();
+    // only resample and repaint the damaged area, the pixels are read in place
+    QRect r = dirtyRect.intersected(composite->rect());
+    if (r.isEmpty()) return;
+    pyramid.markDirty(r);
+
+    const QRect wr = imageToWidget(r);
+    displayDirty += wr;
+    refreshView(wr);
 }
 
-void Canvas::setTargetImage(QImage *target)
+void Canvas::setTargetImage(TiledImage *target, const QTransform &transform, bool paintable)
 {
+    if (target != targetImg || transform != targetTransform) brushEngine.cancel(); // a stroke belongs to its layer
     targetImg = target;
-    // make sure the target image has at least composite size or widget size
-    ensureTargetSizeMatchesWidget();
+    targetPaintable = paintable;
+    targetTransform = transform;
+    imageToTarget = transform.inverted();
+    // the target must cover the document (older layers may be smaller)
+    ensureTargetCoversDocument();
+}
+
+QSize Canvas::targetSize() const
+{
+    return targetTransform.mapRect(targetImg->rect()).size();
+}
+
+QImage Canvas::getSelectionImage() const
+{
+    if (!hasSelection() || !targetImg || selection.isEmpty()) return QImage();
+    if (targetTransform.isIdentity()) return selection.copy(*targetImg);
+    // read in layer pixels, then turned as displayed (90 degree steps, lossless)
+    return selectionInTarget().copy(*targetImg).transformed(targetTransform);
 }
 
 QImage Canvas::getDisplayedImage() const
 {
-    return composite;
+    return composite->toImage();
 }
 
 void Canvas::setPenColor(const QColor &c) { penColor = c; eraserMode = false; }
@@ -79,7 +144,9 @@ void Canvas::setZoom(double z)
 {
     if (z <= 0.0) return;
     zoom = z;
-    update();
+    displayDirty = rect();
+    emit viewChanged(); // more of the document may show
+    refreshView();
 }
 
 void Canvas::setTool(Tool t)
@@ -93,32 +160,52 @@ void Canvas::setTool(Tool t)
 
 void Canvas::paintEvent(QPaintEvent *event)
 {
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
+    EPIGRIMP_PROFILE_SCOPE("paintEvent");
+    if (gpuView) return; // covered by the OpenGL view
 
-    painter.drawImage(imageOffset.x(), imageOffset.y(),
-                      composite.scaled(composite.size()*zoom));
+    if (displayCache.size() != size()) {
+        displayCache = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+        displayDirty = rect();
+    }
 
+    // resample only the part of the exposed area that is out of date
+    const QRegion todo = displayDirty & event->region();
+    for (const QRect &r : todo)
+        renderDisplayCache(r);
+    displayDirty -= todo;
 
-    for (int i = 0; i < textItems.size(); ++i) {
-        const TextItem &t = textItems[i];
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
 
-        painter.setFont(t.font);
-        painter.setPen(t.color);
+    painter.drawImage(event->rect(), displayCache, event->rect());
+    paintOverlay(painter);
+}
 
-        QPoint wPos(imageOffset.x() + t.position.x()*zoom,
-                    imageOffset.y() + t.position.y()*zoom);
+void Canvas::paintOverlay(QPainter &painter)
+{
+    if (!floatingImage.isNull()) {
+        const QRectF wr(QPointF(imageOffset) + QPointF(floatingPos) * zoom, QSizeF(floatingImage.size()) * zoom);
+        painter.drawImage(wr, floatingImage);
+        painter.setPen(QPen(Qt::blue, 1, Qt::DashLine));
+        painter.drawRect(wr);
+    }
 
-        painter.drawText(wPos, t.text);
+    // only the items over the widget, each blitted from its cached raster
+    const QRect visible = QRectF(widgetToImageF(QPointF(0, 0)), widgetToImageF(QPointF(width(), height())))
+                              .toAlignedRect();
+    for (int i : textCache.itemsIn(visible)) {
+        const TextItem &t = textItems[i];
+        const QRect box = TextItemCache::paddedRect(t);
+        const QRectF wr(QPointF(imageOffset) + QPointF(box.topLeft()) * zoom, QSizeF(box.size()) * zoom);
+        painter.drawImage(wr, textCache.raster(i, t, zoom));
 
         if (t.selected) {
             painter.setPen(QPen(Qt::blue, 1, Qt::DashLine));
-            QRect scaledRect = QRect(wPos, t.boundingRect.size() * zoom);
-            painter.drawRect(scaledRect);
+            const QRect r = TextItemCache::itemRect(t);
+            painter.drawRect(QRectF(QPointF(imageOffset) + QPointF(r.topLeft()) * zoom, QSizeF(r.size()) * zoom));
         }
     }
 
-
     QPen selPen(Qt::DashLine);
     selPen.setColor(Qt::blue);
     selPen.setWidth(1);
@@ -137,8 +224,141 @@ void Canvas::paintEvent(QPaintEvent *event)
         }
         painter.drawPolygon(wPoly);
     }
+
+    if (hudVisible) paintHud(painter);
+}
+
+namespace {
+const QRect HudRect(8, 8, 250, 112);
+}
+
+void Canvas::setHudVisible(bool on)
+{
+    hudVisible = on;
+    frameClock.invalidate();
+    refreshView(HudRect);
+}
+
+void Canvas::paintHud(QPainter &painter)
+{
+    // called once per displayed frame, whatever backend draws it
+    if (frameClock.isValid()) frameMs = frameClock.nsecsElapsed() / 1e6;
+    frameClock.start();
+
+    const double paintMs = Profiler::lastMs(gpuView ? "paintGL" : "paintEvent");
+    const double compositeMs = Profiler::lastMs("compositeLayers");
+    const qint64 dirty = Profiler::lastCounter("dirtyPixels");
+    const qint64 undoBytes = Profiler::lastCounter("undoBytes");
+    const auto mb = [](const char *name) { return qMax<qint64>(0, Profiler::lastCounter(name)) / 1048576.0; };
+    // composite tiles (with the caches over them) and the mip tiles made from them
+    const double viewMb = mb("compositeBytes") + pyramid.memoryBytes() / 1048576.0;
+    const QString text = QString("frame %1 ms  (paint %2 ms)\ncomposite %3 ms  %9 MB\ndirty %4 px\nundo %5 MB\n"
+                                 "layers %6 MB  store %7 / disk %8 MB\nadjustments %10 MB")
+                             .arg(frameMs, 0, 'f', 1).arg(qMax(0.0, paintMs), 0, 'f', 2)
+                             .arg(qMax(0.0, compositeMs), 0, 'f', 2).arg(qMax<qint64>(0, dirty))
+                             .arg(qMax<qint64>(0, undoBytes) / 1048576.0, 0, 'f', 1)
+                             .arg(mb("layerBytes"), 0, 'f', 0).arg(mb("storeRamBytes"), 0, 'f', 0)
+                             .arg(mb("storeDiskBytes"), 0, 'f', 0).arg(viewMb, 0, 'f', 0)
+                             .arg(mb("adjustmentBytes"), 0, 'f', 0);
+
+    painter.save();
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(0, 0, 0, 170));
+    painter.drawRoundedRect(HudRect, 4, 4);
+    painter.setPen(Qt::white);
+    painter.setFont(QFont("monospace", 9));
+    painter.drawText(HudRect.adjusted(8, 6, -8, -6), Qt::AlignLeft | Qt::AlignTop, text);
+    painter.restore();
+}
+
+void Canvas::refreshView()
+{
+#ifdef EPIGRIMP_HAVE_GL
+    if (gpuView) {
+        gpuView->update();
+        return;
+    }
+#endif
+    update();
+}
+
+void Canvas::refreshView(const QRect &widgetRect)
+{
+#ifdef EPIGRIMP_HAVE_GL
+    if (gpuView) {
+        gpuView->update(); // QOpenGLWidget always redraws whole
+        return;
+    }
+#endif
+    update(widgetRect);
+    if (hudVisible) update(HudRect); // its numbers change with every frame
+}
+
+bool Canvas::setGpuBackend(bool on)
+{
+#ifdef EPIGRIMP_HAVE_GL
+    if (on == gpuBackend()) return true;
+    if (on) {
+        gpuView = new GLCanvasView(this);
+        gpuView->setGeometry(rect());
+        gpuView->setLayers(gpuLayers, gpuActive);
+        gpuView->show();
+    } else {
+        gpuView->deleteLater(); // may be the caller (init failure)
+        gpuView = nullptr;
+        displayDirty = rect();
+        update();
+    }
+    emit gpuBackendChanged(on);
+    return true;
+#else
+    Q_UNUSED(on);
+    return !on; // built without OpenGL
+#endif
+}
+
+void Canvas::setLayerStack(const QVector<Layer> *layers, int activeIndex)
+{
+    gpuLayers = layers;
+    gpuActive = activeIndex;
+#ifdef EPIGRIMP_HAVE_GL
+    if (gpuView) gpuView->setLayers(layers, activeIndex);
+#endif
 }
 
+void Canvas::layersChanged(const QRect &imageRect)
+{
+#ifdef EPIGRIMP_HAVE_GL
+    if (gpuView) gpuView->layersChanged(imageRect);
+#else
+    Q_UNUSED(imageRect);
+#endif
+}
+
+void Canvas::renderDisplayCache(const QRect &wr)
+{
+    QPainter p(&displayCache);
+    p.setClipRect(wr);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.fillRect(wr, Qt::transparent);
+
+    // zoomed out: sample from the nearest mip level instead of the full image
+    const int n = zoom < 1.0 ? pyramid.levelForScale(zoom) : 0;
+    const double z = zoom * (1 << n);
+
+    // image pixels covering wr, drawn at their exact zoomed position so that
+    // separately rendered areas line up
+    QRect src = QRectF((wr.x() - imageOffset.x()) / z, (wr.y() - imageOffset.y()) / z,
+                       wr.width() / z, wr.height() / z)
+                    .toAlignedRect();
+    const TiledImage &img = pyramid.level(n, src); // only the tiles under wr are halved
+    src &= img.rect();
+    if (src.isEmpty()) return;
+
+    p.translate(imageOffset);
+    p.scale(z, z);
+    img.draw(p, src);
+}
 
 QPoint Canvas::widgetToImage(const QPoint &p, const QSize &imgSize)
 {
@@ -157,24 +377,68 @@ QPoint Canvas::widgetToImage(const QPoint &p, const QSize &imgSize)
     return QPoint(int(ix + 0.5), int(iy + 0.5));
 }
 
+QPointF Canvas::widgetToImageF(const QPointF &p) const
+{
+    return (p - QPointF(imageOffset)) / zoom;
+}
+
+QRect Canvas::visibleImageRect() const
+{
+    const QRectF r(widgetToImageF(QPointF(0, 0)), QSizeF(width() / zoom, height() / zoom));
+    return r.toAlignedRect().intersected(composite->rect());
+}
+
+QRect Canvas::imageToWidget(const QRect &r) const
+{
+    // widget area covered by image rect r (rounded outwards, 1px margin for scaling)
+    QRectF wr(imageOffset.x() + r.x() * zoom, imageOffset.y() + r.y() * zoom,
+              r.width() * zoom, r.height() * zoom);
+    return wr.toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+// the pen's pressure when the mouse event was made from a tablet one, else what
+// the event carries (plain mice report 1)
+qreal Canvas::pressureOf(const QMouseEvent *event) const
+{
+    if (tabletPressure > 0.0) return tabletPressure;
+    const qreal p = event->points().isEmpty() ? 1.0 : event->points().first().pressure();
+    return p > 0.0 ? p : 1.0;
+}
+
+void Canvas::tabletEvent(QTabletEvent *event)
+{
+    // only the pressure is kept: ignored, the event comes back as the mouse
+    // event every tool handles, which then takes it (see pressureOf())
+    const bool down = event->type() == QEvent::TabletPress || event->type() == QEvent::TabletMove;
+    tabletPressure = down && event->buttons() != Qt::NoButton ? event->pressure() : 0.0;
+    event->ignore();
+}
+
 void Canvas::mousePressEvent(QMouseEvent *event)
 {
-    if (currentTool == TEXT && event->button() == Qt::LeftButton && targetImg) {
-        QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
+    // floating paste: dragged from inside, anchored by a click outside
+    if (!floatingImage.isNull() && event->button() == Qt::LeftButton) {
+        const QPointF p = widgetToImageF(event->position());
+        const QPoint imgPt(int(std::floor(p.x())), int(std::floor(p.y())));
+        if (QRect(floatingPos, floatingImage.size()).contains(imgPt)) {
+            movingFloating = true;
+            lastPoint = imgPt;
+            return;
+        }
+        commitFloatingPaste();
+    }
+
+    if (currentTool == TEXT && event->button() == Qt::LeftButton && targetImg && targetPaintable) {
+        QPoint imgPt = widgetToImage(event->pos(), targetSize());
         if (imgPt == QPoint(-1,-1)) return;
 
         // Sélection texte existant
-        activeTextIndex = -1;
-        for (int i = textItems.size() - 1; i >= 0; --i) {
-            if (textItems[i].boundingRect
-                    .translated(textItems[i].position)
-                    .contains(imgPt)) {
-                activeTextIndex = i;
-                textItems[i].selected = true;
-                lastPoint = imgPt;
-                update();
-                return;
-            }
+        activeTextIndex = textCache.itemAt(textItems, imgPt);
+        if (activeTextIndex >= 0) {
+            textItems[activeTextIndex].selected = true;
+            lastPoint = imgPt;
+            refreshView();
+            return;
         }
 
         // Nouveau texte
@@ -194,14 +458,15 @@ void Canvas::mousePressEvent(QMouseEvent *event)
         item.boundingRect = fm.boundingRect(item.text);
 
         textItems.append(item);
+        textCache.append(item);
         activeTextIndex = textItems.size() - 1;
 
-        update();
+        refreshView();
         return;
     }
 
     if (event->button() == Qt::LeftButton && targetImg) {
-        QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
+        QPoint imgPt = widgetToImage(event->pos(), targetSize());
         if (imgPt == QPoint(-1,-1)) return;
 
         startPoint = imgPt;
@@ -216,72 +481,125 @@ void Canvas::mousePressEvent(QMouseEvent *event)
             lassoPolygon << imgPt;
         }
 
-        emit strokeStarted(); // pour undo
+        // pour undo; selecting changes no pixel
+        if (currentTool != RECT_SELECT && currentTool != LASSO_SELECT) {
+            if (!targetPaintable) return; // adjustment layer: no pixel to paint on
+            emit strokeStarted();
+        }
+
+        if (currentTool == BRUSH || currentTool == ERASER) {
+            BrushSettings b;
+            b.diameter = penWidth;
+            b.hardness = brushHardness;
+            b.color = penColor;
+            b.eraser = eraserMode;
+            // the stroke runs in layer pixels, what it reports is mapped back to the image
+            const QRect dirty = brushEngine.begin(targetImg->size(), b, imageToTarget.map(widgetToImageF(event->position())),
+                                                  pressureOf(event));
+            emit strokeFinished(targetTransform.mapRect(dirty)); // display only, the layer is written on release
+        }
     }
 }
 
 
 void Canvas::mouseMoveEvent(QMouseEvent *event)
 {
+    if (movingFloating) {
+        // the layer is not touched, only the overlay is redrawn
+        const QPointF p = widgetToImageF(event->position());
+        const QPoint imgPt(int(std::floor(p.x())), int(std::floor(p.y())));
+        floatingPos += imgPt - lastPoint;
+        lastPoint = imgPt;
+        overlayChanged = true;
+        scheduleFrame();
+        return;
+    }
     if (currentTool == TEXT && activeTextIndex >= 0 &&
         (event->buttons() & Qt::LeftButton)) {
 
-        QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
+        QPoint imgPt = widgetToImage(event->pos(), targetSize());
         if (imgPt == QPoint(-1,-1)) return;
 
         QPoint delta = imgPt - lastPoint;
-        textItems[activeTextIndex].position += delta;
+        TextItem &t = textItems[activeTextIndex];
+        const QRect before = TextItemCache::itemRect(t);
+        t.position += delta;
+        textCache.update(activeTextIndex, before, t); // raster kept, only the grid cell changes
         lastPoint = imgPt;
 
-        update();
+        overlayChanged = true;
+        scheduleFrame();
         return;
     }
     if (!(event->buttons() & Qt::LeftButton) || !targetImg) return;
-    QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
+
+    // brush/eraser: every sample is kept, they are rasterized once per frame
+    if (brushEngine.isActive()) {
+        pendingSamples.append({imageToTarget.map(widgetToImageF(event->position())), pressureOf(event)});
+        scheduleFrame();
+        return;
+    }
+
+    QPoint imgPt = widgetToImage(event->pos(), targetSize());
     if (imgPt == QPoint(-1,-1)) return;
 
     if (currentTool == RECT_SELECT && selecting) {
         selectionRect.setBottomRight(imgPt);
-        update(); // redraw pour visualiser
+        overlayChanged = true; // redraw pour visualiser, à la prochaine frame
+        scheduleFrame();
     } else if (currentTool == LASSO_SELECT && selecting) {
+        // points closer than 2 pixels add nothing to the outline
+        if ((imgPt - lassoPolygon.last()).manhattanLength() < 2) return;
         lassoPolygon << imgPt;
-        update(); // redraw
-    }
-    if (!(event->buttons() & Qt::LeftButton) || !targetImg) return;
-    QSize imgSize = targetImg->size();
-    QPoint imgP = widgetToImage(event->pos(), imgSize);
-    if (imgP == QPoint(-1, -1)) {
-        // out of image bounds: ignore movement
-        return;
+        overlayChanged = true;
+        scheduleFrame();
     }
+}
 
-    // For brush/eraser: draw as mouse moves (using image coords)
-    if (currentTool == BRUSH || currentTool == ERASER) {
-        QPainter painter(targetImg);
-        painter.setRenderHint(QPainter::Antialiasing, true);
+void Canvas::scheduleFrame()
+{
+    if (frameTimer.isActive()) return;
+    const qreal hz = screen() ? screen()->refreshRate() : 60.0;
+    frameTimer.start(std::max(1, int(1000.0 / std::max<qreal>(hz, 1.0))));
+}
 
-        if (eraserMode) {
-            // Clear using CompositionMode_Clear for proper alpha erasing
-            painter.setCompositionMode(QPainter::CompositionMode_Clear);
-            QPen pen(Qt::transparent, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-            painter.setPen(pen);
-            painter.drawLine(lastPoint, imgP);
-            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-        } else {
-            QPen pen(penColor, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-            painter.setPen(pen);
-            painter.drawLine(lastPoint, imgP);
-        }
-        lastPoint = imgP;
-        emit strokeFinished();
-    } else {
+void Canvas::processFrame()
+{
+    EPIGRIMP_PROFILE_SCOPE("strokeFrame");
+    frameTimer.stop();
+
+    // all samples since the last frame, then a single composite of their union
+    if (!pendingSamples.isEmpty() && brushEngine.isActive()) {
+        QRect dirty;
+        for (const PointerSample &s : pendingSamples)
+            dirty |= brushEngine.strokeTo(s.pos, s.pressure);
+        if (!dirty.isEmpty()) emit strokeFinished(targetTransform.mapRect(dirty));
+    }
+    pendingSamples.clear();
+
+    if (overlayChanged) {
+        overlayChanged = false;
+        refreshView();
     }
 }
 
 void Canvas::mouseReleaseEvent(QMouseEvent *event)
 {
+    processFrame(); // nothing buffered may be lost or applied after the release
+    if (movingFloating) {
+        movingFloating = false;
+        return;
+    }
+
+    if (event->button() == Qt::LeftButton && brushEngine.isActive()) {
+        const QRect dirty = brushEngine.finish(*targetImg);
+        // give back the memory of tiles the eraser emptied
+        if (eraserMode && !dirty.isEmpty()) targetImg->squeeze(dirty);
+        emit strokeFinished(targetTransform.mapRect(dirty));
+    }
+
     if (event->button() == Qt::LeftButton && selecting) {
-        QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
+        QPoint imgPt = widgetToImage(event->pos(), targetSize());
         if (imgPt != QPoint(-1,-1)) {
             if (currentTool == RECT_SELECT) {
                 selectionRect.setBottomRight(imgPt);
@@ -291,28 +609,21 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event)
         }
         selecting = false;
 
-        // Met à jour _hasSelection
+        // Met à jour _hasSelection, la sélection devient un masque de spans
         if (currentTool == RECT_SELECT && !selectionRect.isNull()) {
-            _hasSelection = true;
-        } else if (currentTool == LASSO_SELECT && !lassoPolygon.isEmpty()) {
-            _hasSelection = true;
-
-            // Recalculer selectionRect pour englober le polygone
-            int minX = lassoPolygon[0].x(), minY = lassoPolygon[0].y();
-            int maxX = lassoPolygon[0].x(), maxY = lassoPolygon[0].y();
-            for (const QPoint &p : lassoPolygon) {
-                if (p.x() < minX) minX = p.x();
-                if (p.y() < minY) minY = p.y();
-                if (p.x() > maxX) maxX = p.x();
-                if (p.y() > maxY) maxY = p.y();
-            }
-            selectionRect = QRect(QPoint(minX, minY), QPoint(maxX, maxY));
+            selectionRect = selectionRect.normalized();
+            selection = SelectionMask::fromRect(selectionRect);
+        } else if (currentTool == LASSO_SELECT && lassoPolygon.size() >= 3) {
+            lassoPolygon = SelectionMask::simplified(lassoPolygon, 0.75);
+            selection = SelectionMask::fromPolygon(lassoPolygon);
+            selectionRect = selection.bounds();
         } else {
-            _hasSelection = false;
+            selection = SelectionMask();
         }
+        _hasSelection = !selection.isEmpty();
 
-        emit strokeFinished();
-        update();
+        emit strokeFinished(QRect()); // selection only, no pixel changed
+        refreshView();
     }
 }
 
@@ -320,23 +631,20 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event)
 void Canvas::resizeEvent(QResizeEvent *event)
 {
     QWidget::resizeEvent(event);
-    ensureTargetSizeMatchesWidget();
+#ifdef EPIGRIMP_HAVE_GL
+    if (gpuView) gpuView->setGeometry(rect());
+#endif
+    // the document does not follow the widget: nothing to resize, more of it may show
+    emit viewChanged();
 }
 
-void Canvas::ensureTargetSizeMatchesWidget()
+void Canvas::ensureTargetCoversDocument()
 {
-    if (!targetImg) return;
-    // Ensure the target image has at least the same pixel size as the composite image if composite is larger
-    QSize wsize = targetImg->size();
-    // We don't force it to widget size here; keep simple: if too small, expand to composite size
-    if (targetImg->width() < composite.width() || targetImg->height() < composite.height()) {
-        int newW = qMax(targetImg->width(), composite.width());
-        int newH = qMax(targetImg->height(), composite.height());
-        QImage newImg(newW, newH, QImage::Format_ARGB32_Premultiplied);
-        newImg.fill(Qt::transparent);
-        QPainter p(&newImg);
-        p.drawImage(0, 0, *targetImg);
-        *targetImg = newImg;
+    if (!targetImg || !targetTransform.isIdentity()) return; // a transformed layer keeps its own size
+    if (targetImg->width() < composite->width() || targetImg->height() < composite->height()) {
+        int newW = qMax(targetImg->width(), composite->width());
+        int newH = qMax(targetImg->height(), composite->height());
+        targetImg->resize(QSize(newW, newH)); // only the tile grid grows
     }
 }
 
@@ -384,18 +692,27 @@ MainWindow::MainWindow(QWidget *parent)
     // status bar
     statusLabel = new QLabel("Ready", this);
     statusBar()->addWidget(statusLabel);
+    cancelImportBtn = new QPushButton("Cancel Import", this);
+    cancelImportBtn->hide();
+    statusBar()->addPermanentWidget(cancelImportBtn);
+    connect(cancelImportBtn, &QPushButton::clicked, &importWatcher, &QFutureWatcher<ImportedImage>::cancel);
+    connect(&importWatcher, &QFutureWatcher<ImportedImage>::progressValueChanged, this, [this](int done) {
+        if (importWatcher.progressMaximum() > 1)
+            statusLabel->setText(QString("Loading images... %1/%2").arg(done).arg(importWatcher.progressMaximum()));
+    });
+    connect(&importWatcher, &QFutureWatcher<ImportedImage>::finished, this, &MainWindow::onImportFinished);
+    setAcceptDrops(true);
 
     // initial two layers (bottom = background white, top = transparent)
     Layer bg;
     bg.name = "Background";
-    bg.image = QImage(1600, 1200, QImage::Format_ARGB32_Premultiplied);
+    bg.image = TiledImage(DefaultDocumentSize);
     bg.image.fill(Qt::white);
     layers.append(bg);
 
     Layer top;
     top.name = "Layer 1";
-    top.image = QImage(1600, 1200, QImage::Format_ARGB32_Premultiplied);
-    top.image.fill(Qt::transparent);
+    top.image = TiledImage(DefaultDocumentSize); // transparent: no tile stored
     layers.append(top);
 
     // set active layer to top (index 1)
@@ -415,17 +732,47 @@ MainWindow::MainWindow(QWidget *parent)
     // canvas <-> mainwindow signals
     connect(canvas, &Canvas::strokeStarted, this, &MainWindow::onStrokeStarted);
     connect(canvas, &Canvas::strokeFinished, this, &MainWindow::onStrokeFinished);
+    connect(canvas, &Canvas::viewChanged, this, [this] {
+        // zoomed out or resized: blend what comes into sight
+        if (layers.isEmpty() || canvas->gpuBackend()) return;
+        const QRect shown = blendStale(canvas->visibleImageRect());
+        if (!shown.isEmpty()) canvas->setCompositeImage(&composite, shown);
+    });
 
     // set initial target and composite
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
     compositeLayers();
 
     setupMenu();
     setupToolbarAndPalette();
     statusLabel->setText("Ready - active layer: " + layers[activeLayerIndex].name);
+    setupAutosave();
+
+    tileStore = QSharedPointer<TileStore>::create();
+    connect(&memoryTimer, &QTimer::timeout, this, &MainWindow::trimLayerMemory);
+    memoryTimer.start(2000);
+
+    connect(&filterWatcher, &QFutureWatcher<FilterBatch>::resultReadyAt, this, &MainWindow::onFilterBatchReady);
+    connect(&filterWatcher, &QFutureWatcher<FilterBatch>::finished, this, &MainWindow::onFilterJobFinished);
+    filterResubmitTimer.setSingleShot(true);
+    filterResubmitTimer.setInterval(150);
+    connect(&filterResubmitTimer, &QTimer::timeout, this, &MainWindow::resubmitFilterJob);
 }
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow()
+{
+    // running decodes finish on their own, their results are dropped
+    importWatcher.cancel();
+    importWatcher.waitForFinished();
+    filterWatcher.cancel();
+    filterWatcher.waitForFinished();
+    // a save must not be cut off when the window closes
+    for (QFutureWatcher<QString> *job : saveJobs) job->waitForFinished();
+    projectSaveWatcher.waitForFinished();
+    autosaveTimer.stop();
+    autosaveWatcher.waitForFinished();
+    if (autosaveLock) QFile::remove(autosaveFileName); // closed normally, nothing to recover
+}
 
 void MainWindow::setupMenu()
 {
@@ -436,11 +783,35 @@ void MainWindow::setupMenu()
     connect(openAct, &QAction::triggered, this, &MainWindow::openFile);
     fileMenu->addAction(openAct);
 
+    QAction *openLayerAct = new QAction("Open PNG as &Layer...", this);
+    connect(openLayerAct, &QAction::triggered, this, &MainWindow::openPNGAsNewLayer);
+    fileMenu->addAction(openLayerAct);
+
+    QAction *openProjectAct = new QAction("Open &Project...", this);
+    connect(openProjectAct, &QAction::triggered, this, &MainWindow::openProject);
+    fileMenu->addAction(openProjectAct);
+
+    QAction *saveProjectAct = new QAction("Save P&roject", this);
+    saveProjectAct->setShortcut(QKeySequence("Ctrl+Alt+S")); // Ctrl+S stays on Save Composite
+    connect(saveProjectAct, &QAction::triggered, this, &MainWindow::saveProject);
+    fileMenu->addAction(saveProjectAct);
+
+    QAction *saveProjectAsAct = new QAction("Save Project &As...", this);
+    saveProjectAsAct->setShortcut(QKeySequence::SaveAs);
+    connect(saveProjectAsAct, &QAction::triggered, this, &MainWindow::saveProjectAs);
+    fileMenu->addAction(saveProjectAsAct);
+
+    fileMenu->addSeparator();
+
     QAction *saveAct = new QAction("&Save Composite...", this);
     saveAct->setShortcut(QKeySequence::Save);
     connect(saveAct, &QAction::triggered, this, &MainWindow::saveFile);
     fileMenu->addAction(saveAct);
 
+    QAction *exportSettingsAct = new QAction("Export Settings...", this);
+    connect(exportSettingsAct, &QAction::triggered, this, &MainWindow::editExportSettings);
+    fileMenu->addAction(exportSettingsAct);
+
     fileMenu->addSeparator();
 
     QAction *clearAct = new QAction("&Clear Active Layer", this);
@@ -454,6 +825,116 @@ void MainWindow::setupMenu()
     connect(quitAct, &QAction::triggered, this, &MainWindow::close);
     fileMenu->addAction(quitAct);
 
+    // Edit menu: selection, undo memory settings
+    QMenu *editMenu = menuBar()->addMenu("&Edit");
+    QAction *fillSelAct = new QAction("Fill Selection", this);
+    connect(fillSelAct, &QAction::triggered, this, &MainWindow::fillSelection);
+    editMenu->addAction(fillSelAct);
+    QAction *anchorAct = new QAction("Anchor Paste", this);
+    connect(anchorAct, &QAction::triggered, this, &MainWindow::anchorPaste);
+    editMenu->addAction(anchorAct);
+    editMenu->addSeparator();
+
+    QAction *budgetAct = new QAction("Undo Memory Budget...", this);
+    connect(budgetAct, &QAction::triggered, [this]() {
+        bool ok;
+        int mb = QInputDialog::getInt(this, "Undo Memory Budget", "Budget shared by all layers (MB):",
+                                      int(undoBudgetBytes >> 20), 16, 65536, 16, &ok);
+        if (!ok) return;
+        undoBudgetBytes = qint64(mb) << 20;
+        enforceUndoBudget();
+        statusLabel->setText(QString("Undo budget: %1 MB").arg(mb));
+    });
+    editMenu->addAction(budgetAct);
+
+    QAction *layerBudgetAct = new QAction("Layer Memory Budget...", this);
+    connect(layerBudgetAct, &QAction::triggered, [this]() {
+        bool ok;
+        int mb = QInputDialog::getInt(this, "Layer Memory Budget", "Uncompressed pixels of all layers (MB):",
+                                      int(layerBudgetBytes >> 20), 64, 1048576, 64, &ok);
+        if (!ok) return;
+        layerBudgetBytes = qint64(mb) << 20;
+        trimLayerMemory();
+        statusLabel->setText(QString("Layer memory budget: %1 MB").arg(mb));
+    });
+    editMenu->addAction(layerBudgetAct);
+
+    QAction *autosaveAct = new QAction("Autosave Interval...", this);
+    connect(autosaveAct, &QAction::triggered, [this]() {
+        bool ok;
+        int sec = QInputDialog::getInt(this, "Autosave", "Seconds between checkpoints (0 = off):",
+                                       autosaveSeconds, 0, 3600, 10, &ok);
+        if (!ok) return;
+        autosaveSeconds = sec;
+        if (sec > 0 && autosaveLock) autosaveTimer.start(sec * 1000);
+        else autosaveTimer.stop();
+        statusLabel->setText(sec > 0 ? QString("Autosave every %1 s").arg(sec) : QString("Autosave off"));
+    });
+    editMenu->addAction(autosaveAct);
+
+    QAction *compressAct = new QAction("Compress Undo History", this);
+    compressAct->setCheckable(true);
+    compressAct->setChecked(compressUndo);
+    connect(compressAct, &QAction::toggled, [this](bool on) { compressUndo = on; });
+    editMenu->addAction(compressAct);
+
+    QMenu *viewMenu = menuBar()->addMenu("&View");
+    QAction *gpuAct = new QAction("GPU Canvas (OpenGL)", this);
+    gpuAct->setCheckable(true);
+    connect(gpuAct, &QAction::triggered, [this, gpuAct](bool on) {
+        const bool allNormal = std::all_of(layers.begin(), layers.end(),
+                                           [](const Layer &l) { return l.blendMode == BlendMode::Normal; });
+        if (on && (!allNormal || hasAdjustmentLayers())) {
+            gpuAct->setChecked(false);
+            QMessageBox::information(this, "GPU Canvas", "The GPU canvas only blends Normal pixel layers.");
+            return;
+        }
+        if (!canvas->setGpuBackend(on)) {
+            gpuAct->setChecked(false);
+            QMessageBox::information(this, "GPU Canvas", "This build has no OpenGL support.");
+        }
+    });
+    connect(canvas, &Canvas::gpuBackendChanged, this, [this, gpuAct](bool on) {
+        gpuAct->setChecked(on);
+        // the CPU path (asked for, or OpenGL failed) starts from a stale composite,
+        // the GPU one needs the layer stack
+        staleComposite = QRegion();
+        compositeLayers();
+        statusLabel->setText(on ? "GPU canvas enabled" : "CPU canvas");
+    });
+    viewMenu->addAction(gpuAct);
+    viewMenu->addSeparator();
+
+    // instrumentation is off by default (or EPIGRIMP_PROFILE=1), the HUD turns it on
+    QAction *hudAct = new QAction("Performance HUD", this);
+    hudAct->setCheckable(true);
+    hudAct->setChecked(Profiler::isEnabled());
+    canvas->setHudVisible(Profiler::isEnabled());
+    connect(hudAct, &QAction::toggled, [this](bool on) {
+        Profiler::setEnabled(on);
+        canvas->setHudVisible(on);
+    });
+    viewMenu->addAction(hudAct);
+
+    QAction *traceAct = new QAction("Export Performance Trace...", this);
+    connect(traceAct, &QAction::triggered, [this]() {
+        if (!Profiler::isEnabled()) {
+            QMessageBox::information(this, "Performance Trace",
+                                     "Enable the Performance HUD first, then reproduce the slow action.");
+            return;
+        }
+        const QString fileName = QFileDialog::getSaveFileName(this, "Export Trace", "epigrimp-trace.json",
+                                                              "Chrome trace (*.json)");
+        if (fileName.isEmpty()) return;
+        const QString error = Profiler::saveTrace(fileName);
+        if (!error.isEmpty()) {
+            QMessageBox::warning(this, "Performance Trace", error);
+            return;
+        }
+        statusLabel->setText("Trace saved (open it in chrome://tracing or Perfetto): " + fileName);
+    });
+    viewMenu->addAction(traceAct);
+
     // Filters menu (Day 8)
     QMenu *filterMenu = menuBar()->addMenu("&Filters");
     QAction *gray = new QAction("Grayscale", this);
@@ -462,6 +943,36 @@ void MainWindow::setupMenu()
     QAction *invert = new QAction("Invert", this);
     connect(invert, &QAction::triggered, this, &MainWindow::invertColors);
     filterMenu->addAction(invert);
+    QAction *brightness = new QAction("Brightness / Contrast...", this);
+    connect(brightness, &QAction::triggered, this, &MainWindow::brightnessContrast);
+    filterMenu->addAction(brightness);
+    QAction *levelsAct = new QAction("Levels...", this);
+    connect(levelsAct, &QAction::triggered, this, &MainWindow::levels);
+    filterMenu->addAction(levelsAct);
+    QAction *mixerAct = new QAction("Channel Mixer...", this);
+    connect(mixerAct, &QAction::triggered, this, &MainWindow::channelMixer);
+    filterMenu->addAction(mixerAct);
+    filterMenu->addSeparator();
+    QAction *gaussAct = new QAction("Gaussian Blur...", this);
+    connect(gaussAct, &QAction::triggered, this, &MainWindow::gaussianBlur);
+    filterMenu->addAction(gaussAct);
+    QAction *boxAct = new QAction("Box Blur...", this);
+    connect(boxAct, &QAction::triggered, this, &MainWindow::boxBlur);
+    filterMenu->addAction(boxAct);
+    QAction *sharpenAct = new QAction("Unsharp Mask...", this);
+    connect(sharpenAct, &QAction::triggered, this, &MainWindow::unsharpMask);
+    filterMenu->addAction(sharpenAct);
+    QAction *edgeAct = new QAction("Edge Detect (Sobel)", this);
+    connect(edgeAct, &QAction::triggered, this, &MainWindow::edgeDetect);
+    filterMenu->addAction(edgeAct);
+    filterMenu->addSeparator();
+    // non destructive: kept in the layer stack, applied when compositing
+    QMenu *adjustMenu = filterMenu->addMenu("New Adjustment Layer");
+    const QStringList adjustNames = Adjustments::kindNames();
+    for (int k = 0; k < adjustNames.size(); ++k) {
+        QAction *act = adjustMenu->addAction(adjustNames[k]);
+        connect(act, &QAction::triggered, this, [this, k] { addAdjustmentLayer(AdjustmentKind(k + 1)); });
+    }
 
     QShortcut *copyShortcut = new QShortcut(QKeySequence("Ctrl+C"), this);
     connect(copyShortcut, &QShortcut::activated, this, &MainWindow::copySelection);
@@ -472,6 +983,16 @@ void MainWindow::setupMenu()
     QShortcut *pasteShortcut = new QShortcut(QKeySequence("Ctrl+V"), this);
     connect(pasteShortcut, &QShortcut::activated, this, &MainWindow::pasteSelection);
 
+    QShortcut *anchorShortcut = new QShortcut(QKeySequence(Qt::Key_Return), this);
+    connect(anchorShortcut, &QShortcut::activated, this, &MainWindow::anchorPaste);
+
+    QShortcut *discardShortcut = new QShortcut(QKeySequence(Qt::Key_Escape), this);
+    connect(discardShortcut, &QShortcut::activated, [this]() {
+        if (!canvas->hasFloatingPaste()) return;
+        canvas->discardFloatingPaste();
+        statusLabel->setText("Paste discarded");
+    });
+
 }
 
 QWidget* createColorBtn(const QColor &color, QObject *receiver, const char *slot)
@@ -627,6 +1148,17 @@ void MainWindow::setupToolbarAndPalette()
     tb->addWidget(sizeSlider);
     connect(sizeSlider, &QSlider::valueChanged, this, &MainWindow::changeBrushSize);
 
+    tb->addWidget(new QLabel("Hardness:", this));
+    QSlider *hardSlider = new QSlider(Qt::Horizontal, this);
+    hardSlider->setRange(0, 100);
+    hardSlider->setValue(100);
+    hardSlider->setFixedWidth(80);
+    tb->addWidget(hardSlider);
+    connect(hardSlider, &QSlider::valueChanged, [this](int v) {
+        canvas->setBrushHardness(v / 100.0);
+        statusLabel->setText(QString("Brush hardness: %1%").arg(v));
+    });
+
     tb->addSeparator();
 
     // --- Palette ---
@@ -664,24 +1196,278 @@ void MainWindow::setupToolbarAndPalette()
 void MainWindow::openFile()
 {
     QString fileName = QFileDialog::getOpenFileName(this, "Open Image", QString(),
-                                                    "Images (*.png *.jpg *.bmp);;All Files (*)");
+                                                    "Images (*.png *.jpg *.bmp *.grimp);;All Files (*)");
     if (fileName.isEmpty()) return;
-
-    QImage loaded;
-    if (!loaded.load(fileName)) {
-        QMessageBox::warning(this, "Open failed", "Could not open image.");
+    if (QFileInfo(fileName).suffix().toLower() == "grimp") {
+        loadProjectFile(fileName);
         return;
     }
+    startImport({fileName}, false);
+}
+
+void MainWindow::openProject()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, "Open Project", QString(),
+                                                          "EpiGrimp Project (*.grimp)");
+    if (!fileName.isEmpty()) loadProjectFile(fileName);
+}
+
+bool MainWindow::loadProjectFile(const QString &fileName)
+{
+    if (projectSaveWatcher.isRunning()) {
+        statusLabel->setText("A project save is still running");
+        return false;
+    }
+    ProjectData data;
+    ProjectFileState state;
+    const QString error = loadProject(fileName, &data, &state);
+    if (!error.isEmpty()) {
+        QMessageBox::warning(this, "Open failed", "Could not open project " + QFileInfo(fileName).fileName() + ":\n" + error);
+        return false;
+    }
+
+    canvas->commitTextItems();
+    canvas->discardFloatingPaste(); // belongs to the document being closed
+    cancelFilterJob();
+    layers.clear();
+    for (const ProjectLayer &pl : data.layers) {
+        Layer l;
+        l.name = pl.name;
+        l.image = pl.image; // tiles stay in the file until shown or painted
+        l.opacity = pl.opacity;
+        l.blendMode = pl.blendMode;
+        l.transform = pl.transform;
+        l.adjustment = pl.adjustment;
+        layers.append(l);
+    }
+    project = state;
+
+    // fill layer list UI (show top at top)
+    activeLayerIndex = data.activeLayer;
+    layerListWidget->blockSignals(true);
+    layerListWidget->clear();
+    for (int i = layers.size() - 1; i >= 0; --i)
+        layerListWidget->addItem(layers[i].name);
+    layerListWidget->setCurrentRow(layers.size() - 1 - activeLayerIndex);
+    layerListWidget->blockSignals(false);
 
-    // place loaded image onto active layer (preserve transparency if possible)
-    layers[activeLayerIndex].image = loaded.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-    // clear undo/redo
-    layers[activeLayerIndex].undoStack.clear();
-    layers[activeLayerIndex].redoStack.clear();
+    const bool allNormal = std::all_of(layers.begin(), layers.end(),
+                                       [](const Layer &l) { return l.blendMode == BlendMode::Normal; });
+    if (canvas->gpuBackend() && (!allNormal || hasAdjustmentLayers()))
+        canvas->setGpuBackend(false); // GPU view: Normal pixel layers only
 
+    targetActiveLayer();
+    canvas->setTextItems(data.texts);
+    invalidateCompositeCache();
     compositeLayers();
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
-    statusLabel->setText(QFileInfo(fileName).fileName() + " loaded into " + layers[activeLayerIndex].name);
+    setWindowTitle("EpiGrimp - " + QFileInfo(fileName).fileName());
+    statusLabel->setText(QString("%1 opened (%2 layers)").arg(QFileInfo(fileName).fileName()).arg(layers.size()));
+    return true;
+}
+
+void MainWindow::saveProject()
+{
+    if (project.fileName.isEmpty()) {
+        saveProjectAs();
+        return;
+    }
+    startProjectSave(project.fileName);
+}
+
+void MainWindow::saveProjectAs()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Project As", project.fileName,
+                                                    "EpiGrimp Project (*.grimp)");
+    if (fileName.isEmpty()) return;
+    if (QFileInfo(fileName).suffix().isEmpty()) fileName += ".grimp";
+    startProjectSave(fileName);
+}
+
+ProjectData MainWindow::projectSnapshot() const
+{
+    ProjectData data;
+    data.size = composite.size();
+    data.activeLayer = activeLayerIndex;
+    data.texts = canvas->getTextItems();
+    for (const Layer &l : layers)
+        data.layers.append({l.name, l.image, l.opacity, l.blendMode, l.transform, l.adjustment});
+    return data;
+}
+
+void MainWindow::startProjectSave(const QString &fileName)
+{
+    if (projectSaveWatcher.isRunning()) {
+        statusLabel->setText("A project save is already running");
+        return;
+    }
+
+    // shared snapshot, painting goes on while the tiles are written
+    for (int i = 0; i < layers.size(); ++i) repackLayer(i); // saved in their own format
+    const ProjectData data = projectSnapshot();
+    const ProjectFileState previous = project;
+    const bool compress = compressProject;
+
+    disconnect(&projectSaveWatcher, nullptr, this, nullptr);
+    connect(&projectSaveWatcher, &QFutureWatcher<ProjectSaveResult>::finished, this, [this, fileName] {
+        const ProjectSaveResult r = projectSaveWatcher.result();
+        if (!r.error.isEmpty()) {
+            QMessageBox::warning(this, "Save failed", "Unable to save " + QFileInfo(fileName).fileName() + ":\n" + r.error);
+            return;
+        }
+        project = r.state;
+        setWindowTitle("EpiGrimp - " + QFileInfo(fileName).fileName());
+        statusLabel->setText(QString("%1 saved (%2 tiles written, %3 reused%4)")
+                                 .arg(QFileInfo(fileName).fileName()).arg(r.tilesWritten).arg(r.tilesReused)
+                                 .arg(r.rewritten ? ", file rewritten" : ""));
+    });
+    projectSaveWatcher.setFuture(QtConcurrent::run([data, fileName, previous, compress] {
+        return ::saveProject(data, fileName, previous, compress);
+    }));
+    statusLabel->setText("Saving " + QFileInfo(fileName).fileName() + "...");
+}
+
+void MainWindow::setupAutosave()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dir);
+    autosaveLock = std::make_unique<QLockFile>(dir + "/autosave.lock");
+    if (!autosaveLock->tryLock()) {
+        autosaveLock.reset(); // another window journals already; the lock of a crashed one is stale and taken over
+        return;
+    }
+    autosaveFileName = dir + "/autosave.grimp";
+
+    // one thread, lowest priority: checkpoints never compete with painting or the real saves
+    autosavePool.setMaxThreadCount(1);
+    autosavePool.setThreadPriority(QThread::LowestPriority);
+    connect(&autosaveWatcher, &QFutureWatcher<ProjectSaveResult>::finished, this, [this] {
+        const ProjectSaveResult r = autosaveWatcher.result();
+        if (!r.error.isEmpty()) {
+            autosavePending = true; // retried at the next tick
+            statusLabel->setText("Autosave failed: " + r.error);
+            return;
+        }
+        autosaveState = r.state;
+    });
+    connect(&autosaveTimer, &QTimer::timeout, this, &MainWindow::autosave);
+    if (autosaveSeconds > 0) autosaveTimer.start(autosaveSeconds * 1000);
+
+    // left behind: the previous session did not end normally
+    if (QFileInfo::exists(autosaveFileName))
+        QTimer::singleShot(0, this, &MainWindow::recoverSession);
+}
+
+void MainWindow::autosave()
+{
+    if (!autosavePending || autosaveWatcher.isRunning() || !autosaveLock) return;
+    autosavePending = false;
+    // raw tiles: a checkpoint costs a memcpy per changed tile, no compression
+    for (int i = 0; i < layers.size(); ++i) repackLayer(i); // saved in their own format
+    const ProjectData data = projectSnapshot();
+    const ProjectFileState previous = autosaveState;
+    const QString fileName = autosaveFileName;
+    autosaveWatcher.setFuture(QtConcurrent::run(&autosavePool, [data, fileName, previous] {
+        return ::saveProject(data, fileName, previous, false);
+    }));
+}
+
+void MainWindow::recoverSession()
+{
+    const auto answer = QMessageBox::question(this, "Recover Session",
+                                              "EpiGrimp did not close normally.\nRestore the last autosaved session?");
+    if (answer != QMessageBox::Yes || !loadProjectFile(autosaveFileName)) {
+        QFile::remove(autosaveFileName);
+        return;
+    }
+    // tiles page in from the journal, which the next checkpoints keep appending to
+    autosaveState = project;
+    project = ProjectFileState(); // untitled: Save Project asks for a file name
+    setWindowTitle("EpiGrimp - Recovered session");
+    statusLabel->setText("Session recovered - save it as a project to keep it");
+}
+
+void MainWindow::startImport(const QStringList &files, bool asNewLayers)
+{
+    if (importWatcher.isRunning()) {
+        statusLabel->setText("An import is already running");
+        return;
+    }
+    importAsLayers = asNewLayers;
+    statusLabel->setText(files.size() == 1 ? "Loading " + QFileInfo(files.first()).fileName() + "..."
+                                           : QString("Loading %1 images...").arg(files.size()));
+    cancelImportBtn->show();
+    // one file per task, several files decode in parallel
+    importWatcher.setFuture(QtConcurrent::mapped(files, importImage));
+}
+
+void MainWindow::onImportFinished()
+{
+    cancelImportBtn->hide();
+    if (importWatcher.isCanceled()) {
+        statusLabel->setText("Import canceled");
+        return;
+    }
+
+    const QList<ImportedImage> results = importWatcher.future().results();
+    QStringList failed;
+    int loaded = 0;
+    // an adjustment layer has no pixels to replace: the file comes in as a new layer
+    const bool asLayers = importAsLayers
+                          || (activeLayerIndex >= 0 && activeLayerIndex < layers.size() && layers[activeLayerIndex].isAdjustment());
+    for (const ImportedImage &r : results) {
+        if (!r.error.isEmpty()) {
+            failed << QFileInfo(r.fileName).fileName() + ": " + r.error;
+            continue;
+        }
+        ++loaded;
+        if (asLayers) {
+            addLayerFromImport(r);
+            continue;
+        }
+
+        // place loaded image onto active layer (preserve transparency if possible)
+        if (filterLayer == activeLayerIndex) cancelFilterJob();
+        layers[activeLayerIndex].image = r.image;
+        layers[activeLayerIndex].transform = QTransform(); // the file is shown as it is, not as the old pixels were turned
+        autosavePending = true;
+        // clear undo/redo
+        layers[activeLayerIndex].history.clear();
+        growDocument(r.image.size());
+
+        compositeLayers();
+        targetActiveLayer();
+        statusLabel->setText(QFileInfo(r.fileName).fileName() + " loaded into " + layers[activeLayerIndex].name);
+    }
+
+    if (asLayers && loaded > 0) {
+        autosavePending = true;
+        invalidateCompositeCache();
+        compositeLayers();
+        statusLabel->setText(loaded == 1 ? "Loaded into new layer: " + layers[activeLayerIndex].name
+                                         : QString("%1 images loaded as layers").arg(loaded));
+    }
+    if (!failed.isEmpty()) {
+        QMessageBox::warning(this, "Open failed", "Could not open image:\n" + failed.join("\n"));
+    }
+}
+
+void MainWindow::dragEnterEvent(QDragEnterEvent *event)
+{
+    if (event->mimeData()->hasUrls()) event->acceptProposedAction();
+}
+
+void MainWindow::dropEvent(QDropEvent *event)
+{
+    QStringList files;
+    for (const QUrl &url : event->mimeData()->urls())
+        if (url.isLocalFile()) files << url.toLocalFile();
+    if (files.isEmpty()) return;
+    event->acceptProposedAction();
+    if (files.size() == 1 && QFileInfo(files.first()).suffix().toLower() == "grimp") {
+        loadProjectFile(files.first());
+        return;
+    }
+    startImport(files, true);
 }
 
 void MainWindow::saveFile()
@@ -690,18 +1476,75 @@ void MainWindow::saveFile()
                                                     "PNG Image (*.png);;JPEG Image (*.jpg);;BMP Image (*.bmp)");
     if (fileName.isEmpty()) return;
 
-    QImage composite = canvas->getDisplayedImage();
-    if (!composite.save(fileName)) {
-        QMessageBox::warning(this, "Save failed", "Unable to save file.");
-        return;
-    }
-    statusLabel->setText(QFileInfo(fileName).fileName() + " saved");
+    // shared snapshot: painting goes on, the composite tiles detach on their next change
+    const TiledImage snapshot = flattenedComposite();
+    const ExportSettings settings = exportSettings;
+
+    auto *job = new QFutureWatcher<QString>(this);
+    saveJobs.append(job);
+    connect(job, &QFutureWatcher<QString>::finished, this, [this, job, fileName] {
+        saveJobs.removeOne(job);
+        job->deleteLater();
+        const QString error = job->result();
+        if (!error.isEmpty()) {
+            QMessageBox::warning(this, "Save failed", "Unable to save " + QFileInfo(fileName).fileName() + ":\n" + error);
+            return;
+        }
+        statusLabel->setText(saveJobs.isEmpty() ? QFileInfo(fileName).fileName() + " saved"
+                                                : QString("%1 saved, %2 still saving...")
+                                                      .arg(QFileInfo(fileName).fileName()).arg(saveJobs.size()));
+    });
+    job->setFuture(QtConcurrent::run([snapshot, fileName, settings] {
+        return exportImage(snapshot, fileName, settings);
+    }));
+    statusLabel->setText(saveJobs.size() == 1 ? "Saving " + QFileInfo(fileName).fileName() + "..."
+                                              : QString("Saving %1 files...").arg(saveJobs.size()));
+}
+
+void MainWindow::editExportSettings()
+{
+    QDialog dlg(this);
+    dlg.setWindowTitle("Export Settings");
+    QFormLayout *form = new QFormLayout(&dlg);
+
+    QSpinBox *pngSpin = new QSpinBox(&dlg);
+    pngSpin->setRange(0, 9);
+    pngSpin->setValue(exportSettings.pngCompression);
+    pngSpin->setToolTip("0 = fastest, 9 = smallest file");
+    form->addRow("PNG compression:", pngSpin);
+
+    QSpinBox *jpegSpin = new QSpinBox(&dlg);
+    jpegSpin->setRange(0, 100);
+    jpegSpin->setValue(exportSettings.jpegQuality);
+    form->addRow("JPEG quality:", jpegSpin);
+
+    QCheckBox *optimizeBox = new QCheckBox("Optimize JPEG (smaller, slower)", &dlg);
+    optimizeBox->setChecked(exportSettings.jpegOptimize);
+    form->addRow(optimizeBox);
+
+    QCheckBox *projectBox = new QCheckBox("Compress project tiles (smaller, slower to open)", &dlg);
+    projectBox->setChecked(compressProject);
+    form->addRow(projectBox);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dlg);
+    connect(buttons, &QDialogButtonBox::accepted, &dlg, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dlg, &QDialog::reject);
+    form->addRow(buttons);
+
+    if (dlg.exec() != QDialog::Accepted) return;
+    exportSettings.pngCompression = pngSpin->value();
+    exportSettings.jpegQuality = jpegSpin->value();
+    exportSettings.jpegOptimize = optimizeBox->isChecked();
+    compressProject = projectBox->isChecked();
+    statusLabel->setText(QString("Export: PNG level %1, JPEG quality %2")
+                             .arg(exportSettings.pngCompression).arg(exportSettings.jpegQuality));
 }
 
 void MainWindow::clearCanvas()
 {
     // clear active layer (fill transparent)
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    if (!activeLayerHasPixels("clear")) return;
+    if (filterLayer == activeLayerIndex) cancelFilterJob(); // nothing left to filter
     pushUndoForActiveLayer();
     layers[activeLayerIndex].image.fill(Qt::transparent);
     clearRedoForActiveLayer();
@@ -713,8 +1556,7 @@ void MainWindow::addLayer()
 {
     Layer l;
     l.name = QString("Layer %1").arg(layers.size());
-    l.image = QImage(layers[0].image.size(), QImage::Format_ARGB32_Premultiplied);
-    l.image.fill(Qt::transparent);
+    l.image = TiledImage(documentSize()); // empty layer, no pixel stored
     layers.append(l);
 
     // update UI list: we show top layer at index 0, so insert at top
@@ -723,7 +1565,9 @@ void MainWindow::addLayer()
 
     // set active to newly added layer
     activeLayerIndex = layers.size() - 1;
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    autosavePending = true;
+    invalidateCompositeCache();
     compositeLayers();
     statusLabel->setText("Added " + l.name);
 }
@@ -735,6 +1579,7 @@ void MainWindow::removeLayer()
         return;
     }
     // Remove active layer
+    cancelFilterJob(); // layer indices shift
     int idx = activeLayerIndex;
     layers.removeAt(idx);
     // update UI list: remove corresponding (remember UI order is reversed)
@@ -745,7 +1590,9 @@ void MainWindow::removeLayer()
     // set active to topmost layer
     activeLayerIndex = layers.size() - 1;
     layerListWidget->setCurrentRow(0);
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    autosavePending = true;
+    invalidateCompositeCache();
     compositeLayers();
     statusLabel->setText("Layer removed, active: " + layers[activeLayerIndex].name);
 }
@@ -756,42 +1603,483 @@ void MainWindow::activateLayer(int uiRow)
     int idx = layers.size() - 1 - uiRow;
     if (idx < 0 || idx >= layers.size()) return;
     activeLayerIndex = idx;
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    invalidateCompositeCache();
     statusLabel->setText("Active layer: " + layers[activeLayerIndex].name);
 }
 
-void MainWindow::compositeLayers()
+void MainWindow::targetActiveLayer()
 {
-    if (layers.isEmpty()) return;
-
-    QImage comp = layers[0].image;
-    QPainter p(&comp);
-
-    for (int i = 1; i < layers.size(); ++i) {
-        p.setOpacity(layers[i].opacity);
-        p.drawImage(0, 0, layers[i].image);
-    }
-    p.setOpacity(1.0);
-
-    canvas->setCompositeImage(comp);
+    Layer &L = layers[activeLayerIndex];
+    canvas->setTargetImage(&L.image, L.transform, !L.isAdjustment());
 }
 
-
-void MainWindow::pushUndoForActiveLayer()
+bool MainWindow::activeLayerHasPixels(const QString &what)
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    Layer &L = layers[activeLayerIndex];
-    // push current image snapshot to undo
-    L.undoStack.append(L.image.copy());
-    // keep undo stack to reasonable size
-    const int MAX_UNDO = 20;
-    if (L.undoStack.size() > MAX_UNDO) L.undoStack.remove(0);
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return false;
+    if (!layers[activeLayerIndex].isAdjustment()) return true;
+    statusLabel->setText(layers[activeLayerIndex].name + " is an adjustment layer, it has no pixel to " + what);
+    return false;
+}
+
+QSize MainWindow::documentSize() const
+{
+    const Layer &bg = layers[0];
+    return bg.transform.mapRect(bg.image.rect()).size();
+}
+
+void MainWindow::growDocument(const QSize &size)
+{
+    const QSize doc = documentSize().expandedTo(size);
+    if (doc == documentSize()) return;
+    cancelFilterJob(); // tile grids change
+    for (Layer &l : layers) {
+        if (!l.transform.isIdentity()) continue; // a transformed layer keeps its own size
+        l.image.resize(l.image.size().expandedTo(doc)); // only the tile grids grow
+    }
+    autosavePending = true;
+    invalidateCompositeCache();
+}
+
+void MainWindow::compositeLayers()
+{
+    if (layers.isEmpty()) return;
+    compositeLayers(QRect(QPoint(0, 0), documentSize()));
+}
+
+void MainWindow::compositeLayers(const QRect &dirtyRect)
+{
+    if (layers.isEmpty()) return;
+    EPIGRIMP_PROFILE_SCOPE("compositeLayers");
+
+    const QSize size = documentSize();
+    QRect r = dirtyRect.intersected(QRect(QPoint(0, 0), size));
+    const bool resized = composite.size() != size;
+    if (resized) {
+        // document size changed (open, rotate...): rebuild everything
+        composite = TiledImage(size);
+        r = composite.rect();
+        staleComposite = QRegion();
+        invalidateCompositeCache();
+        canvas->setCompositeImage(&composite); // first: what the canvas shows depends on the size
+    }
+    if (r.isEmpty()) return;
+    Profiler::counter("dirtyPixels", qint64(r.width()) * r.height());
+    staleComposite += r;
+
+    if (canvas->gpuBackend()) {
+        // the GPU blends the layer tiles itself; the CPU composite is only
+        // brought up to date when something needs it (save)
+        canvas->setLayerStack(&layers, activeLayerIndex);
+        canvas->layersChanged(r);
+        return;
+    }
+
+    // only the tiles on screen, the others once they show (see Canvas::viewChanged) or are saved
+    const QRect shown = blendStale(canvas->visibleImageRect());
+    if (!resized && !shown.isEmpty()) canvas->setCompositeImage(&composite, shown);
+}
+
+QRect MainWindow::blendStale(const QRect &r)
+{
+    const QRegion todo = staleComposite.intersected(r);
+    if (todo.isEmpty()) return QRect();
+    for (const QRect &part : todo) blendComposite(part);
+    staleComposite -= todo;
+    Profiler::counter("compositeBytes", composite.memoryBytes() + belowCache.memoryBytes() + aboveCache.memoryBytes());
+    return todo.boundingRect();
+}
+
+void MainWindow::blendComposite(const QRect &r)
+{
+    if (cacheActiveIndex != activeLayerIndex)
+        rebuildCompositeCache();
+    if (cachePlainTop < layers.size()) {
+        blendAdjustedComposite(r);
+        return;
+    }
+    for (int t : composite.tilesIn(r)) blendPlainLayers(t, composite.tileRect(t).intersected(r));
+}
+
+void MainWindow::blendPlainLayers(int t, const QRect &r)
+{
+    // below + active + above: three blends on the damaged area whatever the layer count
+    if (!cachedTiles[t]) cacheTile(t);
+    placeTile(t, r, belowCache.tile(t));
+    if (activeLayerIndex >= cachePlainTop) return; // all in belowCache, the active layer is over an adjustment
+
+    const QPoint at = composite.tileRect(t).topLeft();
+    QImage &dst = composite.tileForWrite(t);
+    blendLayerInto(dst, at, activeLayerIndex, r);
+    if (!aboveCache.isNull()) {
+        BlendKernels::blendLayer(dst, at, aboveCache, QTransform(), r, BlendMode::Normal, 1.0);
+    } else {
+        // no cache when a layer above is not Normal: blend them one by one
+        for (int i = activeLayerIndex + 1; i < cachePlainTop; ++i) blendLayerInto(dst, at, i, r);
+    }
+}
+
+void MainWindow::placeTile(int t, const QRect &r, const QImage &img)
+{
+    const QRect tr = composite.tileRect(t);
+    if (r == tr.intersected(composite.rect())) {
+        composite.setTile(t, img); // shared, detached by the next blend into it
+        return;
+    }
+    QPainter p(&composite.tileForWrite(t));
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    const QRect local = r.translated(-tr.topLeft());
+    if (img.isNull()) p.fillRect(local, Qt::transparent);
+    else p.drawImage(local.topLeft(), img, local);
+}
+
+void MainWindow::blendLayerInto(QImage &dst, const QPoint &origin, int i, const QRect &r)
+{
+    const Layer &l = layers[i];
+    const double opacity = i == 0 ? 1.0 : l.opacity; // bottom layer is always opaque
+    if (l.isAdjustment()) {
+        // what is under it, filtered, then blended back over it
+        const QRect local = r.translated(-origin);
+        QImage adjusted = dst.copy(local);
+        Adjustments::apply(l.adjustment, adjusted);
+        BlendKernels::blendImage(dst, local.topLeft(), adjusted, adjusted.rect(), l.blendMode, opacity);
+        return;
+    }
+
+    const BrushEngine *stroke = i == activeLayerIndex ? canvas->activeStroke() : nullptr;
+    if (!stroke) {
+        BlendKernels::blendLayer(dst, origin, l.image, l.transform, r, l.blendMode, opacity);
+        return;
+    }
+    // stroke in progress, not merged yet; drawn in layer pixels
+    const QRect src = l.transform.inverted().mapRect(r).intersected(l.image.rect());
+    QImage withStroke(src.size(), QImage::Format_ARGB32_Premultiplied);
+    withStroke.fill(Qt::transparent);
+    QPainter p(&withStroke);
+    p.translate(-src.topLeft());
+    stroke->drawLayer(p, l.image, src);
+    p.end();
+    if (l.transform.isIdentity())
+        BlendKernels::blendImage(dst, r.topLeft() - origin, withStroke, withStroke.rect(), l.blendMode, opacity);
+    else if (!src.isEmpty())
+        BlendKernels::blendTransformed(dst, origin, withStroke, src.topLeft(), l.transform, r, l.blendMode, opacity);
+}
+
+bool MainWindow::hasAdjustmentLayers() const
+{
+    return std::any_of(layers.begin(), layers.end(), [](const Layer &l) { return l.isAdjustment(); });
+}
+
+namespace {
+inline quint64 mix(quint64 h, quint64 v) { return (h ^ v) * 0x100000001b3ULL; } // FNV-1a, one word at a time
+inline quint64 fixed(double v) { return quint64(qRound64(v * 65536.0)); }
+} // namespace
+
+void MainWindow::blendAdjustedComposite(const QRect &r)
+{
+    EPIGRIMP_PROFILE_SCOPE("blendAdjusted");
+    // adjustments read whole tiles, so the work is done per document tile:
+    // start from the topmost adjustment whose cached tile still matches what
+    // is under it, blend only the layers above; a miss starts from the plain
+    // layers under the lowest adjustment (through the below / above caches)
+    // and refills every adjustment cache on the way up
+    const int n = int(layers.size());
+    // a stroke being painted is not in its layer yet: what sits above it is not cached meanwhile
+    const int volatileFrom = canvas->activeStroke() ? activeLayerIndex + 1 : n;
+    QVector<quint64> keys(n);
+
+    for (int t : composite.tilesIn(r)) {
+        const QPoint at = composite.tileRect(t).topLeft();
+        const QRect R = composite.tileRect(t).intersected(composite.rect());
+
+        // version of the stack up to each layer in this tile
+        quint64 h = mix(mix(0xcbf29ce484222325ULL, quint64(quint32(R.x())) << 32 | quint32(R.y())),
+                        quint64(quint32(R.width())) << 32 | quint32(R.height()));
+        for (int i = 0; i < n; ++i) {
+            const Layer &l = layers[i];
+            h = mix(mix(h, fixed(i == 0 ? 1.0 : l.opacity)), quint64(l.blendMode));
+            if (l.isAdjustment()) {
+                h = mix(h, Adjustments::version(l.adjustment));
+            } else {
+                const QTransform &m = l.transform;
+                for (double v : {m.m11(), m.m12(), m.m21(), m.m22(), m.dx(), m.dy()}) h = mix(h, fixed(v));
+                for (int k : l.image.tilesIn(m.inverted().mapRect(R).adjusted(-1, -1, 1, 1))) h = mix(mix(h, quint64(k)), l.image.tileVersion(k));
+            }
+            keys[i] = h;
+        }
+
+        int start = 0;
+        for (int i = std::min(n, volatileFrom) - 1; i >= cachePlainTop && start == 0; --i) {
+            if (!layers[i].isAdjustment() || !layers[i].adjustmentCache) continue;
+            if (const QImage *hit = layers[i].adjustmentCache->find(t, keys[i])) {
+                placeTile(t, R, *hit);
+                start = i + 1;
+            }
+        }
+        if (start == 0) {
+            blendPlainLayers(t, R);
+            start = cachePlainTop;
+        }
+
+        for (int i = start; i < n; ++i) {
+            blendLayerInto(composite.tileForWrite(t), at, i, R);
+            Layer &l = layers[i];
+            if (!l.isAdjustment() || i >= volatileFrom) continue;
+            if (!l.adjustmentCache) l.adjustmentCache = QSharedPointer<AdjustmentCache>::create();
+            l.adjustmentCache->insert(t, keys[i], composite.tile(t)); // shared with the composite tile
+        }
+    }
+    Profiler::counter("adjustmentBytes", adjustmentCacheBytes());
+}
+
+qint64 MainWindow::adjustmentCacheBytes() const
+{
+    qint64 bytes = 0;
+    for (const Layer &l : layers)
+        if (l.adjustmentCache) bytes += l.adjustmentCache->byteSize();
+    return bytes;
+}
+
+TiledImage MainWindow::flattenedBelow(int i)
+{
+    TiledImage flat(documentSize());
+    for (int t = 0; t < flat.tileCount(); ++t) {
+        const QRect tr = flat.tileRect(t);
+        QImage &tile = flat.tileForWrite(t);
+        for (int k = 0; k < i; ++k) blendLayerInto(tile, tr.topLeft(), k, tr.intersected(flat.rect()));
+    }
+    flat.squeeze(flat.rect());
+    return flat;
+}
+
+TiledImage MainWindow::flattenedComposite()
+{
+    blendStale(composite.rect());
+    return composite;
+}
+
+
+void MainWindow::invalidateCompositeCache()
+{
+    cacheActiveIndex = -1;
+}
+
+void MainWindow::rebuildCompositeCache()
+{
+    // the layers below the active one are flattened once per tile and reused
+    // for every stroke on it; the layers above too when they are all Normal,
+    // since source-over is associative (other modes depend on what is under
+    // them). A tile is flattened the first time it is blended, see cacheTile().
+    // Only the pixel layers under the lowest adjustment are cached this way, the
+    // adjustments and what is over them go through their own caches
+    cacheActiveIndex = activeLayerIndex;
+    cachePlainTop = int(std::find_if(layers.begin(), layers.end(), [](const Layer &l) { return l.isAdjustment(); })
+                        - layers.begin());
+    belowCache = TiledImage(composite.size());
+    const bool aboveNormal = std::all_of(layers.begin() + std::min(activeLayerIndex + 1, cachePlainTop),
+                                         layers.begin() + cachePlainTop,
+                                         [](const Layer &l) { return l.blendMode == BlendMode::Normal; });
+    aboveCache = activeLayerIndex + 1 < cachePlainTop && aboveNormal ? TiledImage(composite.size()) : TiledImage();
+    cachedTiles = QVector<char>(composite.tileCount(), 0);
+}
+
+void MainWindow::cacheTile(int t)
+{
+    const QPoint at = composite.tileRect(t).topLeft();
+    const QRect R = composite.tileRect(t).intersected(composite.rect());
+    const auto flatten = [&](TiledImage &cache, int from, int to, bool normal) {
+        if (from >= to) return;
+        QImage &tile = cache.tileForWrite(t);
+        tile.fill(Qt::transparent);
+        for (int i = from; i < to; ++i)
+            BlendKernels::blendLayer(tile, at, layers[i].image, layers[i].transform, R,
+                                     normal ? BlendMode::Normal : layers[i].blendMode, i == 0 ? 1.0 : layers[i].opacity);
+        if (TiledImage::isTransparent(tile)) cache.setTile(t, QImage()); // nothing there, nothing kept
+    };
+    flatten(belowCache, 0, std::min(activeLayerIndex, cachePlainTop), false);
+    if (!aboveCache.isNull()) flatten(aboveCache, activeLayerIndex + 1, cachePlainTop, true);
+    cachedTiles[t] = 1;
+}
+
+void MainWindow::updateCompositeCache(int layer, const QRect &r)
+{
+    if (cacheActiveIndex != activeLayerIndex || layer == activeLayerIndex || layer >= cachePlainTop)
+        return; // rebuilt when used / not cached (the adjustment caches check their keys)
+    for (int t : composite.tilesIn(r)) cachedTiles[t] = 0; // flattened again when next blended
+}
+
+void MainWindow::trimComposite()
+{
+    // composite tiles out of sight blended again when they next show: the
+    // composite stays in proportion to the view, not to the document
+    const qint64 bytes = composite.memoryBytes() + belowCache.memoryBytes() + aboveCache.memoryBytes();
+    if (bytes <= layerBudgetBytes / 4) return;
+    const QRect shown = canvas->visibleImageRect();
+    for (int t = 0; t < composite.tileCount(); ++t) {
+        const QRect tr = composite.tileRect(t).intersected(composite.rect());
+        if (tr.intersects(shown)) continue;
+        composite.setTile(t, QImage());
+        if (!belowCache.isNull()) belowCache.setTile(t, QImage());
+        if (!aboveCache.isNull()) aboveCache.setTile(t, QImage());
+        if (t < cachedTiles.size()) cachedTiles[t] = 0;
+        staleComposite += tr;
+    }
+    Profiler::counter("compositeBytes", composite.memoryBytes() + belowCache.memoryBytes() + aboveCache.memoryBytes());
+}
+
+void MainWindow::pushUndoForActiveLayer(bool writesPixels)
+{
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    EPIGRIMP_PROFILE_SCOPE("undoSnapshot");
+    if (filterLayer == activeLayerIndex) interruptFilterJob(); // the edit lands between its tiles
+    repackLayer(activeLayerIndex); // the previous edit is over
+    Layer &L = layers[activeLayerIndex];
+    // the previous edit becomes a tile delta, the new one only keeps a shared snapshot
+    L.history.begin(L.image, L.transform, compressUndo);
+    // edits work on ARGB32: a packed layer is widened for the edit, repacked after it
+    if (writesPixels && L.image.format() != QImage::Format_ARGB32_Premultiplied) {
+        L.packedBase = L.image;
+        L.image = L.image.convertedTo(QImage::Format_ARGB32_Premultiplied);
+        L.widenedBase = L.image;
+    }
+    enforceUndoBudget();
+    autosavePending = true;
+}
+
+void MainWindow::repackLayer(int i)
+{
+    Layer &L = layers[i];
+    if (L.packedBase.isNull()) return;
+    // a stroke or a filter job may still write ARGB32 tiles into it
+    if (i == filterLayer || (i == activeLayerIndex && canvas->activeStroke())) return;
+    const TiledImage packed = L.packedBase, widened = L.widenedBase;
+    L.packedBase = TiledImage();
+    L.widenedBase = TiledImage();
+    if (L.image.format() != QImage::Format_ARGB32_Premultiplied) return; // stored in some other format since
+
+    EPIGRIMP_PROFILE_SCOPE("repackLayer");
+    // only the tiles the edit wrote are converted, the others are the packed ones again
+    const bool sameGrid = L.image.size() == widened.size();
+    TiledImage edited(L.image.size());
+    QVector<int> changed;
+    for (int k = 0; k < L.image.tileCount(); ++k) {
+        if (sameGrid && L.image.sameTile(widened, k)) continue;
+        edited.setTile(k, L.image.tile(k));
+        changed.append(k);
+    }
+    if (packed.format() == QImage::Format_Grayscale8 && !ImageOps::isOpaque(edited)) {
+        statusLabel->setText(L.name + " kept as RGBA 8 bit: the edit left transparent pixels");
+        return;
+    }
+    TiledImage out = sameGrid ? packed : TiledImage(L.image.size(), packed.format());
+    const TiledImage repacked = edited.convertedTo(packed.format());
+    for (int k : changed) out.setTile(k, repacked.tile(k));
+    L.image = out;
 }
 
 void MainWindow::clearRedoForActiveLayer()
 {
     if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    layers[activeLayerIndex].redoStack.clear();
+    layers[activeLayerIndex].history.clearRedo();
+}
+
+void MainWindow::enforceUndoBudget()
+{
+    qint64 total = 0;
+    for (const Layer &l : layers) total += l.history.byteSize();
+
+    while (total > undoBudgetBytes) {
+        // globally oldest step first, whatever layer it belongs to
+        int oldest = -1;
+        quint64 oldestSerial = 0;
+        for (int i = 0; i < layers.size(); ++i) {
+            quint64 serial;
+            if (layers[i].history.oldestSerial(&serial) && (oldest < 0 || serial < oldestSerial)) {
+                oldest = i;
+                oldestSerial = serial;
+            }
+        }
+        if (oldest < 0) break;
+        total -= layers[oldest].history.dropOldest();
+    }
+    Profiler::counter("undoBytes", total);
+}
+
+void MainWindow::trimLayerMemory()
+{
+    if (activeLayerIndex >= 0 && activeLayerIndex < layers.size()) layers[activeLayerIndex].lastUsed = ++useClock;
+    for (int i = 0; i < layers.size(); ++i) repackLayer(i); // edits over since the last tick
+
+    // pixels held by a layer: its own tiles and those its store view inflated
+    const auto residentBytes = [](const Layer &l) {
+        const auto *view = dynamic_cast<const StoreTileSource *>(l.image.tileSource());
+        return l.image.memoryBytes() + (view ? view->residentBytes() : 0);
+    };
+    // project tiles decoded so far, once per source however many layers read it
+    const auto decodedBytes = [this]() {
+        QSet<const TileSource *> seen;
+        qint64 bytes = 0;
+        for (const Layer &l : layers) {
+            const TileSource *s = l.image.tileSource();
+            if (const auto *view = dynamic_cast<const StoreTileSource *>(s)) s = view->base.data();
+            if (s && !seen.contains(s)) {
+                seen.insert(s);
+                bytes += s->residentBytes();
+            }
+        }
+        return bytes;
+    };
+    qint64 total = decodedBytes();
+    for (const Layer &l : layers) total += residentBytes(l);
+
+    while (total > layerBudgetBytes) {
+        // least recently active first, the active layer stays as it is
+        int oldest = -1;
+        for (int i = 0; i < layers.size(); ++i) {
+            if (i == activeLayerIndex || i == filterLayer || residentBytes(layers[i]) == 0) continue;
+            if (oldest < 0 || layers[i].lastUsed < layers[oldest].lastUsed) oldest = i;
+        }
+        if (oldest < 0) break;
+        EPIGRIMP_PROFILE_SCOPE("trimLayer");
+        Layer &L = layers[oldest];
+        total -= residentBytes(L);
+        // a pending snapshot would see every tile as changed once stored
+        L.history.commit(L.image, L.transform, compressUndo);
+        L.history.compressAll(); // the steps share tiles with the layer
+        L.image = storedIn(L.image, tileStore);
+    }
+    if (total > layerBudgetBytes) {
+        // still over: drop the decoded project tiles, the file has them; a stroke or
+        // a filter job keeps its layer as it is
+        QVector<TiledImage *> images;
+        for (int i = 0; i < layers.size(); ++i) {
+            if (i == filterLayer || (i == activeLayerIndex && canvas->activeStroke())) continue;
+            Layer &L = layers[i];
+            L.history.commit(L.image, L.transform, compressUndo); // the snapshot would keep the old source alive
+            images.append(&L.image);
+        }
+        const qint64 before = decodedBytes();
+        dropDecodedTiles(images);
+        total += decodedBytes() - before;
+    }
+    // the compressed tiles get a quarter of the budget in RAM, the rest goes to disk
+    tileStore->spill(layerBudgetBytes / 4);
+    // the composite out of sight gets another quarter
+    trimComposite();
+    // and the adjustment results another, each cache keeping its share of it
+    const qint64 adjustmentBytes = adjustmentCacheBytes();
+    if (adjustmentBytes > layerBudgetBytes / 4) {
+        EPIGRIMP_PROFILE_SCOPE("trimAdjustments");
+        const double keep = double(layerBudgetBytes / 4) / double(adjustmentBytes);
+        for (Layer &l : layers)
+            if (l.adjustmentCache) l.adjustmentCache->trim(qint64(l.adjustmentCache->byteSize() * keep));
+    }
+    Profiler::counter("adjustmentBytes", adjustmentCacheBytes());
+
+    const TileStore::Stats st = tileStore->stats();
+    Profiler::counter("layerBytes", total);
+    Profiler::counter("storeRamBytes", st.ramBytes);
+    Profiler::counter("storeDiskBytes", st.diskBytes);
 }
 
 void MainWindow::onStrokeStarted()
@@ -801,43 +2089,62 @@ void MainWindow::onStrokeStarted()
     clearRedoForActiveLayer();
 }
 
-void MainWindow::onStrokeFinished()
+void MainWindow::onStrokeFinished(const QRect &dirtyRect)
 {
-    // recomposite after each stroke or intermediate move
-    compositeLayers();
+    // recomposite only what the stroke or intermediate move touched
+    if (!dirtyRect.isEmpty())
+        compositeLayers(dirtyRect);
 }
 
 void MainWindow::undo()
 {
     if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    EPIGRIMP_PROFILE_SCOPE("undo");
+    if (filterLayer == activeLayerIndex) cancelFilterJob(); // undo takes back the tiles already written
+    repackLayer(activeLayerIndex);
     Layer &L = layers[activeLayerIndex];
-    if (L.undoStack.isEmpty()) {
+    L.history.commit(L.image, L.transform, compressUndo);
+    if (!L.history.canUndo()) {
         statusLabel->setText("Nothing to undo");
         return;
     }
-    // move current to redo, pop last undo into current
-    L.redoStack.append(L.image.copy());
-    QImage prev = L.undoStack.takeLast();
-    L.image = prev;
-    compositeLayers();
+    // swap the changed tiles back, cost depends on the edit size only
+    const QTransform before = L.transform;
+    historyChanged(L, before, L.history.undo(L.image, L.transform));
+    autosavePending = true;
     statusLabel->setText("Undo on " + L.name);
 }
 
 void MainWindow::redo()
 {
     if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    EPIGRIMP_PROFILE_SCOPE("redo");
+    if (filterLayer == activeLayerIndex) cancelFilterJob();
+    repackLayer(activeLayerIndex);
     Layer &L = layers[activeLayerIndex];
-    if (L.redoStack.isEmpty()) {
+    L.history.commit(L.image, L.transform, compressUndo);
+    if (!L.history.canRedo()) {
         statusLabel->setText("Nothing to redo");
         return;
     }
-    L.undoStack.append(L.image.copy());
-    QImage next = L.redoStack.takeLast();
-    L.image = next;
-    compositeLayers();
+    const QTransform before = L.transform;
+    historyChanged(L, before, L.history.redo(L.image, L.transform));
+    autosavePending = true;
     statusLabel->setText("Redo on " + L.name);
 }
 
+void MainWindow::historyChanged(const Layer &L, const QTransform &before, const QRect &layerRect)
+{
+    if (L.transform == before) {
+        compositeLayers(L.transform.mapRect(layerRect));
+        return;
+    }
+    // transform undone / redone: everything the layer covers moved
+    targetActiveLayer();
+    invalidateCompositeCache();
+    compositeLayers();
+}
+
 void MainWindow::selectBrush()
 {
     canvas->commitTextItems();
@@ -908,182 +2215,369 @@ void MainWindow::zoomOut()
 
 void MainWindow::rotateLeft()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    QTransform transform;
-    transform.rotate(-90);
-    layers[activeLayerIndex].image = layers[activeLayerIndex].image.transformed(transform);
-    compositeLayers();
-    statusLabel->setText("Rotated left");
+    orientActiveLayer(ImageOps::Orientation::RotateLeft, "Rotated left");
 }
 
 void MainWindow::rotateRight()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    QTransform transform;
-    transform.rotate(90);
-    layers[activeLayerIndex].image = layers[activeLayerIndex].image.transformed(transform);
-    compositeLayers();
-    statusLabel->setText("Rotated right");
+    orientActiveLayer(ImageOps::Orientation::RotateRight, "Rotated right");
 }
 
 void MainWindow::flipHorizontal()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    layers[activeLayerIndex].image = layers[activeLayerIndex].image.mirrored(true, false);
-    compositeLayers();
-    statusLabel->setText("Flipped horizontally");
+    orientActiveLayer(ImageOps::Orientation::FlipHorizontal, "Flipped horizontally");
 }
 
 void MainWindow::flipVertical()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
-    layers[activeLayerIndex].image = layers[activeLayerIndex].image.mirrored(false, true);
+    orientActiveLayer(ImageOps::Orientation::FlipVertical, "Flipped vertically");
+}
+
+void MainWindow::orientActiveLayer(ImageOps::Orientation o, const QString &doneText)
+{
+    if (!activeLayerHasPixels("turn")) return;
+    pushUndoForActiveLayer(false); // the step only holds the previous transform
+    clearRedoForActiveLayer();
+    Layer &L = layers[activeLayerIndex];
+    // O(1): no pixel moves until the transform is applied; its bounds stay at the origin
+    L.transform *= ImageOps::orientationTransform(o, L.transform.mapRect(L.image.rect()).size());
+    targetActiveLayer();
+    invalidateCompositeCache();
     compositeLayers();
-    statusLabel->setText("Flipped vertically");
+    statusLabel->setText(doneText);
 }
 
-// ---------------- Day 8 filters ----------------
-void MainWindow::grayscale()
+void MainWindow::applyActiveLayerTransform()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    if (!activeLayerHasPixels("transform")) return;
+    Layer &L = layers[activeLayerIndex];
+    if (L.transform.isIdentity()) {
+        statusLabel->setText(L.name + " has no transform");
+        return;
+    }
+    if (filterLayer == activeLayerIndex) cancelFilterJob(); // pixels move
+    pushUndoForActiveLayer();
+    clearRedoForActiveLayer();
+    L.image = ImageOps::transformed(L.image, L.transform); // exact for 90 degree steps
+    L.transform = QTransform();
+    targetActiveLayer();
+    invalidateCompositeCache();
+    compositeLayers();
+    statusLabel->setText("Transform applied to " + L.name);
+}
 
-    QImage &img = layers[activeLayerIndex].image;
-    QImage preview = img.copy(); // copie pour prévisualisation
+namespace {
+// preview proxy / layer: radii given in layer pixels are scaled by it
+double proxyScale(const TiledImage &img, int layerWidth)
+{
+    return layerWidth > 0 ? double(img.width()) / layerWidth : 1.0;
+}
 
-    // appliquer filtre à la copie
-    for (int y = 0; y < preview.height(); ++y) {
-        QRgb *scan = reinterpret_cast<QRgb*>(preview.scanLine(y));
-        for (int x = 0; x < preview.width(); ++x) {
-            QColor c(scan[x]);
-            int g = qGray(c.rgb());
-            scan[x] = QColor(g, g, g, c.alpha()).rgba();
-        }
+// pixels a Gaussian blur reads around a tile: its box passes add up
+int gaussianHalo(double sigma)
+{
+    int halo = 0;
+    for (int r : Convolution::gaussianBoxes(sigma)) halo += r;
+    return halo;
+}
+} // namespace
+
+// ---------------- Day 8 filters ----------------
+bool MainWindow::applyFilter(const QString &title, const QString &doneText, const QString &cancelText,
+                             const QVector<FilterParam> &params, const FilterFn &fn,
+                             const std::function<int(const QVector<int> &)> &halo)
+{
+    if (!activeLayerHasPixels("filter")) return false;
+
+    // aperçu sur une version réduite, le calque pleine résolution est rempli en arrière-plan
+    const TiledImage &img = layers[activeLayerIndex].image;
+    // filters run on ARGB32, a packed layer is read widened
+    const TiledImage source = img.convertedTo(QImage::Format_ARGB32_Premultiplied);
+    // with a selection, only the tiles under it are filtered, then merged by coverage
+    const SelectionMask mask = canvas->hasSelection()
+        ? canvas->selectionMask().mapped(layers[activeLayerIndex].transform.inverted()) : SelectionMask();
+    FilterDialog dlg(title, mask.isEmpty() ? source : mask.selectedTiles(source), params, fn, this);
+    if (dlg.exec() != QDialog::Accepted) {
+        statusLabel->setText(cancelText);
+        return false;
     }
 
-    // créer un dialog avec prévisualisation
-    QDialog dlg(this);
-    dlg.setWindowTitle("Apply Grayscale?");
-    dlg.resize(400, 300);
+    cancelFilterJob(); // one at a time, the previous one keeps what it wrote
+    pushUndoForActiveLayer();
+    clearRedoForActiveLayer();
+    Layer &L = layers[activeLayerIndex];
+    // the step holds the tiles the job writes, whenever they arrive
+    filterLayer = activeLayerIndex;
+    filterOriginal = L.image;
+    filterDoneText = doneText;
+    filterSpec = FilterJobSpec();
+    filterSpec.fn = fn;
+    filterSpec.values = dlg.values();
+    filterSpec.halo = halo ? halo(filterSpec.values) : 0;
+    filterSpec.mask = mask;
+    const QVector<int> tiles = filterJobTiles(L.image, filterSpec.halo, mask);
+    filterPending = QVector<char>(L.image.tileCount(), 0);
+    for (int i : tiles) filterPending[i] = 1;
+    submitFilterJob(L.image, tiles);
+    return true;
+}
 
-    QVBoxLayout *lay = new QVBoxLayout(&dlg);
-    QLabel *imgLabel = new QLabel(&dlg);
-    imgLabel->setPixmap(QPixmap::fromImage(preview).scaled(380, 250, Qt::KeepAspectRatio));
-    lay->addWidget(imgLabel);
+void MainWindow::submitFilterJob(const TiledImage &source, const QVector<int> &tiles)
+{
+    const Layer &L = layers[filterLayer];
+    filterSpec.source = source;
+    filterSpec.tiles = tiles;
+    filterSpec.focus = L.transform.inverted().mapRect(canvas->visibleImageRect()); // what the user looks at first
+    filterWatcher.setFuture(startFilterJob(filterSpec));
+    statusLabel->setText("Filtering " + L.name + "...");
+}
 
-    QHBoxLayout *btnLayout = new QHBoxLayout();
-    QPushButton *okBtn = new QPushButton("OK", &dlg);
-    QPushButton *cancelBtn = new QPushButton("Cancel", &dlg);
-    btnLayout->addWidget(okBtn);
-    btnLayout->addWidget(cancelBtn);
-    lay->addLayout(btnLayout);
+void MainWindow::onFilterBatchReady(int index)
+{
+    // a canceled job may still report the block it was on
+    if (filterLayer < 0 || filterWatcher.isCanceled()) return;
+    EPIGRIMP_PROFILE_SCOPE("filterBatch");
+    const FilterBatch batch = filterWatcher.resultAt(index);
+    Layer &L = layers[filterLayer];
+    QRect dirty;
+    for (int k = 0; k < batch.indices.size(); ++k) {
+        const int i = batch.indices[k];
+        // painted over since it was submitted: done again on resubmit
+        if (!filterPending[i] || !L.image.sameTile(filterSpec.source, i)) continue;
+        L.image.setTile(i, batch.tiles[k]);
+        filterPending[i] = 0;
+        dirty |= L.image.tileRect(i);
+    }
+    if (dirty.isEmpty()) return;
+    autosavePending = true;
+    const QRect area = L.transform.mapRect(dirty);
+    updateCompositeCache(filterLayer, area); // not the active layer: it is in the below / above caches
+    compositeLayers(area);
+    const int left = int(std::count(filterPending.begin(), filterPending.end(), 1));
+    statusLabel->setText(QString("Filtering %1... %2 tiles left").arg(L.name).arg(left));
+}
 
-    connect(okBtn, &QPushButton::clicked, &dlg, &QDialog::accept);
-    connect(cancelBtn, &QPushButton::clicked, &dlg, &QDialog::reject);
+void MainWindow::onFilterJobFinished()
+{
+    if (filterLayer < 0 || filterWatcher.isCanceled()) return;
+    if (std::count(filterPending.begin(), filterPending.end(), 1) > 0) {
+        resubmitFilterJob(); // tiles skipped because they were edited meanwhile
+        return;
+    }
+    statusLabel->setText(filterDoneText + layers[filterLayer].name);
+    const std::function<void()> done = filterOnDone;
+    cancelFilterJob(); // nothing left, only resets the state
+    if (done) done();
+}
 
-    // Enter = OK, Esc = Cancel
-    dlg.setWindowFlag(Qt::WindowContextHelpButtonHint, false);
-    dlg.setModal(true);
+void MainWindow::interruptFilterJob()
+{
+    if (filterLayer < 0) return;
+    filterWatcher.cancel();
+    filterResubmitTimer.start(); // restarted by every edit, so a series of them waits for the last
+}
 
-    if (dlg.exec() == QDialog::Accepted) {
-        pushUndoForActiveLayer();
-        clearRedoForActiveLayer();
-        img = preview; // appliquer la modification
-        compositeLayers();
-        statusLabel->setText("Grayscale applied to " + layers[activeLayerIndex].name);
-    } else {
-        statusLabel->setText("Grayscale canceled");
+void MainWindow::resubmitFilterJob()
+{
+    if (filterLayer < 0) return;
+    // not in the middle of a stroke: it would be cut in two undo steps
+    if (QGuiApplication::mouseButtons() != Qt::NoButton) {
+        filterResubmitTimer.start();
+        return;
+    }
+    Layer &L = layers[filterLayer];
+    if (L.image.size() != filterOriginal.size() || L.image.format() != QImage::Format_ARGB32_Premultiplied) {
+        cancelFilterJob(); // resized or repacked, the job no longer fits
+        statusLabel->setText("Filter stopped, " + L.name + " changed");
+        return;
     }
+    // the pending tiles as they are now, their neighbours as the filter was accepted on
+    TiledImage source = filterOriginal;
+    QVector<int> tiles;
+    for (int i = 0; i < filterPending.size(); ++i) {
+        if (!filterPending[i]) continue;
+        source.setTile(i, L.image.tile(i));
+        tiles.append(i);
+    }
+    // the rest is a step of its own, after the edits
+    if (!tiles.isEmpty()) {
+        L.history.begin(L.image, L.transform, compressUndo);
+        L.history.clearRedo();
+        enforceUndoBudget();
+    }
+    submitFilterJob(source, tiles); // empty: only reports it is done
 }
 
-void MainWindow::invertColors()
+void MainWindow::cancelFilterJob()
 {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    if (filterLayer < 0) return;
+    filterWatcher.cancel(); // the worker stops after its current block
+    filterResubmitTimer.stop();
+    const int layer = filterLayer;
+    filterLayer = -1;
+    repackLayer(layer);
+    filterSpec = FilterJobSpec();
+    filterOriginal = TiledImage();
+    filterPending.clear();
+    filterOnDone = nullptr;
+}
 
-    QImage &img = layers[activeLayerIndex].image;
-    QImage preview = img.copy(); // copie pour prévisualisation
+void MainWindow::grayscale()
+{
+    if (!applyFilter("Apply Grayscale?", "Grayscale applied to ", "Grayscale canceled", {},
+                     [](TiledImage &img, const QVector<int> &) { ImageOps::grayscale(img); }))
+        return;
+    // gray and opaque: one byte per pixel is enough
+    if (canvas->hasSelection()) return;
+    const int layer = activeLayerIndex;
+    filterOnDone = [this, layer] {
+        if (layer != activeLayerIndex || !ImageOps::isOpaque(layers[layer].image)) return;
+        if (QMessageBox::question(this, "Grayscale", "Store " + layers[layer].name
+                                  + " as Grayscale 8 bit? It takes 4x less memory.") == QMessageBox::Yes)
+            setActiveLayerFormat(QImage::Format_Grayscale8);
+    };
+}
 
-    // appliquer le filtre inversé sur la copie
-    for (int y = 0; y < preview.height(); ++y) {
-        QRgb *scan = reinterpret_cast<QRgb*>(preview.scanLine(y));
-        for (int x = 0; x < preview.width(); ++x) {
-            QColor c(scan[x]);
-            QColor n(255 - c.red(), 255 - c.green(), 255 - c.blue(), c.alpha());
-            scan[x] = n.rgba();
-        }
-    }
+void MainWindow::invertColors()
+{
+    applyFilter("Apply Invert Colors?", "Inverted colors applied to ", "Invert canceled", {},
+                [](TiledImage &img, const QVector<int> &) { ImageOps::invert(img); });
+}
 
-    // créer un dialog pour prévisualisation
-    QDialog dlg(this);
-    dlg.setWindowTitle("Apply Invert Colors?");
-    dlg.resize(400, 300);
+void MainWindow::brightnessContrast()
+{
+    const QVector<FilterParam> params = {{"Brightness", -100, 100, 0}, {"Contrast", -100, 100, 0}};
+    applyFilter("Brightness / Contrast", "Brightness / contrast applied to ", "Brightness / contrast canceled",
+                params, [](TiledImage &img, const QVector<int> &v) {
+        quint8 lut[256];
+        PixelKernels::makeBrightnessContrastLut(lut, v[0], v[1]);
+        ImageOps::applyLut(img, lut);
+    });
+}
 
-    QVBoxLayout *lay = new QVBoxLayout(&dlg);
-    QLabel *imgLabel = new QLabel(&dlg);
-    imgLabel->setPixmap(QPixmap::fromImage(preview).scaled(380, 250, Qt::KeepAspectRatio));
-    lay->addWidget(imgLabel);
+void MainWindow::levels()
+{
+    const QVector<FilterParam> params = {{"Input black", 0, 255, 0}, {"Input white", 0, 255, 255},
+                                         {"Gamma (%)", 10, 1000, 100}, {"Output black", 0, 255, 0},
+                                         {"Output white", 0, 255, 255}};
+    applyFilter("Levels", "Levels applied to ", "Levels canceled", params, [](TiledImage &img, const QVector<int> &v) {
+        quint8 lut[256];
+        PixelKernels::makeLevelsLut(lut, v[0], v[1], v[2] / 100.0, v[3], v[4]);
+        ImageOps::applyLut(img, lut);
+    });
+}
 
-    QHBoxLayout *btnLayout = new QHBoxLayout();
-    QPushButton *okBtn = new QPushButton("OK", &dlg);
-    QPushButton *cancelBtn = new QPushButton("Cancel", &dlg);
-    btnLayout->addWidget(okBtn);
-    btnLayout->addWidget(cancelBtn);
-    lay->addLayout(btnLayout);
+void MainWindow::channelMixer()
+{
+    // output channel from each input one, in percent (100 = as is)
+    QVector<FilterParam> params;
+    const QStringList names = {"Red", "Green", "Blue"};
+    for (int out = 0; out < 3; ++out)
+        for (int in = 0; in < 3; ++in)
+            params.append({names[out] + " from " + names[in].toLower() + " (%)", -200, 200, out == in ? 100 : 0});
+    applyFilter("Channel Mixer", "Channel mixer applied to ", "Channel mixer canceled", params,
+                [](TiledImage &img, const QVector<int> &v) {
+        PixelKernels::ChannelMatrix m;
+        for (int k = 0; k < 9; ++k) m.m[k / 3][k % 3] = qint16(std::lround(v[k] * 256 / 100.0));
+        ImageOps::channelMix(img, m);
+    });
+}
 
-    connect(okBtn, &QPushButton::clicked, &dlg, &QDialog::accept);
-    connect(cancelBtn, &QPushButton::clicked, &dlg, &QDialog::reject);
+void MainWindow::gaussianBlur()
+{
+    const int full = layers[activeLayerIndex].image.width();
+    applyFilter("Gaussian Blur", "Gaussian blur applied to ", "Gaussian blur canceled", {{"Radius (px)", 1, 500, 8}},
+                [full](TiledImage &img, const QVector<int> &v) {
+        Convolution::gaussianBlur(img, v[0] * proxyScale(img, full) / 2.0); // radius ~ 2 sigma
+    }, [](const QVector<int> &v) { return gaussianHalo(v[0] / 2.0); });
+}
+
+void MainWindow::boxBlur()
+{
+    const int full = layers[activeLayerIndex].image.width();
+    applyFilter("Box Blur", "Box blur applied to ", "Box blur canceled", {{"Radius (px)", 1, 500, 8}},
+                [full](TiledImage &img, const QVector<int> &v) {
+        Convolution::boxBlur(img, int(std::lround(v[0] * proxyScale(img, full))));
+    }, [](const QVector<int> &v) { return v[0]; });
+}
 
-    dlg.setWindowFlag(Qt::WindowContextHelpButtonHint, false);
-    dlg.setModal(true);
+void MainWindow::unsharpMask()
+{
+    const QVector<FilterParam> params = {{"Radius (px)", 1, 100, 3}, {"Amount (%)", 0, 500, 100},
+                                         {"Threshold", 0, 255, 0}};
+    const int full = layers[activeLayerIndex].image.width();
+    applyFilter("Unsharp Mask", "Unsharp mask applied to ", "Unsharp mask canceled", params,
+                [full](TiledImage &img, const QVector<int> &v) {
+        Convolution::unsharpMask(img, v[0] * proxyScale(img, full) / 2.0, v[1], v[2]);
+    }, [](const QVector<int> &v) { return gaussianHalo(v[0] / 2.0); });
+}
 
-    // si OK ou Entrée -> appliquer, sinon Échap -> annuler
-    if (dlg.exec() == QDialog::Accepted) {
-        pushUndoForActiveLayer();
-        clearRedoForActiveLayer();
-        img = preview; // appliquer la modification
-        compositeLayers();
-        statusLabel->setText("Inverted colors applied to " + layers[activeLayerIndex].name);
-    } else {
-        statusLabel->setText("Invert canceled");
-    }
+void MainWindow::edgeDetect()
+{
+    applyFilter("Apply Edge Detect?", "Edge detect applied to ", "Edge detect canceled", {},
+                [](TiledImage &img, const QVector<int> &) { Convolution::sobel(img); },
+                [](const QVector<int> &) { return 1; });
 }
 
 void MainWindow::copySelection()
 {
     if (!canvas->hasSelection()) return; // ← utilise Canvas
     selectionBuffer = canvas->getSelectionImage();
+    QGuiApplication::clipboard()->setImage(selectionBuffer); // shared, encoded only if another app asks
     statusLabel->setText("Selection copied");
 }
 
 void MainWindow::cutSelection()
 {
-    if (!canvas->hasSelection()) return;
+    if (!canvas->hasSelection() || !activeLayerHasPixels("cut")) return;
     pushUndoForActiveLayer();
+    clearRedoForActiveLayer();
     selectionBuffer = canvas->getSelectionImage();
+    QGuiApplication::clipboard()->setImage(selectionBuffer);
 
-    QPainter p(&layers[activeLayerIndex].image);
-    p.setCompositionMode(QPainter::CompositionMode_Clear);
-
-    if (canvas->isRectSelection()) {
-        p.fillRect(canvas->getSelectionRect(), Qt::transparent);
-    } else if (canvas->isLassoSelection()) {
-        QPainterPath path;
-        path.addPolygon(canvas->getLassoPolygon());
-        p.fillPath(path, Qt::transparent);
-    }
+    // selection in image coordinates, cleared in the layer's own pixels (spans only)
+    Layer &layer = layers[activeLayerIndex];
+    canvas->selectionMask().mapped(layer.transform.inverted()).clear(layer.image);
 
-    compositeLayers();
+    compositeLayers(canvas->selectionMask().bounds());
     statusLabel->setText("Selection cut");
 }
 
 
+void MainWindow::anchorPaste()
+{
+    if (!canvas->hasFloatingPaste()) return;
+    canvas->commitFloatingPaste();
+    statusLabel->setText("Paste anchored to " + layers[activeLayerIndex].name);
+}
+
+void MainWindow::fillSelection()
+{
+    if (!canvas->hasSelection() || !activeLayerHasPixels("fill")) return;
+    pushUndoForActiveLayer();
+    clearRedoForActiveLayer();
+    Layer &layer = layers[activeLayerIndex];
+    canvas->selectionMask().mapped(layer.transform.inverted()).fill(layer.image, brushColor);
+    compositeLayers(canvas->selectionMask().bounds());
+    statusLabel->setText("Selection filled");
+}
+
 void MainWindow::pasteSelection()
 {
+    // an image copied in another application wins over our own buffer
+    const QClipboard *clipboard = QGuiApplication::clipboard();
+    if (!clipboard->ownsClipboard() && clipboard->mimeData() && clipboard->mimeData()->hasImage()) {
+        const QImage external = clipboard->image();
+        if (!external.isNull())
+            selectionBuffer = external.format() == QImage::Format_ARGB32_Premultiplied
+                ? external : external.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
     if (selectionBuffer.isNull()) return;
-    pushUndoForActiveLayer();
-    QPainter p(&layers[activeLayerIndex].image);
-    p.drawImage(canvas->getSelectionRect().topLeft(), selectionBuffer);
-    compositeLayers();
-    statusLabel->setText("Selection pasted");
+
+    // floating until anchored: the layer and its history are untouched meanwhile
+    const QPoint pos = canvas->hasSelection() ? canvas->getSelectionRect().topLeft() : QPoint(0, 0);
+    canvas->setFloatingPaste(selectionBuffer, pos);
+    statusLabel->setText("Selection pasted: drag to move, Enter to anchor, Esc to discard");
 }
 
 void MainWindow::onLayerContextMenu(const QPoint &pos)
@@ -1098,6 +2592,11 @@ void MainWindow::onLayerContextMenu(const QPoint &pos)
     QAction *delAct = menu.addAction("Delete Layer");
     QAction *renameAct = menu.addAction("Rename Layer");
     QAction *opacityAct = menu.addAction("Change Opacity");
+    QAction *blendAct = menu.addAction("Blend Mode...");
+    QAction *transformAct = menu.addAction("Apply Transform");
+    QAction *formatAct = menu.addAction("Pixel Format...");
+    QAction *adjustAct = menu.addAction("Edit Adjustment...");
+    adjustAct->setEnabled(layers[layers.size() - 1 - layerListWidget->row(item)].isAdjustment());
 
     QAction *selected = menu.exec(layerListWidget->mapToGlobal(pos));
     if (!selected) return;
@@ -1106,12 +2605,17 @@ void MainWindow::onLayerContextMenu(const QPoint &pos)
     int uiIndex = layerListWidget->row(item);
     int layerIndex = layers.size() - 1 - uiIndex;
     activeLayerIndex = layerIndex;
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    invalidateCompositeCache();
 
     if (selected == dupAct) duplicateLayer();
     else if (selected == delAct) deleteLayer();
     else if (selected == renameAct) renameLayer();
     else if (selected == opacityAct) changeLayerOpacity();
+    else if (selected == blendAct) changeLayerBlendMode();
+    else if (selected == transformAct) applyActiveLayerTransform();
+    else if (selected == formatAct) changeLayerFormat();
+    else if (selected == adjustAct) editAdjustment();
 }
 
 void MainWindow::duplicateLayer()
@@ -1119,6 +2623,7 @@ void MainWindow::duplicateLayer()
     if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
     Layer copy = layers[activeLayerIndex];
     copy.name += " Copy";
+    copy.adjustmentCache = QSharedPointer<AdjustmentCache>(); // its own, it sits higher in the stack
     layers.append(copy);
 
     // mettre en haut dans l'UI
@@ -1126,7 +2631,9 @@ void MainWindow::duplicateLayer()
     layerListWidget->setCurrentRow(0);
 
     activeLayerIndex = layers.size() - 1;
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    autosavePending = true;
+    invalidateCompositeCache();
     compositeLayers();
     statusLabel->setText("Layer duplicated: " + copy.name);
 }
@@ -1138,6 +2645,7 @@ void MainWindow::deleteLayer()
         return;
     }
 
+    cancelFilterJob(); // layer indices shift
     int idx = activeLayerIndex;
     layers.removeAt(idx);
 
@@ -1147,7 +2655,9 @@ void MainWindow::deleteLayer()
 
     activeLayerIndex = layers.size() - 1; // top layer
     layerListWidget->setCurrentRow(0);
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
+    targetActiveLayer();
+    autosavePending = true;
+    invalidateCompositeCache();
     compositeLayers();
     statusLabel->setText("Layer removed, active: " + layers[activeLayerIndex].name);
 }
@@ -1166,6 +2676,7 @@ void MainWindow::renameLayer()
         // update UI
         int uiIndex = layerListWidget->count() - 1 - activeLayerIndex;
         layerListWidget->item(uiIndex)->setText(newName);
+        autosavePending = true;
         statusLabel->setText("Layer renamed: " + newName);
     }
 }
@@ -1181,108 +2692,270 @@ void MainWindow::changeLayerOpacity()
 
     if (ok) {
         layers[activeLayerIndex].opacity = op;
+        autosavePending = true;
+        invalidateCompositeCache();
         compositeLayers();
         statusLabel->setText(QString("Opacity: %1").arg(op));
     }
 }
 
+void MainWindow::changeLayerFormat()
+{
+    const QStringList names = {"RGBA 8 bit", "Grayscale 8 bit (opaque)", "Alpha 8 bit (mask, no colour)",
+                               "RGBA 16 bit"};
+    const QVector<QImage::Format> formats = {QImage::Format_ARGB32_Premultiplied, QImage::Format_Grayscale8,
+                                             QImage::Format_Alpha8, QImage::Format_RGBA64_Premultiplied};
+    bool ok;
+    const QString name = QInputDialog::getItem(this, "Pixel Format", "Store the layer as:", names,
+                                               std::max(0, int(formats.indexOf(layers[activeLayerIndex].image.format()))),
+                                               false, &ok);
+    if (!ok) return;
+    setActiveLayerFormat(formats[names.indexOf(name)]);
+}
+
+void MainWindow::setActiveLayerFormat(QImage::Format format)
+{
+    if (!activeLayerHasPixels("convert")) return;
+    Layer &L = layers[activeLayerIndex];
+    if (L.image.format() == format) return;
+    if (format == QImage::Format_Grayscale8 && !ImageOps::isOpaque(L.image)) {
+        QMessageBox::warning(this, "Pixel Format", "Grayscale 8 bit has no transparency: " + L.name
+                             + " must be fully opaque where it is painted.");
+        return;
+    }
+    pushUndoForActiveLayer(false); // the packed layer is what the step gives back
+    clearRedoForActiveLayer();
+    L.image = L.image.convertedTo(format);
+    targetActiveLayer();
+    invalidateCompositeCache();
+    compositeLayers();
+    statusLabel->setText(QString("%1 stored in %2 MB").arg(L.name).arg(double(L.image.memoryBytes()) / (1 << 20), 0, 'f', 1));
+}
+
+void MainWindow::addAdjustmentLayer(AdjustmentKind kind)
+{
+    Layer l;
+    l.name = Adjustments::kindName(kind);
+    l.image = TiledImage(documentSize()); // never written, only keeps every layer alike (saves, undo)
+    l.adjustment.kind = kind;
+    l.adjustment.values = Adjustments::defaultValues(kind);
+    layers.append(l);
+
+    layerListWidget->insertItem(0, l.name);
+    layerListWidget->setCurrentRow(0);
+
+    activeLayerIndex = layers.size() - 1;
+    targetActiveLayer();
+    if (canvas->gpuBackend()) canvas->setGpuBackend(false); // the GL view has no adjustments
+    autosavePending = true;
+    invalidateCompositeCache();
+    compositeLayers();
+    statusLabel->setText("Added adjustment layer " + l.name);
+    if (!l.adjustment.values.isEmpty()) editAdjustment();
+}
+
+void MainWindow::editAdjustment()
+{
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    const Layer &L = layers[activeLayerIndex];
+    if (!L.isAdjustment()) {
+        statusLabel->setText(L.name + " is not an adjustment layer");
+        return;
+    }
+    if (L.adjustment.kind != AdjustmentKind::BrightnessContrast) {
+        statusLabel->setText(L.name + " has no setting");
+        return;
+    }
+
+    const QVector<FilterParam> params = {{"Brightness", -100, 100, L.adjustment.values.value(0)},
+                                         {"Contrast", -100, 100, L.adjustment.values.value(1)}};
+    const AdjustmentKind kind = L.adjustment.kind;
+    // preview on what the layers under it composite to
+    FilterDialog dlg("Adjustment: " + L.name, flattenedBelow(activeLayerIndex), params,
+                     [kind](TiledImage &img, const QVector<int> &v) {
+        const Adjustment a{kind, v};
+        for (int i = 0; i < img.tileCount(); ++i) {
+            if (img.tile(i).isNull()) continue;
+            QImage tile = img.tile(i);
+            Adjustments::apply(a, tile);
+            img.setTile(i, tile);
+        }
+    }, this);
+    if (dlg.exec() != QDialog::Accepted) {
+        statusLabel->setText("Adjustment unchanged");
+        return;
+    }
+
+    // no pixel changes: the cache keys do, every tile is recomputed once
+    Layer &A = layers[activeLayerIndex];
+    A.adjustment.values = dlg.values();
+    autosavePending = true;
+    compositeLayers();
+    statusLabel->setText("Adjustment changed: " + A.name);
+}
+
+void MainWindow::changeLayerBlendMode()
+{
+    const QStringList modes = BlendKernels::modeNames();
+    bool ok;
+    const QString mode = QInputDialog::getItem(this, "Blend Mode", "Mode:", modes,
+                                               int(layers[activeLayerIndex].blendMode), false, &ok);
+    if (!ok) return;
+
+    layers[activeLayerIndex].blendMode = BlendMode(modes.indexOf(mode));
+    if (canvas->gpuBackend() && layers[activeLayerIndex].blendMode != BlendMode::Normal)
+        canvas->setGpuBackend(false); // the GL view only does Normal
+    autosavePending = true;
+    invalidateCompositeCache();
+    compositeLayers();
+    statusLabel->setText("Blend mode: " + mode);
+}
+
 void Canvas::mouseDoubleClickEvent(QMouseEvent *event)
 {
     if (currentTool != TEXT || !targetImg) return;
 
-    QPoint imgPt = widgetToImage(event->pos(), targetImg->size());
-    for (TextItem &t : textItems) {
-        QRect itemRect = t.boundingRect.translated(t.position);
-        if (itemRect.contains(imgPt)) {
-
-            // Dialog pour éditer texte
-            QDialog dlg(this);
-            dlg.setWindowTitle("Edit Text");
-            QVBoxLayout *lay = new QVBoxLayout(&dlg);
-
-            QLineEdit *line = new QLineEdit(t.text, &dlg);
-            lay->addWidget(line);
-
-            QPushButton *colorBtn = new QPushButton("Choose Color", &dlg);
-            lay->addWidget(colorBtn);
-
-            QFontComboBox *fontCombo = new QFontComboBox(&dlg);
-            fontCombo->setCurrentFont(t.font);
-            lay->addWidget(fontCombo);
-
-            QSpinBox *sizeSpin = new QSpinBox(&dlg);
-            sizeSpin->setRange(6, 200);
-            sizeSpin->setValue(t.font.pointSize());
-            lay->addWidget(sizeSpin);
-
-            QHBoxLayout *btnLayout = new QHBoxLayout();
-            QPushButton *okBtn = new QPushButton("OK", &dlg);
-            QPushButton *cancelBtn = new QPushButton("Cancel", &dlg);
-            btnLayout->addWidget(okBtn);
-            btnLayout->addWidget(cancelBtn);
-            lay->addLayout(btnLayout);
-
-            QColor chosenColor = t.color;
-
-            connect(colorBtn, &QPushButton::clicked, [&]() {
-                QColor c = QColorDialog::getColor(chosenColor, this, "Pick Color");
-                if (c.isValid()) chosenColor = c;
-            });
-            connect(okBtn, &QPushButton::clicked, &dlg, &QDialog::accept);
-            connect(cancelBtn, &QPushButton::clicked, &dlg, &QDialog::reject);
-
-            if (dlg.exec() == QDialog::Accepted) {
-                t.text = line->text();
-                t.color = chosenColor;
-                t.font = QFont(fontCombo->currentFont().family(), sizeSpin->value());
-                QFontMetrics fm(t.font);
-                t.boundingRect = fm.boundingRect(t.text);
-                update();
-            }
-            return;
-        }
+    QPoint imgPt = widgetToImage(event->pos(), targetSize());
+    const int index = textCache.itemAt(textItems, imgPt);
+    if (index < 0) return;
+    TextItem &t = textItems[index];
+
+    // Dialog pour éditer texte
+    QDialog dlg(this);
+    dlg.setWindowTitle("Edit Text");
+    QVBoxLayout *lay = new QVBoxLayout(&dlg);
+
+    QLineEdit *line = new QLineEdit(t.text, &dlg);
+    lay->addWidget(line);
+
+    QPushButton *colorBtn = new QPushButton("Choose Color", &dlg);
+    lay->addWidget(colorBtn);
+
+    QFontComboBox *fontCombo = new QFontComboBox(&dlg);
+    fontCombo->setCurrentFont(t.font);
+    lay->addWidget(fontCombo);
+
+    QSpinBox *sizeSpin = new QSpinBox(&dlg);
+    sizeSpin->setRange(6, 200);
+    sizeSpin->setValue(t.font.pointSize());
+    lay->addWidget(sizeSpin);
+
+    QHBoxLayout *btnLayout = new QHBoxLayout();
+    QPushButton *okBtn = new QPushButton("OK", &dlg);
+    QPushButton *cancelBtn = new QPushButton("Cancel", &dlg);
+    btnLayout->addWidget(okBtn);
+    btnLayout->addWidget(cancelBtn);
+    lay->addLayout(btnLayout);
+
+    QColor chosenColor = t.color;
+
+    connect(colorBtn, &QPushButton::clicked, [&]() {
+        QColor c = QColorDialog::getColor(chosenColor, this, "Pick Color");
+        if (c.isValid()) chosenColor = c;
+    });
+    connect(okBtn, &QPushButton::clicked, &dlg, &QDialog::accept);
+    connect(cancelBtn, &QPushButton::clicked, &dlg, &QDialog::reject);
+
+    if (dlg.exec() == QDialog::Accepted) {
+        t.text = line->text();
+        t.color = chosenColor;
+        t.font = QFont(fontCombo->currentFont().family(), sizeSpin->value());
+        const QRect before = TextItemCache::itemRect(t);
+        QFontMetrics fm(t.font);
+        t.boundingRect = fm.boundingRect(t.text);
+        textCache.update(index, before, t); // new raster at the next paint
+        refreshView();
     }
 }
 
 
 void Canvas::commitTextItems()
 {
-    if (!targetImg || textItems.isEmpty()) return;
-
-    QPainter p(targetImg);
-    p.setRenderHint(QPainter::Antialiasing, true);
+    if (!targetImg || !targetPaintable || textItems.isEmpty()) return;
+    emit strokeStarted(); // pour undo
 
-    for (const TextItem &t : textItems) {
-        p.setFont(t.font);
-        p.setPen(t.color);
-        p.drawText(t.position, t.text);
+    // one paint per item, over its own tiles only; rasters at scale 1 are reused
+    QRect dirty;
+    for (int i = 0; i < textItems.size(); ++i) {
+        const QRect box = TextItemCache::paddedRect(textItems[i]);
+        const QImage &raster = textCache.raster(i, textItems[i], 1.0);
+        targetImg->paint(imageToTarget.mapRect(box), [&](QPainter &p) {
+            p.setTransform(imageToTarget, true); // positions are image coordinates
+            p.drawImage(QRectF(box), raster);
+        });
+        dirty |= box;
     }
 
     textItems.clear();
+    textCache.reset(textItems);
     activeTextIndex = -1;
-    emit strokeFinished();
-    update();
+    emit strokeFinished(dirty);
+    refreshView();
+}
+
+void Canvas::setFloatingPaste(const QImage &img, const QPoint &pos)
+{
+    commitFloatingPaste(); // the previous one is anchored first
+    floatingImage = img;   // shared, no pixel copied
+    floatingPos = pos;
+    movingFloating = false;
+    refreshView();
+}
+
+void Canvas::commitFloatingPaste()
+{
+    if (floatingImage.isNull()) return;
+    if (!targetImg) {
+        discardFloatingPaste();
+        return;
+    }
+    if (!targetPaintable) return; // stays floating until a pixel layer is active
+    const QRect dirty(floatingPos, floatingImage.size());
+    emit strokeStarted(); // pour undo
+    targetImg->paint(imageToTarget.mapRect(dirty), [&](QPainter &p) {
+        p.setTransform(imageToTarget, true);
+        p.drawImage(floatingPos, floatingImage);
+    });
+    floatingImage = QImage();
+    movingFloating = false;
+    emit strokeFinished(dirty);
+    refreshView();
+}
+
+void Canvas::discardFloatingPaste()
+{
+    if (floatingImage.isNull()) return;
+    floatingImage = QImage();
+    movingFloating = false;
+    refreshView();
+}
+
+void Canvas::setTextItems(const QVector<TextItem> &items)
+{
+    textItems = items;
+    for (TextItem &t : textItems) t.selected = false;
+    textCache.reset(textItems);
+    activeTextIndex = -1;
+    refreshView();
 }
 
 void MainWindow::openPNGAsNewLayer()
 {
-    QString fileName = QFileDialog::getOpenFileName(this,
+    const QStringList files = QFileDialog::getOpenFileNames(this,
         "Open PNG as Layer",
         QString(),
         "PNG Images (*.png)");
 
-    if (fileName.isEmpty()) return;
-
-    QImage loaded;
-    if (!loaded.load(fileName)) {
-        QMessageBox::warning(this, "Open failed", "Could not open PNG image.");
-        return;
-    }
+    if (files.isEmpty()) return;
+    startImport(files, true);
+}
 
+void MainWindow::addLayerFromImport(const ImportedImage &imported)
+{
     // Créer un nouveau layer
     Layer l;
-    l.name = QFileInfo(fileName).baseName(); // nom du fichier sans extension
-    l.image = loaded.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    l.name = QFileInfo(imported.fileName).baseName(); // nom du fichier sans extension
+    l.image = imported.image; // transparent areas are not stored
 
     layers.append(l);
 
@@ -1292,10 +2965,5 @@ void MainWindow::openPNGAsNewLayer()
 
     // Activer le nouveau layer
     activeLayerIndex = layers.size() - 1;
-    canvas->setTargetImage(&layers[activeLayerIndex].image);
-
-    // Mettre à jour le composite
-    compositeLayers();
-
-    statusLabel->setText(fileName + " loaded into new layer: " + l.name);
+    targetActiveLayer();
 }
@@ -0,0 +1,181 @@
+#include "mippyramid.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// per channel (a + b + c + d + 2) / 4 on premultiplied ARGB, two channels per 16-bit lane
+inline quint32 average4(quint32 a, quint32 b, quint32 c, quint32 d)
+{
+    const quint32 rb = ((a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff)
+                        + (d & 0x00ff00ff) + 0x00020002) >> 2;
+    const quint32 ag = (((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff)
+                        + ((d >> 8) & 0x00ff00ff) + 0x00020002) >> 2;
+    return (rb & 0x00ff00ff) | ((ag & 0x00ff00ff) << 8);
+}
+
+QSize halfSize(const QSize &s)
+{
+    return QSize(std::max(1, (s.width() + 1) / 2), std::max(1, (s.height() + 1) / 2));
+}
+
+} // namespace
+
+void MipPyramid::setBase(const TiledImage *b)
+{
+    base = b;
+    levels.clear();
+    dirty.clear();
+}
+
+void MipPyramid::markDirty(const QRect &baseRect)
+{
+    // pixel x of a level depends on pixels 2x and 2x+1 of the level above it
+    QRect r = baseRect;
+    for (int i = 0; i < levels.size(); ++i) {
+        r = QRect(QPoint(r.left() >> 1, r.top() >> 1), QPoint(r.right() >> 1, r.bottom() >> 1));
+        dirty[i] += r.intersected(levels[i].rect());
+    }
+}
+
+int MipPyramid::maxLevel() const
+{
+    if (!base || base->isNull()) return 0;
+    int n = 0;
+    QSize s = base->size();
+    while (n < 8 && s.width() > 16 && s.height() > 16) {
+        s = halfSize(s);
+        ++n;
+    }
+    return n;
+}
+
+int MipPyramid::levelForScale(double scale) const
+{
+    const int maxN = maxLevel();
+    int n = 0;
+    double levelScale = 0.5;
+    while (n < maxN && levelScale >= scale) {
+        ++n;
+        levelScale *= 0.5;
+    }
+    return n;
+}
+
+const TiledImage &MipPyramid::level(int n, const QRect &r)
+{
+    n = std::clamp(n, 0, maxLevel());
+    if (n == 0) return *base;
+
+    // allocate missing levels, fully dirty (no tile stored yet)
+    while (levels.size() < n) {
+        const TiledImage &parent = levels.isEmpty() ? *base : levels.last();
+        levels.append(TiledImage(halfSize(parent.size())));
+        dirty.append(QRegion(levels.last().rect()));
+    }
+    refresh(n - 1, r);
+    return levels[n - 1];
+}
+
+void MipPyramid::refresh(int i, const QRect &r)
+{
+    TiledImage &dst = levels[i];
+    const int T = TiledImage::TileSize;
+    QVector<int> todo;
+    QRect area;
+    for (int t : dst.tilesIn(r)) {
+        if (!dirty[i].intersects(dst.tileRect(t))) continue;
+        todo.append(t);
+        area |= dst.tileRect(t);
+    }
+    if (todo.isEmpty()) return;
+
+    // a tile halves the 2 x 2 tiles above it, which come first
+    if (i > 0) refresh(i - 1, QRect(area.topLeft() * 2, area.size() * 2));
+    const TiledImage &src = i == 0 ? *base : levels[i - 1];
+
+    const QRect srcRect = src.rect();
+    QVector<uchar *> bits(todo.size(), nullptr);
+    for (int k = 0; k < todo.size(); ++k) {
+        const int t = todo[k];
+        dirty[i] -= QRegion(dst.tileRect(t));
+        const QRect parent(dst.tileRect(t).topLeft() * 2, QSize(2 * T, 2 * T));
+        const QVector<int> from = src.tilesIn(parent);
+        const bool empty = std::all_of(from.begin(), from.end(), [&](int p) { return src.tile(p).isNull(); });
+        if (empty) dst.setTile(t, QImage()); // transparent stays unstored
+        else bits[k] = dst.tileForWrite(t).bits(); // detach here, not in the workers
+    }
+
+    WorkScheduler::parallelFor(todo.size(), [&](int k) {
+        if (!bits[k]) return;
+        const QRect tr = dst.tileRect(todo[k]);
+        const qsizetype dstBpl = dst.tile(todo[k]).bytesPerLine();
+        for (int q = 0; q < 4; ++q) {
+            // quadrant q of the tile comes from one parent tile
+            const QPoint at = tr.topLeft() * 2 + QPoint((q & 1) * T, (q >> 1) * T);
+            uchar *out = bits[k] + (q >> 1) * (T / 2) * dstBpl + (q & 1) * (T / 2) * 4;
+            const QImage *tile = srcRect.contains(at) ? &src.tile(at.y() / T * src.tileColumns() + at.x() / T) : nullptr;
+            if (!tile || tile->isNull()) {
+                for (int y = 0; y < T / 2; ++y) std::memset(out + y * dstBpl, 0, T / 2 * 4);
+                continue;
+            }
+            // clamped to the image like halved(), so odd sizes keep their last row / column
+            const int maxX = std::min(T, srcRect.right() + 1 - at.x()) - 1;
+            const int maxY = std::min(T, srcRect.bottom() + 1 - at.y()) - 1;
+            for (int y = 0; y < T / 2; ++y) {
+                const quint32 *row0 = reinterpret_cast<const quint32 *>(tile->constScanLine(std::min(2 * y, maxY)));
+                const quint32 *row1 = reinterpret_cast<const quint32 *>(tile->constScanLine(std::min(2 * y + 1, maxY)));
+                quint32 *o = reinterpret_cast<quint32 *>(out + y * dstBpl);
+                for (int x = 0; x < T / 2; ++x) {
+                    const int x0 = std::min(2 * x, maxX);
+                    const int x1 = std::min(2 * x + 1, maxX);
+                    o[x] = average4(row0[x0], row0[x1], row1[x0], row1[x1]);
+                }
+            }
+        }
+    });
+}
+
+qint64 MipPyramid::memoryBytes() const
+{
+    qint64 bytes = 0;
+    for (const TiledImage &l : levels) bytes += l.memoryBytes();
+    return bytes;
+}
+
+void MipPyramid::downsample(const QImage &src, QImage &dst, const QRect &dstRect)
+{
+    const int maxX = src.width() - 1;
+    const int maxY = src.height() - 1;
+    const uchar *srcBits = src.constBits();
+    const qsizetype srcBpl = src.bytesPerLine();
+    uchar *dstBits = dst.bits(); // detach here, not in the workers
+    const qsizetype dstBpl = dst.bytesPerLine();
+
+    // small refreshes (brush strokes) stay on this thread
+    const int minRows = dstRect.width() * dstRect.height() < 64 * 1024 ? dstRect.height() : 16;
+    WorkScheduler::parallelForRows(dstRect.top(), dstRect.bottom() + 1, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const quint32 *row0 = reinterpret_cast<const quint32 *>(srcBits + std::min(2 * y, maxY) * srcBpl);
+            const quint32 *row1 = reinterpret_cast<const quint32 *>(srcBits + std::min(2 * y + 1, maxY) * srcBpl);
+            quint32 *out = reinterpret_cast<quint32 *>(dstBits + y * dstBpl);
+            for (int x = dstRect.left(); x <= dstRect.right(); ++x) {
+                const int x0 = std::min(2 * x, maxX);
+                const int x1 = std::min(2 * x + 1, maxX);
+                out[x] = average4(row0[x0], row0[x1], row1[x0], row1[x1]);
+            }
+        }
+    }, minRows);
+}
+
+QImage MipPyramid::halved(const QImage &src)
+{
+    const QImage in = src.format() == QImage::Format_ARGB32_Premultiplied
+                          ? src
+                          : src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QImage out(halfSize(in.size()), QImage::Format_ARGB32_Premultiplied);
+    downsample(in, out, out.rect());
+    return out;
+}
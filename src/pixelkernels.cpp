@@ -0,0 +1,167 @@
+#include "pixelkernels_p.h"
+
+#include <QByteArray>
+#include <QColor>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(EPIGRIMP_HAVE_X86_KERNELS) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace PixelKernels {
+namespace detail {
+
+// ---------------- scalar kernels ----------------
+void invertScalar(quint32 *px, int n)
+{
+    // premultiplied: a * (255 - c) / 255 == a - c, no division needed
+    for (int i = 0; i < n; ++i) {
+        const quint32 p = px[i];
+        const quint32 a = p >> 24;
+        const quint32 r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+        px[i] = (a << 24) | ((r > a ? 0 : a - r) << 16) | ((g > a ? 0 : a - g) << 8) | (b > a ? 0 : a - b);
+    }
+}
+
+void grayscaleScalar(quint32 *px, int n)
+{
+    // the weighted sum of premultiplied channels is the premultiplied gray
+    for (int i = 0; i < n; ++i) {
+        const quint32 p = px[i];
+        const quint32 g = (((p >> 16) & 0xff) * 11 + ((p >> 8) & 0xff) * 16 + (p & 0xff) * 5) >> 5;
+        px[i] = (p & 0xff000000) | (g * 0x010101);
+    }
+}
+
+void channelMixScalar(quint32 *px, int n, const ChannelMatrix &mx)
+{
+    const auto &m = mx.m;
+    for (int i = 0; i < n; ++i) {
+        const quint32 p = px[i];
+        const int a = int(p >> 24);
+        const int r = int((p >> 16) & 0xff), g = int((p >> 8) & 0xff), b = int(p & 0xff);
+        // linear, so it applies to premultiplied values; clamp keeps c <= a
+        const int nr = std::clamp((m[0][0] * r + m[0][1] * g + m[0][2] * b) >> 8, 0, a);
+        const int ng = std::clamp((m[1][0] * r + m[1][1] * g + m[1][2] * b) >> 8, 0, a);
+        const int nb = std::clamp((m[2][0] * r + m[2][1] * g + m[2][2] * b) >> 8, 0, a);
+        px[i] = (quint32(a) << 24) | (quint32(nr) << 16) | (quint32(ng) << 8) | quint32(nb);
+    }
+}
+
+void applyLutScalar(quint32 *px, int n, const quint8 lut[256])
+{
+    for (int i = 0; i < n; ++i) {
+        const quint32 p = px[i];
+        const quint32 a = p >> 24;
+        if (a == 0) continue; // fully transparent stays as is
+        if (a == 255) {
+            px[i] = 0xff000000 | (quint32(lut[(p >> 16) & 0xff]) << 16)
+                    | (quint32(lut[(p >> 8) & 0xff]) << 8) | lut[p & 0xff];
+        } else {
+            const QRgb u = qUnpremultiply(p);
+            px[i] = qPremultiply(qRgba(lut[qRed(u)], lut[qGreen(u)], lut[qBlue(u)], int(a)));
+        }
+    }
+}
+
+} // namespace detail
+
+namespace {
+
+using namespace detail;
+
+#ifdef EPIGRIMP_HAVE_X86_KERNELS
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false; // OS saves ymm registers
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+KernelTable pickTable()
+{
+    // EPIGRIMP_KERNELS=scalar|sse2 forces a slower path (debugging, benchmarks)
+    const QByteArray forced = qgetenv("EPIGRIMP_KERNELS");
+    const KernelTable scalar = {"scalar", invertScalar, grayscaleScalar, channelMixScalar, applyLutScalar};
+    if (forced == "scalar") return scalar;
+
+#if defined(EPIGRIMP_HAVE_X86_KERNELS)
+    if (forced != "sse2" && cpuHasAvx2())
+        return {"avx2", invertAvx2, grayscaleAvx2, channelMixAvx2, applyLutAvx2};
+    return {"sse2", invertSse2, grayscaleSse2, channelMixSse2, applyLutScalar}; // baseline on x86-64
+#elif defined(EPIGRIMP_HAVE_NEON_KERNELS)
+    return {"neon", invertNeon, grayscaleNeon, channelMixNeon, applyLutNeon};
+#else
+    return scalar;
+#endif
+}
+
+const KernelTable &table()
+{
+    static const KernelTable t = pickTable();
+    return t;
+}
+
+} // namespace
+
+void invert(quint32 *px, int n) { table().invert(px, n); }
+void grayscale(quint32 *px, int n) { table().grayscale(px, n); }
+void channelMix(quint32 *px, int n, const ChannelMatrix &matrix) { table().channelMix(px, n, matrix); }
+void applyLut(quint32 *px, int n, const quint8 lut[256]) { table().applyLut(px, n, lut); }
+const char *implementationName() { return table().name; }
+
+void unpackToArgb32(quint32 *dst, const uchar *src, int n, QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_Alpha8: // black with that alpha, as QImage converts it
+        for (int i = 0; i < n; ++i) dst[i] = quint32(src[i]) << 24;
+        break;
+    case QImage::Format_Grayscale8: // opaque
+        for (int i = 0; i < n; ++i) dst[i] = 0xff000000 | (quint32(src[i]) * 0x010101);
+        break;
+    case QImage::Format_RGBA64_Premultiplied: {
+        // 16 -> 8 bit with rounding (x / 257), QRgba64 keeps red in the low bits
+        const quint64 *s = reinterpret_cast<const quint64 *>(src);
+        const auto c8 = [](quint64 v) { return quint32((v - (v >> 8) + 128) >> 8); };
+        for (int i = 0; i < n; ++i) {
+            const quint64 p = s[i];
+            dst[i] = (c8(p >> 48) << 24) | (c8(p & 0xffff) << 16) | (c8((p >> 16) & 0xffff) << 8) | c8((p >> 32) & 0xffff);
+        }
+        break;
+    }
+    default:
+        std::memcpy(dst, src, size_t(n) * 4);
+        break;
+    }
+}
+
+void makeBrightnessContrastLut(quint8 lut[256], int brightness, int contrast)
+{
+    const double factor = (100.0 + std::clamp(contrast, -100, 100)) / 100.0;
+    const double offset = std::clamp(brightness, -100, 100) * 255.0 / 100.0;
+    for (int i = 0; i < 256; ++i)
+        lut[i] = quint8(std::clamp(int(std::lround((i - 128) * factor + 128 + offset)), 0, 255));
+}
+
+void makeLevelsLut(quint8 lut[256], int inBlack, int inWhite, double gamma, int outBlack, int outWhite)
+{
+    const double range = std::max(1, inWhite - inBlack);
+    const double invGamma = 1.0 / std::max(0.01, gamma);
+    for (int i = 0; i < 256; ++i) {
+        const double x = std::pow(std::clamp((i - inBlack) / range, 0.0, 1.0), invGamma);
+        lut[i] = quint8(std::clamp(int(std::lround(outBlack + x * (outWhite - outBlack))), 0, 255));
+    }
+}
+
+} // namespace PixelKernels
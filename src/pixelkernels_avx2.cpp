@@ -0,0 +1,125 @@
+#include "pixelkernels_p.h"
+
+#include <immintrin.h>
+
+namespace PixelKernels {
+namespace detail {
+
+namespace {
+
+// alpha of each pixel copied into its four bytes
+inline __m256i broadcastAlpha(__m256i v)
+{
+    __m256i a = _mm256_srli_epi32(v, 24);
+    a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+    return _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+}
+
+// c = clamp(c, 0, hi) on signed 32-bit lanes
+inline __m256i clamp0(__m256i c, __m256i hi)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(c, _mm256_setzero_si256()), hi);
+}
+
+} // namespace
+
+void invertAvx2(quint32 *px, int n)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(px + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        // a - c per channel (saturated), the alpha byte becomes 0 and is put back
+        const __m256i inv = _mm256_subs_epu8(broadcastAlpha(v), v);
+        _mm256_storeu_si256(p, _mm256_or_si256(inv, _mm256_and_si256(v, alphaMask)));
+    }
+    invertScalar(px + i, n - i);
+}
+
+void grayscaleAvx2(quint32 *px, int n)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000));
+    // channel and weights fit in the low 16 bits of each lane, the high halves stay 0
+    const __m256i wr = _mm256_set1_epi32(11), wb = _mm256_set1_epi32(5);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(px + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        const __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), byteMask);
+        const __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), byteMask);
+        const __m256i b = _mm256_and_si256(v, byteMask);
+        __m256i sum = _mm256_add_epi32(_mm256_mullo_epi16(r, wr), _mm256_slli_epi32(g, 4));
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi16(b, wb));
+        const __m256i gray = _mm256_srli_epi32(sum, 5);
+        __m256i out = _mm256_or_si256(gray, _mm256_slli_epi32(gray, 8));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(gray, 16));
+        _mm256_storeu_si256(p, _mm256_or_si256(out, _mm256_and_si256(v, alphaMask)));
+    }
+    grayscaleScalar(px + i, n - i);
+}
+
+void channelMixAvx2(quint32 *px, int n, const ChannelMatrix &mx)
+{
+    const auto &m = mx.m;
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    // coefficient in the low 16 bits only: madd_epi16 then yields channel * coefficient
+    __m256i c[3][3];
+    for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 3; ++col)
+            c[row][col] = _mm256_set1_epi32(int(quint16(m[row][col])));
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(px + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        const __m256i a = _mm256_srli_epi32(v, 24);
+        const __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), byteMask);
+        const __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), byteMask);
+        const __m256i b = _mm256_and_si256(v, byteMask);
+
+        __m256i ch[3];
+        for (int row = 0; row < 3; ++row) {
+            __m256i s = _mm256_add_epi32(_mm256_madd_epi16(r, c[row][0]), _mm256_madd_epi16(g, c[row][1]));
+            s = _mm256_add_epi32(s, _mm256_madd_epi16(b, c[row][2]));
+            ch[row] = clamp0(_mm256_srai_epi32(s, 8), a);
+        }
+
+        __m256i out = _mm256_slli_epi32(a, 24);
+        out = _mm256_or_si256(out, _mm256_slli_epi32(ch[0], 16));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(ch[1], 8));
+        _mm256_storeu_si256(p, _mm256_or_si256(out, ch[2]));
+    }
+    channelMixScalar(px + i, n - i, mx);
+}
+
+void applyLutAvx2(quint32 *px, int n, const quint8 lut[256])
+{
+    // opaque pixels need no unpremultiply: their channels are gathered from the
+    // table as 32-bit entries; blocks with any other alpha go the scalar way
+    alignas(32) qint32 wide[256];
+    for (int k = 0; k < 256; ++k) wide[k] = lut[k];
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(px + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        const __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(v, alphaMask), alphaMask);
+        if (_mm256_movemask_epi8(opaque) != -1) {
+            applyLutScalar(px + i, 8, lut);
+            continue;
+        }
+        const __m256i r = _mm256_i32gather_epi32(wide, _mm256_and_si256(_mm256_srli_epi32(v, 16), byteMask), 4);
+        const __m256i g = _mm256_i32gather_epi32(wide, _mm256_and_si256(_mm256_srli_epi32(v, 8), byteMask), 4);
+        const __m256i b = _mm256_i32gather_epi32(wide, _mm256_and_si256(v, byteMask), 4);
+        __m256i out = _mm256_or_si256(alphaMask, _mm256_slli_epi32(r, 16));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(g, 8));
+        _mm256_storeu_si256(p, _mm256_or_si256(out, b));
+    }
+    applyLutScalar(px + i, n - i, lut);
+}
+
+} // namespace detail
+} // namespace PixelKernels
@@ -0,0 +1,100 @@
+#include "pixelkernels_p.h"
+
+#include <arm_neon.h>
+
+namespace PixelKernels {
+namespace detail {
+
+void invertNeon(quint32 *px, int n)
+{
+    const uint32x4_t alphaMask = vdupq_n_u32(0xff000000u);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t v = vld1q_u32(px + i);
+        uint32x4_t a = vshrq_n_u32(v, 24);
+        a = vorrq_u32(a, vshlq_n_u32(a, 8));
+        a = vorrq_u32(a, vshlq_n_u32(a, 16));
+        // a - c per channel (saturated), the alpha byte becomes 0 and is put back
+        const uint8x16_t inv = vqsubq_u8(vreinterpretq_u8_u32(a), vreinterpretq_u8_u32(v));
+        vst1q_u32(px + i, vorrq_u32(vreinterpretq_u32_u8(inv), vandq_u32(v, alphaMask)));
+    }
+    invertScalar(px + i, n - i);
+}
+
+void grayscaleNeon(quint32 *px, int n)
+{
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+    const uint32x4_t alphaMask = vdupq_n_u32(0xff000000u);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t v = vld1q_u32(px + i);
+        const uint32x4_t r = vandq_u32(vshrq_n_u32(v, 16), byteMask);
+        const uint32x4_t g = vandq_u32(vshrq_n_u32(v, 8), byteMask);
+        const uint32x4_t b = vandq_u32(v, byteMask);
+        uint32x4_t sum = vmulq_n_u32(r, 11);
+        sum = vaddq_u32(sum, vshlq_n_u32(g, 4));
+        sum = vmlaq_n_u32(sum, b, 5);
+        const uint32x4_t gray = vmulq_n_u32(vshrq_n_u32(sum, 5), 0x010101);
+        vst1q_u32(px + i, vorrq_u32(gray, vandq_u32(v, alphaMask)));
+    }
+    grayscaleScalar(px + i, n - i);
+}
+
+void channelMixNeon(quint32 *px, int n, const ChannelMatrix &mx)
+{
+    const auto &m = mx.m;
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t v = vld1q_u32(px + i);
+        const int32x4_t a = vreinterpretq_s32_u32(vshrq_n_u32(v, 24));
+        const int32x4_t r = vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(v, 16), byteMask));
+        const int32x4_t g = vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(v, 8), byteMask));
+        const int32x4_t b = vreinterpretq_s32_u32(vandq_u32(v, byteMask));
+
+        uint32x4_t ch[3];
+        for (int row = 0; row < 3; ++row) {
+            int32x4_t s = vmulq_n_s32(r, m[row][0]);
+            s = vmlaq_n_s32(s, g, m[row][1]);
+            s = vmlaq_n_s32(s, b, m[row][2]);
+            s = vminq_s32(vmaxq_s32(vshrq_n_s32(s, 8), vdupq_n_s32(0)), a);
+            ch[row] = vreinterpretq_u32_s32(s);
+        }
+
+        uint32x4_t out = vshlq_n_u32(vreinterpretq_u32_s32(a), 24);
+        out = vorrq_u32(out, vshlq_n_u32(ch[0], 16));
+        out = vorrq_u32(out, vshlq_n_u32(ch[1], 8));
+        vst1q_u32(px + i, vorrq_u32(out, ch[2]));
+    }
+    channelMixScalar(px + i, n - i, mx);
+}
+
+void applyLutNeon(quint32 *px, int n, const quint8 lut[256])
+{
+    // opaque pixels need no unpremultiply: every byte is looked up in the table,
+    // 64 entries per tbl (out of range gives 0), then the alpha is put back;
+    // blocks with any other alpha go the scalar way
+    uint8x16x4_t t[4];
+    for (int k = 0; k < 4; ++k) t[k] = vld1q_u8_x4(lut + 64 * k);
+    const uint32x4_t alphaMask = vdupq_n_u32(0xff000000u);
+    const uint8x16_t step = vdupq_n_u8(64);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t v = vld1q_u32(px + i);
+        if (vminvq_u32(vshrq_n_u32(v, 24)) != 255) {
+            applyLutScalar(px + i, 4, lut);
+            continue;
+        }
+        uint8x16_t idx = vreinterpretq_u8_u32(v);
+        uint8x16_t out = vqtbl4q_u8(t[0], idx);
+        for (int k = 1; k < 4; ++k) {
+            idx = vsubq_u8(idx, step);
+            out = vorrq_u8(out, vqtbl4q_u8(t[k], idx));
+        }
+        vst1q_u32(px + i, vorrq_u32(vreinterpretq_u32_u8(out), alphaMask));
+    }
+    applyLutScalar(px + i, n - i, lut);
+}
+
+} // namespace detail
+} // namespace PixelKernels
@@ -0,0 +1,44 @@
+#ifndef PIXELKERNELS_P_H
+#define PIXELKERNELS_P_H
+
+#include "pixelkernels.h"
+
+// Per instruction set entry points, only for the kernel translation units
+namespace PixelKernels {
+namespace detail {
+
+struct KernelTable {
+    const char *name;
+    void (*invert)(quint32 *px, int n);
+    void (*grayscale)(quint32 *px, int n);
+    void (*channelMix)(quint32 *px, int n, const ChannelMatrix &matrix);
+    void (*applyLut)(quint32 *px, int n, const quint8 lut[256]);
+};
+
+// scalar versions, also used by the SIMD ones for the last few pixels
+void invertScalar(quint32 *px, int n);
+void grayscaleScalar(quint32 *px, int n);
+void channelMixScalar(quint32 *px, int n, const ChannelMatrix &matrix);
+void applyLutScalar(quint32 *px, int n, const quint8 lut[256]); // also SSE2's: no gather there
+
+#ifdef EPIGRIMP_HAVE_X86_KERNELS
+void invertSse2(quint32 *px, int n);
+void grayscaleSse2(quint32 *px, int n);
+void channelMixSse2(quint32 *px, int n, const ChannelMatrix &matrix);
+void invertAvx2(quint32 *px, int n);
+void grayscaleAvx2(quint32 *px, int n);
+void channelMixAvx2(quint32 *px, int n, const ChannelMatrix &matrix);
+void applyLutAvx2(quint32 *px, int n, const quint8 lut[256]);
+#endif
+
+#ifdef EPIGRIMP_HAVE_NEON_KERNELS
+void invertNeon(quint32 *px, int n);
+void grayscaleNeon(quint32 *px, int n);
+void channelMixNeon(quint32 *px, int n, const ChannelMatrix &matrix);
+void applyLutNeon(quint32 *px, int n, const quint8 lut[256]);
+#endif
+
+} // namespace detail
+} // namespace PixelKernels
+
+#endif // PIXELKERNELS_P_H
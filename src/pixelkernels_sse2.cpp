@@ -0,0 +1,100 @@
+#include "pixelkernels_p.h"
+
+#include <emmintrin.h>
+
+namespace PixelKernels {
+namespace detail {
+
+namespace {
+
+// alpha of each pixel copied into its four bytes
+inline __m128i broadcastAlpha(__m128i v)
+{
+    __m128i a = _mm_srli_epi32(v, 24);
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+    return _mm_or_si128(a, _mm_slli_epi32(a, 16));
+}
+
+// c = clamp(c, 0, hi) on signed 32-bit lanes (SSE2 has no min/max_epi32)
+inline __m128i clamp0(__m128i c, __m128i hi)
+{
+    c = _mm_andnot_si128(_mm_cmplt_epi32(c, _mm_setzero_si128()), c);
+    const __m128i over = _mm_cmpgt_epi32(c, hi);
+    return _mm_or_si128(_mm_andnot_si128(over, c), _mm_and_si128(over, hi));
+}
+
+} // namespace
+
+void invertSse2(quint32 *px, int n)
+{
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(px + i);
+        const __m128i v = _mm_loadu_si128(p);
+        // a - c per channel (saturated), the alpha byte becomes 0 and is put back
+        const __m128i inv = _mm_subs_epu8(broadcastAlpha(v), v);
+        _mm_storeu_si128(p, _mm_or_si128(inv, _mm_and_si128(v, alphaMask)));
+    }
+    invertScalar(px + i, n - i);
+}
+
+void grayscaleSse2(quint32 *px, int n)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000));
+    // channel and weights fit in the low 16 bits of each lane, the high halves stay 0
+    const __m128i wr = _mm_set1_epi32(11), wb = _mm_set1_epi32(5);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(px + i);
+        const __m128i v = _mm_loadu_si128(p);
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), byteMask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), byteMask);
+        const __m128i b = _mm_and_si128(v, byteMask);
+        __m128i sum = _mm_add_epi32(_mm_mullo_epi16(r, wr), _mm_slli_epi32(g, 4));
+        sum = _mm_add_epi32(sum, _mm_mullo_epi16(b, wb));
+        const __m128i gray = _mm_srli_epi32(sum, 5);
+        __m128i out = _mm_or_si128(gray, _mm_slli_epi32(gray, 8));
+        out = _mm_or_si128(out, _mm_slli_epi32(gray, 16));
+        _mm_storeu_si128(p, _mm_or_si128(out, _mm_and_si128(v, alphaMask)));
+    }
+    grayscaleScalar(px + i, n - i);
+}
+
+void channelMixSse2(quint32 *px, int n, const ChannelMatrix &mx)
+{
+    const auto &m = mx.m;
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    // coefficient in the low 16 bits only: madd_epi16 then yields channel * coefficient
+    __m128i c[3][3];
+    for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 3; ++col)
+            c[row][col] = _mm_set1_epi32(int(quint16(m[row][col])));
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(px + i);
+        const __m128i v = _mm_loadu_si128(p);
+        const __m128i a = _mm_srli_epi32(v, 24);
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), byteMask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), byteMask);
+        const __m128i b = _mm_and_si128(v, byteMask);
+
+        __m128i ch[3];
+        for (int row = 0; row < 3; ++row) {
+            __m128i s = _mm_add_epi32(_mm_madd_epi16(r, c[row][0]), _mm_madd_epi16(g, c[row][1]));
+            s = _mm_add_epi32(s, _mm_madd_epi16(b, c[row][2]));
+            ch[row] = clamp0(_mm_srai_epi32(s, 8), a);
+        }
+
+        __m128i out = _mm_slli_epi32(a, 24);
+        out = _mm_or_si128(out, _mm_slli_epi32(ch[0], 16));
+        out = _mm_or_si128(out, _mm_slli_epi32(ch[1], 8));
+        _mm_storeu_si128(p, _mm_or_si128(out, ch[2]));
+    }
+    channelMixScalar(px + i, n - i, mx);
+}
+
+} // namespace detail
+} // namespace PixelKernels
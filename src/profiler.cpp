@@ -0,0 +1,163 @@
+#include "profiler.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+namespace Profiler {
+
+namespace detail {
+std::atomic<bool> enabled{qEnvironmentVariableIntValue("EPIGRIMP_PROFILE") != 0};
+}
+
+namespace {
+
+struct Event {
+    const char *name;
+    qint64 start;   // ns
+    qint64 value;   // duration in ns, or counter value
+    quint32 thread;
+    bool isCounter;
+};
+
+// oldest events are overwritten past this, about 6 MB
+constexpr int MaxEvents = 200000;
+
+struct State {
+    QMutex mutex;
+    QElapsedTimer clock;
+    QVector<Event> events;   // ring buffer
+    int nextEvent = 0;
+    QHash<const char *, qint64> lastDuration;
+    QHash<const char *, qint64> lastValue;
+    QHash<Qt::HANDLE, quint32> threadIds;
+
+    State() { clock.start(); }
+
+    quint32 threadId()
+    {
+        const Qt::HANDLE h = QThread::currentThreadId();
+        auto it = threadIds.constFind(h);
+        if (it != threadIds.constEnd()) return it.value();
+        const quint32 id = quint32(threadIds.size()) + 1;
+        threadIds.insert(h, id);
+        return id;
+    }
+
+    void append(const Event &e)
+    {
+        if (events.size() < MaxEvents) events.append(e);
+        else events[nextEvent] = e;
+        nextEvent = (nextEvent + 1) % MaxEvents;
+    }
+};
+
+State &state()
+{
+    static State s;
+    return s;
+}
+
+// trace names are literals from the code, only quotes/backslashes need care
+QString jsonString(const char *s)
+{
+    QString out = QString::fromUtf8(s);
+    out.replace('\\', "\\\\");
+    out.replace('"', "\\\"");
+    return '"' + out + '"';
+}
+
+} // namespace
+
+namespace detail {
+
+qint64 now() { return state().clock.nsecsElapsed(); }
+
+void record(const char *name, qint64 start, qint64 end)
+{
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    s.append({name, start, end - start, s.threadId(), false});
+    s.lastDuration.insert(name, end - start);
+}
+
+void recordCounter(const char *name, qint64 value)
+{
+    State &s = state();
+    const qint64 t = now();
+    QMutexLocker lock(&s.mutex);
+    s.append({name, t, value, s.threadId(), true});
+    s.lastValue.insert(name, value);
+}
+
+} // namespace detail
+
+void setEnabled(bool on)
+{
+    state(); // start the clock before the first scope
+    detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+double lastMs(const char *name)
+{
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    auto it = s.lastDuration.constFind(name);
+    return it == s.lastDuration.constEnd() ? -1.0 : it.value() / 1e6;
+}
+
+qint64 lastCounter(const char *name)
+{
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    return s.lastValue.value(name, -1);
+}
+
+QString saveTrace(const QString &fileName)
+{
+    QVector<Event> events;
+    int first = 0;
+    {
+        State &s = state();
+        QMutexLocker lock(&s.mutex);
+        events = s.events;
+        if (events.size() == MaxEvents) first = s.nextEvent; // wrapped: oldest first
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) return file.errorString();
+
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int k = 0; k < events.size(); ++k) {
+        const Event &e = events[(first + k) % events.size()];
+        out << (k ? ",\n" : "") << "{\"name\":" << jsonString(e.name) << ",\"pid\":1,\"tid\":" << e.thread
+            << ",\"ts\":" << QString::number(e.start / 1000.0, 'f', 3);
+        if (e.isCounter)
+            out << ",\"ph\":\"C\",\"args\":{\"value\":" << e.value << "}}";
+        else
+            out << ",\"ph\":\"X\",\"dur\":" << QString::number(e.value / 1000.0, 'f', 3) << "}";
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (!file.commit()) return file.errorString();
+    return QString();
+}
+
+void clear()
+{
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    s.events.clear();
+    s.nextEvent = 0;
+    s.lastDuration.clear();
+    s.lastValue.clear();
+}
+
+} // namespace Profiler
@@ -0,0 +1,401 @@
+#include "projectfile.h"
+#include "profiler.h"
+#include "workscheduler.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+constexpr char Magic[8] = {'E', 'P', 'I', 'G', 'R', 'I', 'M', 'P'};
+constexpr quint32 Version = 4;     // 2: layer transforms, 3: layer storage formats, 4: adjustment layers
+constexpr int HeaderSize = 64;
+constexpr int ChunkAlign = 64;     // keeps mapped raw tiles aligned for QImage
+constexpr int T = TiledImage::TileSize;
+constexpr qint32 RawTileBytes = T * T * 4;
+inline qint32 rawTileBytes(QImage::Format f) { return T * T * TiledImage::bytesPerPixel(f); }
+constexpr int PackBatch = 256;     // tiles compressed at once, bounds the memory of a big save
+
+enum Encoding : quint8 { Raw = 0, Zlib = 1 };
+
+struct Header {
+    quint64 generation = 0;
+    quint64 indexOffset = 0;
+    quint64 indexSize = 0;
+    quint64 liveBytes = 0;
+};
+
+QByteArray encodeHeader(const Header &h)
+{
+    QByteArray out;
+    QDataStream s(&out, QIODevice::WriteOnly);
+    s.setByteOrder(QDataStream::LittleEndian);
+    s.writeRawData(Magic, sizeof(Magic));
+    s << Version << quint32(0) << h.generation << h.indexOffset << h.indexSize << h.liveBytes;
+    out.append(QByteArray(HeaderSize - out.size(), '\0'));
+    return out;
+}
+
+bool decodeHeader(const QByteArray &bytes, Header *h, quint32 *version = nullptr)
+{
+    if (bytes.size() < HeaderSize || std::memcmp(bytes.constData(), Magic, sizeof(Magic)) != 0) return false;
+    QDataStream s(bytes.mid(sizeof(Magic)));
+    s.setByteOrder(QDataStream::LittleEndian);
+    quint32 v, reserved;
+    s >> v >> reserved >> h->generation >> h->indexOffset >> h->indexSize >> h->liveBytes;
+    if (version) *version = v;
+    return s.status() == QDataStream::Ok && v >= 1 && v <= Version;
+}
+
+qint64 aligned(qint64 pos) { return (pos + ChunkAlign - 1) / ChunkAlign * ChunkAlign; }
+
+// mapping shared by the source and every raw tile handed out (they point into it)
+struct Mapping {
+    QFile file;
+    uchar *data = nullptr;
+    qint64 size = 0;
+    explicit Mapping(const QString &name) : file(name) {}
+};
+
+void releaseMapping(void *info)
+{
+    delete static_cast<QSharedPointer<Mapping> *>(info);
+}
+
+// tiles of one opened project file, read on first use
+class ProjectTileSource : public TileSource {
+public:
+    ProjectTileSource(const QSharedPointer<Mapping> &m, const QString &name, quint64 gen, const QVector<ProjectChunk> &c,
+                      const QVector<QImage::Format> &f)
+        : mapping(m), fileName(name), generation(gen), chunks(c), formats(f), cache(c.size()),
+          ready(new std::atomic<bool>[size_t(c.size())])
+    {
+        for (int i = 0; i < c.size(); ++i) ready[size_t(i)].store(false, std::memory_order_relaxed);
+    }
+
+    const QImage &tile(int chunk) const override
+    {
+        if (ready[size_t(chunk)].load(std::memory_order_acquire)) return cache[chunk];
+        const QImage img = decode(chunk); // outside the lock, threads decode different tiles at once
+        QMutexLocker lock(&mutex);
+        if (!ready[size_t(chunk)].load(std::memory_order_relaxed)) {
+            cache[chunk] = img;
+            if (chunks[chunk].encoding != Raw) resident.fetch_add(img.sizeInBytes(), std::memory_order_relaxed);
+            ready[size_t(chunk)].store(true, std::memory_order_release);
+        }
+        return cache[chunk];
+    }
+
+    qint64 residentBytes() const override { return resident.load(std::memory_order_relaxed); } // raw tiles are the mapping
+    QSharedPointer<const TileSource> reopened() const override
+    {
+        return QSharedPointer<const TileSource>(new ProjectTileSource(mapping, fileName, generation, chunks, formats));
+    }
+
+    const QSharedPointer<Mapping> mapping;
+    const QString fileName;
+    const quint64 generation;
+    const QVector<ProjectChunk> chunks;
+    const QVector<QImage::Format> formats; // of the layer each chunk belongs to
+
+private:
+    QImage decode(int chunk) const
+    {
+        EPIGRIMP_PROFILE_SCOPE("pageInTile");
+        const ProjectChunk &c = chunks[chunk];
+        const QImage::Format format = formats[chunk];
+        const uchar *bytes = mapping->data + c.offset;
+        if (c.encoding == Raw) {
+            // used in place: the OS reads the pages, a write detaches a private copy
+            return QImage(bytes, T, T, T * TiledImage::bytesPerPixel(format), format, releaseMapping,
+                          new QSharedPointer<Mapping>(mapping));
+        }
+        const QByteArray raw = qUncompress(bytes, c.size);
+        QImage img(T, T, format);
+        if (raw.size() != rawTileBytes(format)) {
+            img.fill(Qt::transparent); // damaged chunk
+            return img;
+        }
+        std::memcpy(img.bits(), raw.constData(), size_t(raw.size()));
+        return img;
+    }
+
+    mutable QVector<QImage> cache;
+    mutable std::unique_ptr<std::atomic<bool>[]> ready;
+    mutable std::atomic<qint64> resident{0};
+    mutable QMutex mutex;
+};
+
+QString canonical(const QString &fileName)
+{
+    return QFileInfo(fileName).absoluteFilePath();
+}
+
+bool readHeader(const QString &fileName, Header *h)
+{
+    QFile f(fileName);
+    return f.open(QIODevice::ReadOnly) && decodeHeader(f.read(HeaderSize), h);
+}
+
+// tile of the index, existing chunk or one to write
+struct Entry {
+    ProjectChunk chunk;
+    int pending = -1;
+    bool empty = true;
+};
+
+} // namespace
+
+QString loadProject(const QString &fileName, ProjectData *data, ProjectFileState *state)
+{
+    EPIGRIMP_PROFILE_SCOPE("loadProject");
+    auto mapping = QSharedPointer<Mapping>::create(fileName);
+    if (!mapping->file.open(QIODevice::ReadOnly)) return mapping->file.errorString();
+    mapping->size = mapping->file.size();
+    mapping->data = mapping->file.map(0, mapping->size);
+    if (!mapping->data) return "Cannot map the file: " + mapping->file.errorString();
+
+    Header h;
+    quint32 version = 0;
+    const QByteArray head = QByteArray::fromRawData(reinterpret_cast<const char *>(mapping->data),
+                                                    int(std::min<qint64>(mapping->size, HeaderSize)));
+    if (!decodeHeader(head, &h, &version)) return "Not an EpiGrimp project (or a newer version)";
+    if (h.indexOffset + h.indexSize > quint64(mapping->size)) return "Damaged project file";
+
+    QDataStream s(QByteArray::fromRawData(reinterpret_cast<const char *>(mapping->data + h.indexOffset),
+                                          int(h.indexSize)));
+    s.setVersion(QDataStream::Qt_6_0);
+
+    ProjectData d;
+    qint32 active = 0, layerCount = 0;
+    s >> d.size >> active >> layerCount;
+    if (s.status() != QDataStream::Ok || d.size.isEmpty() || layerCount <= 0) return "Damaged project file";
+
+    // every distinct chunk once, tiles shared in the project stay shared in memory
+    QVector<ProjectChunk> chunks;
+    QVector<QImage::Format> chunkFormats;
+    QHash<qint64, int> chunkAt;
+    QVector<QVector<int>> layerChunks;
+    QVector<QSize> layerSizes;
+    QVector<QImage::Format> layerFormats;
+    for (int l = 0; l < layerCount; ++l) {
+        ProjectLayer layer;
+        QSize size;
+        qint32 mode = 0, tileCount = 0;
+        s >> layer.name >> size >> layer.opacity >> mode >> tileCount;
+        if (s.status() != QDataStream::Ok || size.isEmpty() || tileCount != TiledImage(size).tileCount())
+            return "Damaged project file";
+        layerSizes.append(size);
+        layer.blendMode = BlendMode(std::clamp<qint32>(mode, 0, qint32(BlendMode::Difference)));
+        if (version >= 2) s >> layer.transform;
+        qint32 format = QImage::Format_ARGB32_Premultiplied;
+        if (version >= 3) s >> format;
+        if (!TiledImage::isStorageFormat(QImage::Format(format))) return "Damaged project file";
+        if (version >= 4) {
+            qint32 kind = 0;
+            s >> kind >> layer.adjustment.values;
+            if (kind < 0 || kind > qint32(AdjustmentKind::BrightnessContrast)) return "Damaged project file";
+            layer.adjustment.kind = AdjustmentKind(kind);
+        }
+        layerFormats.append(QImage::Format(format));
+
+        QVector<int> ids(tileCount, -1);
+        for (int i = 0; i < tileCount; ++i) {
+            ProjectChunk c;
+            s >> c.offset >> c.size >> c.encoding;
+            if (c.size == 0) continue; // transparent
+            if (c.offset < HeaderSize || c.offset + c.size > mapping->size || c.encoding > Zlib
+                || (c.encoding == Raw && c.size != rawTileBytes(layerFormats.last())))
+                return "Damaged project file";
+            int id = chunkAt.value(c.offset, -1);
+            if (id < 0) {
+                id = int(chunks.size());
+                chunkAt.insert(c.offset, id);
+                chunks.append(c);
+                chunkFormats.append(layerFormats.last());
+            }
+            ids[i] = id;
+        }
+        layerChunks.append(ids);
+        d.layers.append(layer);
+    }
+
+    qint32 textCount = 0;
+    s >> textCount;
+    for (int i = 0; i < textCount && s.status() == QDataStream::Ok; ++i) {
+        TextItem t;
+        s >> t.text >> t.position >> t.font >> t.color >> t.boundingRect;
+        d.texts.append(t);
+    }
+    if (s.status() != QDataStream::Ok) return "Damaged project file";
+
+    const QString name = canonical(fileName);
+    QSharedPointer<const TileSource> source(new ProjectTileSource(mapping, name, h.generation, chunks, chunkFormats));
+    for (int l = 0; l < d.layers.size(); ++l)
+        d.layers[l].image = TiledImage::fromSource(layerSizes[l], source, layerChunks[l], layerFormats[l]);
+    d.activeLayer = std::clamp<int>(active, 0, int(d.layers.size()) - 1);
+
+    *data = d;
+    *state = ProjectFileState();
+    state->fileName = name;
+    state->generation = h.generation;
+    state->liveBytes = qint64(h.liveBytes);
+    return QString();
+}
+
+ProjectSaveResult saveProject(const ProjectData &data, const QString &fileNameIn,
+                              const ProjectFileState &previous, bool compress)
+{
+    EPIGRIMP_PROFILE_SCOPE("saveProject");
+    ProjectSaveResult result;
+    const QString fileName = canonical(fileNameIn);
+
+    // append to the file when it is still the one the previous save produced,
+    // unless more than half of it is stale by now
+    Header onDisk;
+    bool append = previous.fileName == fileName && readHeader(fileName, &onDisk)
+                  && onDisk.generation == previous.generation;
+    if (append && QFileInfo(fileName).size() > 2 * std::max<qint64>(previous.liveBytes, RawTileBytes))
+        append = false;
+    result.rewritten = !append;
+    const quint64 generation = append ? previous.generation : QRandomGenerator::global()->generate64();
+
+    // index entries: reused chunks, or tiles to write (shared tiles written once)
+    QVector<QVector<Entry>> entries(data.layers.size());
+    QVector<QImage> pending;
+    QHash<qint64, int> pendingByKey;
+    QHash<qint64, ProjectChunk> knownChunks;
+    for (int l = 0; l < data.layers.size(); ++l) {
+        const TiledImage &img = data.layers[l].image;
+        entries[l].resize(img.tileCount());
+        for (int i = 0; i < img.tileCount(); ++i) {
+            Entry &e = entries[l][i];
+            // untouched since opened, possibly through a store view of the memory manager
+            int chunk = img.sourceChunk(i);
+            const ProjectTileSource *source = nullptr;
+            if (append && chunk >= 0)
+                source = dynamic_cast<const ProjectTileSource *>(img.tileSource()->origin(chunk, &chunk));
+            if (source && source->fileName == fileName && source->generation == generation) {
+                e.chunk = source->chunks[chunk]; // not even paged in
+                e.empty = false;
+                ++result.tilesReused;
+                continue;
+            }
+            const QImage &tile = img.tile(i);
+            if (tile.isNull()) continue;
+            e.empty = false;
+            const qint64 key = tile.cacheKey();
+            if (append && previous.chunks.contains(key)) {
+                e.chunk = previous.chunks.value(key); // unchanged since the last save
+                knownChunks.insert(key, e.chunk);
+                ++result.tilesReused;
+                continue;
+            }
+            e.pending = pendingByKey.value(key, -1);
+            if (e.pending < 0) {
+                e.pending = int(pending.size());
+                pendingByKey.insert(key, e.pending);
+                pending.append(tile);
+            }
+        }
+    }
+
+    // write: QSaveFile for a new file, in place (after the current end) for an append
+    QSaveFile saveFile(fileName);
+    QFile appendFile(fileName);
+    QFileDevice &out = append ? static_cast<QFileDevice &>(appendFile) : static_cast<QFileDevice &>(saveFile);
+    if (!out.open(append ? QIODevice::ReadWrite : QIODevice::WriteOnly)) {
+        result.error = out.errorString();
+        return result;
+    }
+    qint64 pos = append ? out.size() : HeaderSize;
+    if (!append) out.write(encodeHeader(Header())); // real header once the index exists
+
+    QVector<ProjectChunk> written(pending.size());
+    for (int first = 0; first < pending.size(); first += PackBatch) {
+        const int n = std::min<int>(PackBatch, int(pending.size()) - first);
+        QVector<QByteArray> packed(n);
+        QVector<quint8> encodings(n, Raw);
+        QByteArray *packedData = packed.data();
+        quint8 *encodingData = encodings.data();
+        WorkScheduler::parallelFor(n, [&](int k) {
+            const QImage &tile = pending[first + k];
+            const char *bits = reinterpret_cast<const char *>(tile.constBits());
+            const qint32 bytes = qint32(tile.sizeInBytes()); // T * T * the layer's bytes per pixel
+            if (compress) {
+                QByteArray z = qCompress(tile.constBits(), bytes, 1); // fast level
+                if (z.size() < bytes) {
+                    packedData[k] = z;
+                    encodingData[k] = Zlib;
+                    return;
+                }
+            }
+            packedData[k] = QByteArray(bits, bytes);
+        });
+        for (int k = 0; k < n; ++k) {
+            const qint64 at = aligned(pos);
+            if (!out.seek(at) || out.write(packed[k]) != packed[k].size()) {
+                result.error = out.errorString();
+                if (!append) saveFile.cancelWriting();
+                return result;
+            }
+            written[first + k] = {at, qint32(packed[k].size()), encodings[k]};
+            pos = at + packed[k].size();
+        }
+    }
+    for (auto it = pendingByKey.cbegin(); it != pendingByKey.cend(); ++it)
+        knownChunks.insert(it.key(), written[it.value()]);
+
+    // index
+    QByteArray index;
+    QDataStream s(&index, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_6_0);
+    s << data.size << qint32(data.activeLayer) << qint32(data.layers.size());
+    QHash<qint64, qint32> live; // offset -> size, shared chunks counted once
+    for (int l = 0; l < data.layers.size(); ++l) {
+        const ProjectLayer &layer = data.layers[l];
+        s << layer.name << layer.image.size() << layer.opacity << qint32(layer.blendMode) << qint32(entries[l].size())
+          << layer.transform << qint32(layer.image.format()) << qint32(layer.adjustment.kind)
+          << layer.adjustment.values;
+        for (const Entry &e : entries[l]) {
+            const ProjectChunk c = e.empty ? ProjectChunk() : e.pending >= 0 ? written[e.pending] : e.chunk;
+            s << c.offset << c.size << c.encoding;
+            if (!e.empty) live.insert(c.offset, c.size);
+        }
+    }
+    s << qint32(data.texts.size());
+    for (const TextItem &t : data.texts)
+        s << t.text << t.position << t.font << t.color << t.boundingRect;
+
+    Header h;
+    h.generation = generation;
+    h.indexOffset = quint64(aligned(pos));
+    h.indexSize = quint64(index.size());
+    for (qint32 size : live) h.liveBytes += quint64(size);
+
+    bool ok = out.seek(qint64(h.indexOffset)) && out.write(index) == index.size() && out.flush();
+    // the header switches to the new index last
+    ok = ok && out.seek(0) && out.write(encodeHeader(h)) == HeaderSize;
+    ok = ok && (append ? appendFile.flush() : saveFile.commit());
+    if (!ok) {
+        result.error = out.errorString();
+        if (!append) saveFile.cancelWriting();
+        return result;
+    }
+
+    result.tilesWritten = int(pending.size());
+    result.state.fileName = fileName;
+    result.state.generation = generation;
+    result.state.chunks = knownChunks;
+    result.state.liveBytes = qint64(h.liveBytes);
+    return result;
+}
@@ -0,0 +1,442 @@
+#include "selectionmask.h"
+#include "pixelkernels.h"
+#include "profiler.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr int T = TiledImage::TileSize;
+
+// premultiplied pixel times c / 255, per channel
+inline quint32 scaled(quint32 p, quint32 c)
+{
+    const quint32 rb = ((p & 0x00ff00ff) * c + 0x00800080) >> 8 & 0x00ff00ff;
+    const quint32 ag = (((p >> 8) & 0x00ff00ff) * c + 0x00800080) & 0xff00ff00;
+    return ag | rb;
+}
+
+inline quint32 lerp(quint32 a, quint32 b, quint32 c) // a * c + b * (255 - c)
+{
+    return scaled(a, c) + scaled(b, 255 - c);
+}
+
+void appendSpan(QVector<SelectionMask::Span> &row, int x0, int x1, quint8 coverage)
+{
+    if (x1 <= x0 || coverage == 0) return;
+    if (!row.isEmpty() && row.last().x1 >= x0 && row.last().coverage == coverage) {
+        row.last().x1 = std::max(row.last().x1, x1); // touching runs become one
+        return;
+    }
+    row.append({x0, x1, coverage});
+}
+
+// fn(x0, x1, coverage in row) on every run of x where row and above differ (both sorted)
+template<typename Fn>
+void coverageChanges(const QVector<SelectionMask::Span> &above, const QVector<SelectionMask::Span> &row, Fn fn)
+{
+    int i = 0, j = 0; // first span of each not left behind
+    int x = INT_MIN;
+    while (i < above.size() || j < row.size()) {
+        // next breakpoint: the start or end of the current span of either row
+        const auto edge = [x](const QVector<SelectionMask::Span> &r, int k) {
+            if (k >= r.size()) return INT_MAX;
+            return r[k].x0 > x ? r[k].x0 : r[k].x1;
+        };
+        const int next = std::min(edge(above, i), edge(row, j));
+        const auto coverage = [x](const QVector<SelectionMask::Span> &r, int k) {
+            return k < r.size() && r[k].x0 <= x && x < r[k].x1 ? r[k].coverage : quint8(0);
+        };
+        const quint8 a = coverage(above, i), b = coverage(row, j);
+        if (a != b && x != INT_MIN) fn(x, next, b);
+        x = next;
+        while (i < above.size() && above[i].x1 <= x) ++i;
+        while (j < row.size() && row[j].x1 <= x) ++j;
+    }
+}
+
+} // namespace
+
+SelectionMask SelectionMask::fromRect(const QRect &rr)
+{
+    SelectionMask m;
+    const QRect r = rr.normalized();
+    if (r.isEmpty()) return m;
+    m.box = r;
+    m.rows = QVector<QVector<Span>>(r.height(), QVector<Span>{{r.left(), r.right() + 1, 255}});
+    return m;
+}
+
+SelectionMask SelectionMask::fromPolygon(const QPolygon &poly)
+{
+    SelectionMask m;
+    if (poly.size() < 3) return m;
+    EPIGRIMP_PROFILE_SCOPE("selectionFromPolygon");
+
+    // scanline fill with an active edge list: rows [top, bottom) of each edge
+    struct Edge {
+        int top, bottom;
+        double x0, dxdy; // x on row top, slope
+    };
+    QVector<Edge> edges;
+    edges.reserve(poly.size());
+    for (int i = 0; i < poly.size(); ++i) {
+        QPoint a = poly[i], b = poly[(i + 1) % poly.size()];
+        if (a.y() == b.y()) continue;
+        if (a.y() > b.y()) std::swap(a, b);
+        edges.append({a.y(), b.y(), double(a.x()), double(b.x() - a.x()) / (b.y() - a.y())});
+    }
+    if (edges.isEmpty()) return m;
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.top < b.top; });
+
+    const QRect pb = poly.boundingRect();
+    QVector<QVector<Span>> rows(pb.height());
+    QVector<const Edge *> active;
+    QVector<double> xs;
+    int next = 0;
+    for (int y = pb.top(); y <= pb.bottom(); ++y) {
+        while (next < edges.size() && edges[next].top == y) active.append(&edges[next++]);
+        active.erase(std::remove_if(active.begin(), active.end(), [y](const Edge *e) { return e->bottom <= y; }),
+                     active.end());
+        // crossings at the row's pixel centers (an edge spans the centers of rows [top, bottom))
+        xs.clear();
+        for (const Edge *e : active) xs.append(e->x0 + (y + 0.5 - e->top) * e->dxdy);
+        std::sort(xs.begin(), xs.end());
+        QVector<Span> &row = rows[y - pb.top()];
+        for (int k = 0; k + 1 < xs.size(); k += 2) // odd-even: x + 0.5 in [xs[k], xs[k + 1])
+            appendSpan(row, int(std::ceil(xs[k] - 0.5)), int(std::ceil(xs[k + 1] - 0.5)), 255);
+    }
+
+    // bounds of what was actually filled
+    int top = -1, bottom = -1, left = INT_MAX, right = INT_MIN;
+    for (int i = 0; i < rows.size(); ++i) {
+        if (rows[i].isEmpty()) continue;
+        if (top < 0) top = i;
+        bottom = i;
+        left = std::min(left, rows[i].first().x0);
+        right = std::max(right, rows[i].last().x1);
+    }
+    if (top < 0) return m;
+    m.box = QRect(left, pb.top() + top, right - left, bottom - top + 1);
+    m.rows = rows.mid(top, bottom - top + 1);
+    return m;
+}
+
+QPolygon SelectionMask::simplified(const QPolygon &poly, qreal tolerance)
+{
+    if (poly.size() < 3) return poly;
+    // Douglas-Peucker, with a stack instead of recursion (long lassos)
+    QVector<bool> keep(poly.size(), false);
+    keep[0] = keep[poly.size() - 1] = true;
+    QVector<std::pair<int, int>> stack = {{0, int(poly.size()) - 1}};
+    while (!stack.isEmpty()) {
+        const auto [first, last] = stack.takeLast();
+        const QPointF a = poly[first], b = poly[last];
+        const QPointF ab = b - a;
+        const qreal len = std::hypot(ab.x(), ab.y());
+        qreal worst = -1;
+        int at = -1;
+        for (int i = first + 1; i < last; ++i) {
+            const QPointF ap = QPointF(poly[i]) - a;
+            const qreal d = len > 0 ? std::abs(ab.x() * ap.y() - ab.y() * ap.x()) / len : std::hypot(ap.x(), ap.y());
+            if (d > worst) {
+                worst = d;
+                at = i;
+            }
+        }
+        if (at < 0 || worst <= tolerance) continue;
+        keep[at] = true;
+        stack.append({first, at});
+        stack.append({at, last});
+    }
+    QPolygon out;
+    for (int i = 0; i < poly.size(); ++i)
+        if (keep[i]) out << poly[i];
+    return out;
+}
+
+const QVector<SelectionMask::Span> &SelectionMask::spans(int y) const
+{
+    static const QVector<Span> none;
+    if (y < box.top() || y > box.bottom()) return none;
+    return rows[y - box.top()];
+}
+
+quint8 SelectionMask::coverageAt(int x, int y) const
+{
+    const QVector<Span> &row = spans(y);
+    auto it = std::upper_bound(row.cbegin(), row.cend(), x, [](int v, const Span &s) { return v < s.x0; });
+    if (it == row.cbegin()) return 0;
+    --it;
+    return x < it->x1 ? it->coverage : 0;
+}
+
+SelectionMask SelectionMask::mapped(const QTransform &t) const
+{
+    if (t.isIdentity() || isEmpty()) return *this;
+    const auto pixel = [&t](int x, int y) { // the pixel whose center x, y lands in
+        const QPointF p = t.map(QPointF(x + 0.5, y + 0.5));
+        return QPoint(int(std::floor(p.x())), int(std::floor(p.y())));
+    };
+    const auto unit = [](qreal v) { return std::abs(v) == 1.0; };
+    const bool whole = t.type() <= QTransform::TxRotate && t.dx() == std::round(t.dx()) && t.dy() == std::round(t.dy());
+    const bool straight = whole && t.m12() == 0 && t.m21() == 0 && unit(t.m11()) && unit(t.m22());
+    const bool turned = whole && t.m11() == 0 && t.m22() == 0 && unit(t.m12()) && unit(t.m21());
+    if (!straight && !turned) return sampled(t);
+
+    // layer transforms (90 degree steps, flips, whole pixel moves): spans map to spans
+    // (straight) or to columns (turned), the work follows the outline as everywhere else
+    SelectionMask m;
+    m.box = QRect(pixel(box.left(), box.top()), pixel(box.right(), box.bottom())).normalized();
+    m.rows.resize(m.box.height());
+    const auto put = [&](int y, int x, int lastX, quint8 c) { // lastX: the other end, included
+        appendSpan(m.rows[y - m.box.top()], std::min(x, lastX), std::max(x, lastX) + 1, c);
+    };
+
+    if (straight) {
+        const bool reversed = t.m11() < 0; // spans come right to left
+        for (int y = box.top(); y <= box.bottom(); ++y) {
+            const QVector<Span> &row = rows[y - box.top()];
+            for (int k = 0; k < row.size(); ++k) {
+                const Span &s = row[reversed ? row.size() - 1 - k : k];
+                const QPoint a = pixel(s.x0, y), b = pixel(s.x1 - 1, y);
+                put(a.y(), a.x(), b.x(), s.coverage);
+            }
+        }
+        return m;
+    }
+
+    // turned: a column of the mask becomes a row. Runs down each column start
+    // where a row differs from the one above it, so differences drive it
+    struct Start {
+        int y;
+        quint8 coverage;
+    };
+    QVector<QVector<Start>> columns(box.width());
+    static const QVector<Span> none;
+    for (int y = box.top(); y <= box.bottom() + 1; ++y) {
+        const QVector<Span> &above = y > box.top() ? rows[y - 1 - box.top()] : none;
+        const QVector<Span> &row = y <= box.bottom() ? rows[y - box.top()] : none;
+        coverageChanges(above, row, [&](int x0, int x1, quint8 c) {
+            for (int x = x0; x < x1; ++x) columns[x - box.left()].append({y, c});
+        });
+    }
+    const bool reversed = t.m21() < 0; // a column comes bottom to top
+    for (int x = box.left(); x <= box.right(); ++x) {
+        const QVector<Start> &col = columns[x - box.left()];
+        for (int k = 0; k + 1 < col.size(); ++k) {
+            const int at = reversed ? col.size() - 2 - k : k;
+            const Start &s = col[at];
+            if (s.coverage == 0) continue;
+            const QPoint a = pixel(x, s.y), b = pixel(x, col[at + 1].y - 1);
+            put(a.y(), a.x(), b.x(), s.coverage);
+        }
+    }
+    return m;
+}
+
+SelectionMask SelectionMask::sampled(const QTransform &t) const
+{
+    EPIGRIMP_PROFILE_SCOPE("selectionSampled");
+    const QRect b = t.mapRect(box);
+    const QTransform inv = t.inverted();
+    SelectionMask m;
+    m.rows.resize(b.height());
+    // pixel centers sampled back in the mask
+    for (int y = b.top(); y <= b.bottom(); ++y) {
+        QVector<Span> &row = m.rows[y - b.top()];
+        int runStart = b.left();
+        quint8 run = 0;
+        for (int x = b.left(); x <= b.right() + 1; ++x) {
+            quint8 c = 0;
+            if (x <= b.right()) {
+                const QPointF p = inv.map(QPointF(x + 0.5, y + 0.5));
+                c = coverageAt(int(std::floor(p.x())), int(std::floor(p.y())));
+            }
+            if (c == run) continue;
+            appendSpan(row, runStart, x, run);
+            runStart = x;
+            run = c;
+        }
+    }
+    m.box = b;
+    return m;
+}
+
+void SelectionMask::forEachSegment(TiledImage &img, bool create,
+                                   const std::function<void(quint32 *, int, int, int, quint8)> &fn) const
+{
+    const QRect area = box.intersected(img.rect());
+    if (area.isEmpty()) return;
+
+    // writable tiles first, here: detaching is not safe from several threads
+    QVector<uchar *> bits(img.tileCount(), nullptr);
+    qsizetype bpl = 0;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (const Span &s : spans(y)) {
+            const int x0 = std::max(s.x0, area.left()), x1 = std::min(s.x1, area.right() + 1);
+            for (int col = x0 / T; x0 < x1 && col <= (x1 - 1) / T; ++col) {
+                const int i = (y / T) * img.tileColumns() + col;
+                if (bits[i] || (!create && img.tile(i).isNull())) continue;
+                QImage &tile = img.tileForWrite(i);
+                bits[i] = tile.bits();
+                bpl = tile.bytesPerLine();
+            }
+        }
+    }
+
+    // a band of tile rows per item: no two items share a tile
+    const int firstBand = area.top() / T;
+    WorkScheduler::parallelFor(area.bottom() / T - firstBand + 1, [&](int k) {
+        const int band = firstBand + k;
+        const int y1 = std::min(area.bottom() + 1, (band + 1) * T);
+        for (int y = std::max(area.top(), band * T); y < y1; ++y) {
+            for (const Span &s : spans(y)) {
+                const int sx0 = std::max(s.x0, area.left()), sx1 = std::min(s.x1, area.right() + 1);
+                for (int col = sx0 / T; sx0 < sx1 && col <= (sx1 - 1) / T; ++col) {
+                    uchar *tile = bits[band * img.tileColumns() + col];
+                    if (!tile) continue;
+                    const int x0 = std::max(sx0, col * T), x1 = std::min(sx1, (col + 1) * T);
+                    quint32 *line = reinterpret_cast<quint32 *>(tile + (y - band * T) * bpl);
+                    fn(line + (x0 - col * T), x1 - x0, x0, y, s.coverage);
+                }
+            }
+        }
+    });
+}
+
+SelectionMask SelectionMask::clipped(const QRect &r) const
+{
+    SelectionMask m;
+    const QRect c = box.intersected(r);
+    if (c.isEmpty()) return m;
+    m.box = c;
+    m.rows.resize(c.height());
+    for (int y = c.top(); y <= c.bottom(); ++y) {
+        QVector<Span> &out = m.rows[y - c.top()];
+        for (const Span &s : rows[y - box.top()]) {
+            const int x0 = std::max(s.x0, c.left()), x1 = std::min(s.x1, c.right() + 1);
+            if (x0 < x1) out.append({x0, x1, s.coverage});
+        }
+    }
+    return m;
+}
+
+QImage SelectionMask::copy(const TiledImage &img) const
+{
+    if (isEmpty()) return QImage();
+    EPIGRIMP_PROFILE_SCOPE("selectionCopy");
+    QImage out(box.size(), QImage::Format_ARGB32_Premultiplied);
+    out.fill(Qt::transparent);
+    uchar *outBits = out.bits();
+    const qsizetype outBpl = out.bytesPerLine();
+    const QRect area = box.intersected(img.rect());
+    if (area.isEmpty()) return out;
+    const QImage::Format format = img.format();
+    const int bpp = TiledImage::bytesPerPixel(format);
+
+    WorkScheduler::parallelForRows(area.top(), area.bottom() + 1, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            quint32 *dst = reinterpret_cast<quint32 *>(outBits + (y - box.top()) * outBpl) - box.left();
+            for (const Span &s : spans(y)) {
+                const int sx0 = std::max(s.x0, area.left()), sx1 = std::min(s.x1, area.right() + 1);
+                for (int col = sx0 / T; sx0 < sx1 && col <= (sx1 - 1) / T; ++col) {
+                    const QImage &tile = img.tile((y / T) * img.tileColumns() + col);
+                    if (tile.isNull()) continue;
+                    const int x0 = std::max(sx0, col * T), x1 = std::min(sx1, (col + 1) * T);
+                    if (format != QImage::Format_ARGB32_Premultiplied) { // packed layer, widened in place
+                        PixelKernels::unpackToArgb32(dst + x0, tile.constScanLine(y % T) + (x0 - col * T) * bpp,
+                                                     x1 - x0, format);
+                        if (s.coverage != 255)
+                            for (int x = x0; x < x1; ++x) dst[x] = scaled(dst[x], s.coverage);
+                        continue;
+                    }
+                    const quint32 *src = reinterpret_cast<const quint32 *>(tile.constScanLine(y % T)) - col * T;
+                    if (s.coverage == 255) {
+                        std::memcpy(dst + x0, src + x0, size_t(x1 - x0) * 4);
+                    } else {
+                        for (int x = x0; x < x1; ++x) dst[x] = scaled(src[x], s.coverage);
+                    }
+                }
+            }
+        }
+    });
+    return out;
+}
+
+void SelectionMask::clear(TiledImage &img) const
+{
+    EPIGRIMP_PROFILE_SCOPE("selectionClear");
+    forEachSegment(img, false, [](quint32 *px, int n, int, int, quint8 c) {
+        if (c == 255) {
+            std::memset(px, 0, size_t(n) * 4);
+            return;
+        }
+        for (int i = 0; i < n; ++i) px[i] = scaled(px[i], 255u - c);
+    });
+    img.squeeze(box); // emptied tiles need no memory
+}
+
+void SelectionMask::fill(TiledImage &img, const QColor &color) const
+{
+    EPIGRIMP_PROFILE_SCOPE("selectionFill");
+    const quint32 pc = qPremultiply(color.rgba());
+    forEachSegment(img, qAlpha(pc) > 0, [pc](quint32 *px, int n, int, int, quint8 c) {
+        const quint32 s = c == 255 ? pc : scaled(pc, c);
+        const quint32 keep = 255u - (s >> 24); // source-over
+        if (keep == 0) {
+            std::fill(px, px + n, s);
+            return;
+        }
+        for (int i = 0; i < n; ++i) px[i] = s + scaled(px[i], keep);
+    });
+}
+
+TiledImage SelectionMask::selectedTiles(const TiledImage &img) const
+{
+    TiledImage out(img.size(), img.format());
+    QVector<bool> touched(img.tileCount(), false);
+    const QRect area = box.intersected(img.rect());
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (const Span &s : spans(y)) {
+            const int x0 = std::max(s.x0, area.left()), x1 = std::min(s.x1, area.right() + 1);
+            for (int col = x0 / T; x0 < x1 && col <= (x1 - 1) / T; ++col) {
+                touched[(y / T) * img.tileColumns() + col] = true;
+            }
+        }
+    }
+    // plus the tiles around: filters that read neighbours (blur) see the real pixels
+    const int cols = img.tileColumns(), tileRows = cols ? img.tileCount() / cols : 0;
+    for (int i = 0; i < img.tileCount(); ++i) {
+        if (!touched[i]) continue;
+        for (int r = std::max(0, i / cols - 1); r <= std::min(tileRows - 1, i / cols + 1); ++r)
+            for (int c = std::max(0, i % cols - 1); c <= std::min(cols - 1, i % cols + 1); ++c)
+                if (out.tile(r * cols + c).isNull()) out.setTile(r * cols + c, img.tile(r * cols + c));
+    }
+    return out;
+}
+
+void SelectionMask::merge(TiledImage &dst, const TiledImage &src) const
+{
+    EPIGRIMP_PROFILE_SCOPE("selectionMerge");
+    forEachSegment(dst, true, [&src](quint32 *px, int n, int x, int y, quint8 c) {
+        const QImage &tile = src.tile((y / T) * src.tileColumns() + x / T);
+        if (tile.isNull()) {
+            if (c == 255) std::memset(px, 0, size_t(n) * 4);
+            else for (int i = 0; i < n; ++i) px[i] = scaled(px[i], 255u - c);
+            return;
+        }
+        const quint32 *s = reinterpret_cast<const quint32 *>(tile.constScanLine(y % T)) + x % T;
+        if (c == 255) {
+            std::memcpy(px, s, size_t(n) * 4);
+            return;
+        }
+        for (int i = 0; i < n; ++i) px[i] = lerp(s[i], px[i], c);
+    });
+    dst.squeeze(box);
+}
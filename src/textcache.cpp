@@ -0,0 +1,110 @@
+#include "textcache.h"
+#include "profiler.h"
+
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int MaxRasterSide = 8192; // beyond that the raster is drawn scaled up
+
+inline int floorDiv(int v, int d) { return v >= 0 ? v / d : -((-v + d - 1) / d); }
+inline quint64 cellKey(int cx, int cy) { return (quint64(quint32(cy)) << 32) | quint32(cx); }
+
+} // namespace
+
+void TextItemCache::reset(const QVector<TextItem> &items)
+{
+    cells.clear();
+    rasters.clear();
+    for (const TextItem &t : items) append(t);
+}
+
+void TextItemCache::append(const TextItem &item)
+{
+    rasters.append(Raster());
+    insert(rasters.size() - 1, paddedRect(item));
+}
+
+void TextItemCache::update(int index, const QRect &oldRect, const TextItem &item)
+{
+    // the raster is checked against the item when drawn, only the grid moves here
+    remove(index, oldRect.adjusted(-2, -2, 2, 2));
+    insert(index, paddedRect(item));
+}
+
+void TextItemCache::insert(int index, const QRect &r)
+{
+    for (int cy = floorDiv(r.top(), CellSize); cy <= floorDiv(r.bottom(), CellSize); ++cy)
+        for (int cx = floorDiv(r.left(), CellSize); cx <= floorDiv(r.right(), CellSize); ++cx)
+            cells[cellKey(cx, cy)].append(index);
+}
+
+void TextItemCache::remove(int index, const QRect &r)
+{
+    for (int cy = floorDiv(r.top(), CellSize); cy <= floorDiv(r.bottom(), CellSize); ++cy) {
+        for (int cx = floorDiv(r.left(), CellSize); cx <= floorDiv(r.right(), CellSize); ++cx) {
+            auto it = cells.find(cellKey(cx, cy));
+            if (it == cells.end()) continue;
+            it->removeOne(index);
+            if (it->isEmpty()) cells.erase(it);
+        }
+    }
+}
+
+QVector<int> TextItemCache::itemsIn(const QRect &r) const
+{
+    QVector<int> out;
+    if (r.isEmpty() || cells.isEmpty()) return out;
+    for (int cy = floorDiv(r.top(), CellSize); cy <= floorDiv(r.bottom(), CellSize); ++cy) {
+        for (int cx = floorDiv(r.left(), CellSize); cx <= floorDiv(r.right(), CellSize); ++cx) {
+            auto it = cells.constFind(cellKey(cx, cy));
+            if (it != cells.constEnd()) out += *it;
+        }
+    }
+    // items spanning several cells come once, in list order
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+int TextItemCache::itemAt(const QVector<TextItem> &items, const QPoint &p) const
+{
+    auto it = cells.constFind(cellKey(floorDiv(p.x(), CellSize), floorDiv(p.y(), CellSize)));
+    if (it == cells.constEnd()) return -1;
+    int best = -1;
+    for (int i : *it)
+        if (i > best && i < items.size() && itemRect(items[i]).contains(p)) best = i;
+    return best;
+}
+
+const QImage &TextItemCache::raster(int index, const TextItem &item, qreal scale)
+{
+    Raster &c = rasters[index];
+    const QRect box = paddedRect(item).translated(-item.position); // relative to the baseline origin
+    // one dimension cap, very high zooms draw the capped raster scaled
+    scale = std::min(scale, qreal(MaxRasterSide) / std::max(1, std::max(box.width(), box.height())));
+    if (!c.image.isNull() && c.text == item.text && c.font == item.font && c.color == item.color
+        && c.box == box && c.scale == scale)
+        return c.image;
+
+    EPIGRIMP_PROFILE_SCOPE("textRaster");
+    c.text = item.text;
+    c.font = item.font;
+    c.color = item.color;
+    c.box = box;
+    c.scale = scale;
+    c.image = QImage(std::max(1, int(std::ceil(box.width() * scale))), std::max(1, int(std::ceil(box.height() * scale))),
+                     QImage::Format_ARGB32_Premultiplied);
+    c.image.fill(Qt::transparent);
+    QPainter p(&c.image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setRenderHint(QPainter::TextAntialiasing, true);
+    p.scale(scale, scale);
+    p.translate(-box.topLeft());
+    p.setFont(item.font);
+    p.setPen(item.color);
+    p.drawText(QPoint(0, 0), item.text);
+    return c.image;
+}
@@ -0,0 +1,347 @@
+#include "tiledimage.h"
+#include "pixelkernels.h"
+#include "workscheduler.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::atomic<quint64> TileSource::nextId{1};
+
+TiledImage::TiledImage(const QSize &size, QImage::Format format)
+    : fmt(isStorageFormat(format) ? format : QImage::Format_ARGB32_Premultiplied)
+{
+    resize(size);
+}
+
+bool TiledImage::isStorageFormat(QImage::Format f)
+{
+    return f == QImage::Format_ARGB32_Premultiplied || f == QImage::Format_Alpha8 || f == QImage::Format_Grayscale8
+           || f == QImage::Format_RGBA64_Premultiplied;
+}
+
+int TiledImage::bytesPerPixel(QImage::Format f)
+{
+    switch (f) {
+    case QImage::Format_Alpha8:
+    case QImage::Format_Grayscale8: return 1;
+    case QImage::Format_RGBA64_Premultiplied: return 8;
+    default: return 4;
+    }
+}
+
+TiledImage TiledImage::convertedTo(QImage::Format f) const
+{
+    if (f == fmt || !isStorageFormat(f)) return *this;
+    TiledImage out(sz, f);
+    QImage *result = out.tiles.data();
+    WorkScheduler::parallelFor(tileCount(), [&](int i) {
+        const QImage &t = tile(i);
+        if (t.isNull()) return;
+        QImage c = t.convertToFormat(f);
+        if (!isTransparent(c)) result[i] = c; // e.g. colour only, no alpha, in an Alpha8 mask
+    });
+    return out;
+}
+
+TiledImage TiledImage::fromImage(const QImage &img)
+{
+    TiledImage t(img.size());
+    if (!img.isNull()) t.setRows(0, img);
+    return t;
+}
+
+void TiledImage::setRows(int y, const QImage &src)
+{
+    const QRect band = QRect(0, y, sz.width(), src.height()).intersected(rect());
+    if (band.isEmpty() || y % TileSize != 0) return;
+    const QVector<int> touched = tilesIn(band);
+    if (source)
+        for (int i : touched) dropSource(i);
+
+    // other formats are converted one tile at a time, never as a second full-size copy
+    const bool premultiplied = src.format() == QImage::Format_ARGB32_Premultiplied;
+    QImage *out = tiles.data();
+    WorkScheduler::parallelFor(int(touched.size()), [&](int k) {
+        const int i = touched[k];
+        const QRect tr = tileRect(i);
+        const QRect part = tr.intersected(band);
+        const QPoint inSrc = part.topLeft() - QPoint(0, y);
+        const QImage conv = premultiplied ? src
+                                          : src.copy(QRect(inSrc, part.size()))
+                                                .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        const QPoint origin = premultiplied ? inSrc : QPoint(0, 0); // of part inside conv
+        out[i] = QImage();
+
+        // skip fully transparent areas, they cost nothing
+        bool empty = true;
+        for (int r = 0; r < part.height() && empty; ++r) {
+            const quint32 *line = reinterpret_cast<const quint32 *>(conv.constScanLine(origin.y() + r)) + origin.x();
+            for (int x = 0; x < part.width(); ++x) {
+                if (line[x] & 0xff000000) { empty = false; break; }
+            }
+        }
+        if (empty) return;
+
+        if (!premultiplied && part == tr) {
+            out[i] = conv; // already a whole tile
+            return;
+        }
+        QImage tile = blankTile();
+        for (int r = 0; r < part.height(); ++r) {
+            std::memcpy(tile.scanLine(part.top() - tr.top() + r) + (part.left() - tr.left()) * 4,
+                        conv.constScanLine(origin.y() + r) + origin.x() * 4, size_t(part.width()) * 4);
+        }
+        out[i] = tile;
+    });
+}
+
+TiledImage TiledImage::fromSource(const QSize &size, const QSharedPointer<const TileSource> &src,
+                                  const QVector<int> &tileChunks, QImage::Format format)
+{
+    TiledImage t(size, format);
+    if (tileChunks.size() != t.tileCount()) return t;
+    t.source = src;
+    t.chunks = tileChunks;
+    return t;
+}
+
+TiledImage TiledImage::withSource(const QSharedPointer<const TileSource> &s) const
+{
+    TiledImage t = *this;
+    if (source) t.source = s;
+    return t;
+}
+
+const QImage &TiledImage::sourceTile(int index) const
+{
+    const int chunk = chunks[index];
+    return chunk < 0 ? tiles[index] : source->tile(chunk);
+}
+
+void TiledImage::dropSource(int index)
+{
+    if (source) chunks[index] = -1; // written: no longer what the source holds
+}
+
+bool TiledImage::sameTile(const TiledImage &other, int index) const
+{
+    const bool bothPaged = tiles[index].isNull() && other.tiles[index].isNull();
+    if (bothPaged && source == other.source && sourceChunk(index) == other.sourceChunk(index))
+        return true;
+    const QImage &a = tile(index), &b = other.tile(index);
+    if (a.isNull() || b.isNull()) return a.isNull() == b.isNull();
+    return a.cacheKey() == b.cacheKey(); // still shared = never written
+}
+
+quint64 TiledImage::tileVersion(int index) const
+{
+    if (!tiles[index].isNull()) return quint64(tiles[index].cacheKey());
+    if (!source || chunks[index] < 0) return 0;
+    // still in the source: the chunk is the version, top bit apart from cache keys
+    return (source->id << 32 ^ quint64(chunks[index])) | (quint64(1) << 63);
+}
+
+QImage TiledImage::blankTile() const
+{
+    QImage tile(TileSize, TileSize, fmt);
+    tile.fill(Qt::transparent);
+    return tile;
+}
+
+QRect TiledImage::tileRect(int index) const
+{
+    return QRect((index % cols) * TileSize, (index / cols) * TileSize, TileSize, TileSize);
+}
+
+QVector<int> TiledImage::tilesIn(const QRect &r) const
+{
+    QVector<int> out;
+    const QRect area = r.normalized().intersected(rect());
+    if (area.isEmpty()) return out;
+
+    const int tx0 = area.left() / TileSize, tx1 = area.right() / TileSize;
+    const int ty0 = area.top() / TileSize, ty1 = area.bottom() / TileSize;
+    out.reserve((tx1 - tx0 + 1) * (ty1 - ty0 + 1));
+    for (int ty = ty0; ty <= ty1; ++ty)
+        for (int tx = tx0; tx <= tx1; ++tx)
+            out.append(ty * cols + tx);
+    return out;
+}
+
+void TiledImage::resize(const QSize &size)
+{
+    const QSize s = size.isValid() ? size : QSize(0, 0);
+    const int newCols = (s.width() + TileSize - 1) / TileSize;
+    const int newRows = (s.height() + TileSize - 1) / TileSize;
+
+    QVector<QImage> newTiles(newCols * newRows);
+    QVector<int> newChunks(source ? newTiles.size() : 0, -1);
+    for (int ty = 0; ty < std::min(rows, newRows); ++ty) {
+        for (int tx = 0; tx < std::min(cols, newCols); ++tx) {
+            newTiles[ty * newCols + tx] = tiles[ty * cols + tx];
+            if (source) newChunks[ty * newCols + tx] = chunks[ty * cols + tx];
+        }
+    }
+
+    const bool shrinking = s.width() < sz.width() || s.height() < sz.height();
+    sz = s;
+    cols = newCols;
+    rows = newRows;
+    tiles = newTiles;
+    chunks = newChunks;
+
+    if (!shrinking) return;
+
+    // pixels cut off by the new bounds must not come back on a later grow
+    for (int i = 0; i < tiles.size(); ++i) {
+        if (tile(i).isNull()) continue;
+        const QRect tr = tileRect(i);
+        if (rect().contains(tr)) continue;
+        QPainter p(&tileForWrite(i));
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        const QRect inside = tr.intersected(rect()).translated(-tr.topLeft());
+        p.fillRect(QRect(inside.right() + 1, 0, TileSize, TileSize), Qt::transparent);
+        p.fillRect(QRect(0, inside.bottom() + 1, TileSize, TileSize), Qt::transparent);
+    }
+}
+
+void TiledImage::fill(const QColor &color)
+{
+    source.reset();
+    chunks.clear();
+    if (color.alpha() == 0) {
+        tiles.fill(QImage());
+        return;
+    }
+
+    // interior tiles all share one image, edge tiles only cover the image area
+    QImage solid = blankTile();
+    solid.fill(color);
+    for (int i = 0; i < tiles.size(); ++i) {
+        const QRect tr = tileRect(i);
+        if (rect().contains(tr)) {
+            tiles[i] = solid;
+        } else {
+            QImage edge = blankTile();
+            QPainter p(&edge);
+            p.setCompositionMode(QPainter::CompositionMode_Source);
+            p.fillRect(tr.intersected(rect()).translated(-tr.topLeft()), color);
+            p.end();
+            tiles[i] = edge;
+        }
+    }
+}
+
+QImage TiledImage::toImage() const
+{
+    return copy(rect());
+}
+
+QImage TiledImage::copy(const QRect &rr) const
+{
+    const QRect r = rr.normalized();
+    QImage out(r.size(), QImage::Format_ARGB32_Premultiplied);
+    if (out.isNull()) return out;
+    out.fill(Qt::transparent);
+
+    const int bpp = bytesPerPixel(fmt);
+    for (int i : tilesIn(r)) {
+        const QImage &tile = this->tile(i);
+        if (tile.isNull()) continue;
+        const QRect tr = tileRect(i);
+        const QRect part = tr.intersected(r).intersected(rect());
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            // packed formats are widened line by line, no converted tile is kept
+            PixelKernels::unpackToArgb32(reinterpret_cast<quint32 *>(out.scanLine(y - r.top())) + (part.left() - r.left()),
+                                         tile.constScanLine(y - tr.top()) + (part.left() - tr.left()) * bpp,
+                                         part.width(), fmt);
+        }
+    }
+    return out;
+}
+
+void TiledImage::draw(QPainter &p, const QRect &r) const
+{
+    for (int i : tilesIn(r)) {
+        const QImage &tile = this->tile(i);
+        if (tile.isNull()) continue;
+        const QRect tr = tileRect(i);
+        const QRect part = tr.intersected(r).intersected(rect());
+        p.drawImage(part.topLeft(), tile, part.translated(-tr.topLeft()));
+    }
+}
+
+void TiledImage::paint(const QRect &r, const std::function<void(QPainter &)> &fn, bool createMissing)
+{
+    const QRect area = r.normalized().intersected(rect());
+    for (int i : tilesIn(area)) {
+        if (tile(i).isNull() && !createMissing) continue;
+        const QRect tr = tileRect(i);
+        QPainter p(&tileForWrite(i));
+        p.translate(-tr.topLeft());
+        p.setClipRect(area.intersected(tr));
+        fn(p);
+    }
+}
+
+void TiledImage::squeeze(const QRect &r)
+{
+    for (int i : tilesIn(r)) {
+        if (!tiles[i].isNull() && isTransparent(tiles[i]))
+            tiles[i] = QImage();
+    }
+}
+
+QImage &TiledImage::tileForWrite(int index)
+{
+    QImage &t = tiles[index];
+    if (t.isNull() && source) t = sourceTile(index); // shared, detached by the write
+    if (t.isNull()) t = blankTile();
+    dropSource(index);
+    return t; // writing through it detaches the pixels if they are shared
+}
+
+void TiledImage::setTile(int index, const QImage &img)
+{
+    tiles[index] = img;
+    dropSource(index);
+}
+
+int TiledImage::storedTileCount() const
+{
+    int n = 0;
+    for (int i = 0; i < tiles.size(); ++i)
+        if (!tiles[i].isNull() || sourceChunk(i) >= 0) ++n;
+    return n;
+}
+
+qint64 TiledImage::memoryBytes() const
+{
+    // shared tiles (solid fills, copies) are only counted once
+    QVector<qint64> keys;
+    for (const QImage &t : tiles)
+        if (!t.isNull()) keys.append(t.cacheKey());
+    std::sort(keys.begin(), keys.end());
+    const qint64 unique = std::unique(keys.begin(), keys.end()) - keys.begin();
+    return unique * TileSize * TileSize * bytesPerPixel(fmt);
+}
+
+bool TiledImage::isTransparent(const QImage &tile)
+{
+    if (tile.format() == QImage::Format_Grayscale8) return false;
+    if (tile.format() != QImage::Format_ARGB32_Premultiplied) {
+        // premultiplied (or alpha only): transparent is all zero bytes
+        const qsizetype n = qsizetype(tile.width()) * bytesPerPixel(tile.format());
+        for (int y = 0; y < tile.height(); ++y) {
+            const uchar *line = tile.constScanLine(y);
+            if (std::any_of(line, line + n, [](uchar b) { return b != 0; })) return false;
+        }
+        return true;
+    }
+    for (int y = 0; y < tile.height(); ++y) {
+        const quint32 *line = reinterpret_cast<const quint32 *>(tile.constScanLine(y));
+        for (int x = 0; x < tile.width(); ++x)
+            if (line[x] & 0xff000000) return false;
+    }
+    return true;
+}
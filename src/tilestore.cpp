@@ -0,0 +1,230 @@
+#include "tilestore.h"
+#include "profiler.h"
+#include "workscheduler.h"
+
+#include <QDir>
+#include <QHash>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int T = TiledImage::TileSize;
+
+} // namespace
+
+// ---------------- TileStore ----------------
+TileStore::TileStore() : file(QDir::tempPath() + "/epigrimp-scratch-XXXXXX.tiles")
+{
+}
+
+int TileStore::put(const QImage &tile)
+{
+    Chunk c;
+    c.data = qCompress(tile.constBits(), int(tile.sizeInBytes()), 1); // fast level
+    c.size = qint32(c.data.size());
+
+    QMutexLocker lock(&mutex);
+    c.lastUse = ++clock;
+    totals.ramBytes += c.size;
+    ++totals.chunks;
+    if (!freeIds.isEmpty()) {
+        const int id = freeIds.takeLast();
+        chunks[id] = c;
+        return id;
+    }
+    chunks.append(c);
+    return int(chunks.size()) - 1;
+}
+
+void TileStore::addRef(int chunk)
+{
+    QMutexLocker lock(&mutex);
+    ++chunks[chunk].refs;
+}
+
+void TileStore::release(int chunk)
+{
+    QMutexLocker lock(&mutex);
+    Chunk &c = chunks[chunk];
+    if (--c.refs > 0) return;
+    if (c.offset < 0) totals.ramBytes -= c.size;
+    else totals.diskBytes -= c.size; // a hole in the file until it empties
+    --totals.chunks;
+    c = Chunk();
+    freeIds.append(chunk);
+    if (totals.diskBytes == 0 && fileEnd > 0 && file.resize(0)) fileEnd = 0;
+}
+
+QImage TileStore::get(int chunk, QImage::Format format) const
+{
+    QByteArray data;
+    {
+        QMutexLocker lock(&mutex);
+        const Chunk &c = chunks[chunk];
+        c.lastUse = ++clock;
+        if (c.offset < 0) {
+            data = c.data; // shared, inflated outside the lock
+        } else {
+            EPIGRIMP_PROFILE_SCOPE("readSpilledTile");
+            if (file.seek(c.offset)) data = file.read(c.size);
+        }
+    }
+    const QByteArray raw = qUncompress(data);
+    QImage img(T, T, format);
+    if (raw.size() != img.sizeInBytes()) {
+        img.fill(Qt::transparent); // scratch file damaged or gone
+        return img;
+    }
+    std::memcpy(img.bits(), raw.constData(), size_t(raw.size()));
+    return img;
+}
+
+void TileStore::spill(qint64 maxRamBytes)
+{
+    QMutexLocker lock(&mutex);
+    if (totals.ramBytes <= maxRamBytes) return;
+    if (!file.isOpen() && !file.open()) return; // stays in RAM
+    EPIGRIMP_PROFILE_SCOPE("spillTiles");
+
+    QVector<int> inRam;
+    for (int i = 0; i < chunks.size(); ++i)
+        if (chunks[i].refs > 0 && chunks[i].offset < 0) inRam.append(i);
+    std::sort(inRam.begin(), inRam.end(), [this](int a, int b) { return chunks[a].lastUse < chunks[b].lastUse; });
+
+    for (int id : inRam) {
+        if (totals.ramBytes <= maxRamBytes) break;
+        Chunk &c = chunks[id];
+        if (!file.seek(fileEnd) || file.write(c.data) != c.data.size()) break; // disk full: keep the rest
+        c.offset = fileEnd;
+        fileEnd += c.size;
+        c.data = QByteArray();
+        totals.ramBytes -= c.size;
+        totals.diskBytes += c.size;
+    }
+    file.flush();
+}
+
+TileStore::Stats TileStore::stats() const
+{
+    QMutexLocker lock(&mutex);
+    return totals;
+}
+
+// ---------------- StoreTileSource ----------------
+StoreTileSource::StoreTileSource(const QSharedPointer<TileStore> &s, const QVector<int> &c, QImage::Format f,
+                                 const QSharedPointer<const TileSource> &b, const QVector<int> &bc)
+    : store(s), chunks(c), format(f), base(b), baseChunks(bc), cache(c.size()),
+      ready(new std::atomic<bool>[size_t(c.size())])
+{
+    for (int i = 0; i < c.size(); ++i) {
+        if (c[i] >= 0) store->addRef(c[i]);
+        ready[size_t(i)].store(false, std::memory_order_relaxed);
+    }
+}
+
+StoreTileSource::~StoreTileSource()
+{
+    for (int id : chunks)
+        if (id >= 0) store->release(id);
+}
+
+const QImage &StoreTileSource::tile(int chunk) const
+{
+    if (chunks[chunk] < 0) return base->tile(baseChunks[chunk]); // cached there
+    if (ready[size_t(chunk)].load(std::memory_order_acquire)) return cache[chunk];
+    const QImage img = store->get(chunks[chunk], format); // outside the lock, as project tiles
+    QMutexLocker lock(&cacheMutex);
+    if (!ready[size_t(chunk)].load(std::memory_order_relaxed)) {
+        cache[chunk] = img;
+        resident.fetch_add(img.sizeInBytes(), std::memory_order_relaxed);
+        ready[size_t(chunk)].store(true, std::memory_order_release);
+    }
+    return cache[chunk];
+}
+
+const TileSource *StoreTileSource::origin(int chunk, int *originChunk) const
+{
+    if (chunks[chunk] < 0) return base->origin(baseChunks[chunk], originChunk);
+    *originChunk = chunk;
+    return this;
+}
+
+// ---------------- storedIn ----------------
+TiledImage storedIn(const TiledImage &img, const QSharedPointer<TileStore> &store)
+{
+    EPIGRIMP_PROFILE_SCOPE("storeLayer");
+    const auto *view = dynamic_cast<const StoreTileSource *>(img.tileSource());
+    const bool sameStore = view && view->store == store;
+    // tiles not written since they were opened stay in the project file: compressing
+    // them again would page the whole layer in and lose them for incremental saves
+    const QSharedPointer<const TileSource> base = sameStore ? view->base : img.sharedTileSource();
+
+    // local chunk of every tile; tiles still in the store or in base keep their chunk
+    QVector<int> ids;         // store chunk of each local chunk, -1 = in base
+    QVector<int> baseIds;     // chunk of base of each local chunk
+    QVector<int> local(img.tileCount(), -1);
+    QVector<QImage> pending;  // tiles to compress
+    QVector<int> pendingAt;   // their local chunk
+    QHash<qint64, int> byKey; // shared tiles (fills, copies) stored once
+    for (int i = 0; i < img.tileCount(); ++i) {
+        const int chunk = img.sourceChunk(i);
+        if (chunk >= 0) {
+            local[i] = int(ids.size());
+            ids.append(sameStore ? view->chunks[chunk] : -1);
+            baseIds.append(sameStore ? view->baseChunks.value(chunk, -1) : chunk);
+            continue;
+        }
+        const QImage &tile = img.tile(i);
+        if (tile.isNull()) continue;
+        const int known = byKey.value(tile.cacheKey(), -1);
+        if (known >= 0) {
+            local[i] = known;
+            continue;
+        }
+        local[i] = int(ids.size());
+        byKey.insert(tile.cacheKey(), local[i]);
+        ids.append(-1);
+        baseIds.append(-1);
+        pending.append(tile);
+        pendingAt.append(local[i]);
+    }
+
+    QVector<int> written(pending.size());
+    int *result = written.data();
+    WorkScheduler::parallelFor(int(pending.size()), [&](int k) { result[k] = store->put(pending[k]); });
+    for (int k = 0; k < pending.size(); ++k) ids[pendingAt[k]] = written[k];
+
+    const bool inBase = std::any_of(baseIds.cbegin(), baseIds.cend(), [](int c) { return c >= 0; });
+    QSharedPointer<const TileSource> source(new StoreTileSource(store, ids, img.format(), inBase ? base : QSharedPointer<const TileSource>(),
+                                                                inBase ? baseIds : QVector<int>()));
+    return TiledImage::fromSource(img.size(), source, local, img.format());
+}
+
+// ---------------- dropDecodedTiles ----------------
+void dropDecodedTiles(const QVector<TiledImage *> &images)
+{
+    QHash<const TileSource *, QSharedPointer<const TileSource>> fresh; // one per source, shared by its images
+    const auto freshOf = [&fresh](const QSharedPointer<const TileSource> &s) {
+        auto it = fresh.find(s.data());
+        if (it == fresh.end()) it = fresh.insert(s.data(), s->residentBytes() > 0 ? s->reopened() : QSharedPointer<const TileSource>());
+        return *it;
+    };
+    for (TiledImage *img : images) {
+        const QSharedPointer<const TileSource> source = img->sharedTileSource();
+        if (!source) continue;
+        const auto *view = dynamic_cast<const StoreTileSource *>(source.data());
+        if (!view) {
+            const QSharedPointer<const TileSource> s = freshOf(source);
+            if (s) *img = img->withSource(s);
+            continue;
+        }
+        if (!view->base) continue;
+        const QSharedPointer<const TileSource> b = freshOf(view->base);
+        if (!b) continue;
+        // the new view inflates its store tiles again too, uncommon enough to not matter
+        *img = img->withSource(QSharedPointer<const TileSource>(
+            new StoreTileSource(view->store, view->chunks, view->format, b, view->baseChunks)));
+    }
+}
@@ -0,0 +1,200 @@
+#include "undohistory.h"
+
+#include <algorithm>
+#include <cstring>
+
+quint64 LayerHistory::nextSerial = 0;
+
+// ---------------- UndoDelta ----------------
+UndoDelta UndoDelta::between(const TiledImage &before, const QTransform &beforeTransform,
+                             const TiledImage &after, const QTransform &afterTransform)
+{
+    UndoDelta d;
+    if (before.size() != after.size() || before.format() != after.format()) { // resized or repacked
+        d = wholeImage(before);
+    } else {
+        d.size = before.size();
+        d.format = before.format();
+        for (int i = 0; i < before.tileCount(); ++i) {
+            if (before.sameTile(after, i)) continue; // never written, untouched project tiles stay on disk
+            d.indices.append(i);
+            d.tiles.append(before.tile(i));
+        }
+    }
+    // rotations / flips only touch the transform, the step costs no pixel
+    d.hasTransform = beforeTransform != afterTransform;
+    d.transform = beforeTransform;
+    return d;
+}
+
+UndoDelta UndoDelta::wholeImage(const TiledImage &img)
+{
+    UndoDelta d;
+    d.size = img.size();
+    d.format = img.format();
+    d.whole = true;
+    for (int i = 0; i < img.tileCount(); ++i) {
+        if (img.tile(i).isNull()) continue;
+        d.indices.append(i);
+        d.tiles.append(img.tile(i));
+    }
+    return d;
+}
+
+qint64 UndoDelta::byteSize() const
+{
+    qint64 bytes = 0;
+    if (compressed) {
+        for (const QByteArray &p : packed) bytes += p.size();
+    } else {
+        const qint64 tileBytes = qint64(TiledImage::TileSize) * TiledImage::TileSize * TiledImage::bytesPerPixel(format);
+        for (const QImage &t : tiles)
+            if (!t.isNull()) bytes += tileBytes;
+    }
+    return bytes;
+}
+
+QRect UndoDelta::affectedRect() const
+{
+    const QRect bounds(QPoint(0, 0), size);
+    if (whole) return bounds;
+
+    const int T = TiledImage::TileSize;
+    const int cols = (size.width() + T - 1) / T;
+    QRect r;
+    for (int i : indices)
+        r |= QRect((i % cols) * T, (i / cols) * T, T, T);
+    return r.intersected(bounds);
+}
+
+void UndoDelta::swapWith(TiledImage &img, QTransform &layerTransform)
+{
+    unpack();
+    if (hasTransform) std::swap(transform, layerTransform);
+
+    if (whole) {
+        TiledImage restored(size, format);
+        for (int k = 0; k < indices.size(); ++k)
+            restored.setTile(indices[k], tiles[k]);
+        UndoDelta current = wholeImage(img);
+        current.hasTransform = hasTransform;
+        current.transform = transform;
+        img = restored;
+        *this = current;
+        return;
+    }
+
+    for (int k = 0; k < indices.size(); ++k) {
+        QImage t = img.tile(indices[k]);
+        img.setTile(indices[k], tiles[k]);
+        tiles[k] = t;
+    }
+}
+
+void UndoDelta::compress()
+{
+    if (compressed) return;
+    packed.resize(tiles.size());
+    for (int k = 0; k < tiles.size(); ++k) {
+        const QImage &t = tiles[k];
+        packed[k] = t.isNull() ? QByteArray()
+                               : qCompress(t.constBits(), t.sizeInBytes(), 1); // fast level
+    }
+    tiles.fill(QImage());
+    compressed = true;
+}
+
+void UndoDelta::unpack()
+{
+    if (!compressed) return;
+    for (int k = 0; k < packed.size(); ++k) {
+        if (packed[k].isEmpty()) continue;
+        const QByteArray raw = qUncompress(packed[k]);
+        QImage t(TiledImage::TileSize, TiledImage::TileSize, format);
+        std::memcpy(t.bits(), raw.constData(), size_t(std::min<qsizetype>(raw.size(), t.sizeInBytes())));
+        tiles[k] = t;
+    }
+    packed.clear();
+    compressed = false;
+}
+
+// ---------------- LayerHistory ----------------
+void LayerHistory::begin(const TiledImage &current, const QTransform &transform, bool compressOlder)
+{
+    commit(current, transform, compressOlder);
+    pendingBase = current; // shares every tile, costs nothing until the layer is written
+    pendingTransform = transform;
+    pending = true;
+}
+
+void LayerHistory::commit(const TiledImage &current, const QTransform &transform, bool compressOlder)
+{
+    if (!pending) return;
+    pending = false;
+
+    UndoDelta d = UndoDelta::between(pendingBase, pendingTransform, current, transform);
+    pendingBase = TiledImage();
+    if (d.isEmpty()) return;
+
+    // the step on top stays raw so that a quick undo does not pay for inflating
+    if (compressOlder && !undoSteps.isEmpty())
+        undoSteps.last().delta.compress();
+    undoSteps.append({d, nextSerial++});
+}
+
+QRect LayerHistory::undo(TiledImage &img, QTransform &transform)
+{
+    if (undoSteps.isEmpty()) return QRect();
+    Step s = undoSteps.takeLast();
+    const QRect before = s.delta.affectedRect();
+    s.delta.swapWith(img, transform);
+    redoSteps.append(s);
+    return before | s.delta.affectedRect();
+}
+
+QRect LayerHistory::redo(TiledImage &img, QTransform &transform)
+{
+    if (redoSteps.isEmpty()) return QRect();
+    Step s = redoSteps.takeLast();
+    const QRect before = s.delta.affectedRect();
+    s.delta.swapWith(img, transform);
+    undoSteps.append(s);
+    return before | s.delta.affectedRect();
+}
+
+void LayerHistory::clear()
+{
+    undoSteps.clear();
+    redoSteps.clear();
+    pendingBase = TiledImage();
+    pending = false;
+}
+
+qint64 LayerHistory::byteSize() const
+{
+    qint64 bytes = 0;
+    for (const Step &s : undoSteps) bytes += s.delta.byteSize();
+    for (const Step &s : redoSteps) bytes += s.delta.byteSize();
+    return bytes;
+}
+
+bool LayerHistory::oldestSerial(quint64 *serial) const
+{
+    if (undoSteps.isEmpty()) return false;
+    *serial = undoSteps.first().serial;
+    return true;
+}
+
+qint64 LayerHistory::dropOldest()
+{
+    if (undoSteps.isEmpty()) return 0;
+    const qint64 bytes = undoSteps.first().delta.byteSize();
+    undoSteps.removeFirst();
+    return bytes;
+}
+
+void LayerHistory::compressAll()
+{
+    for (Step &s : undoSteps) s.delta.compress();
+    for (Step &s : redoSteps) s.delta.compress();
+}
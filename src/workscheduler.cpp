@@ -0,0 +1,60 @@
+#include "workscheduler.h"
+
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+
+namespace WorkScheduler {
+
+int threadCount()
+{
+    return std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+}
+
+void parallelFor(int count, const std::function<void(int)> &fn)
+{
+    if (count <= 0) return;
+    const int helpers = std::min(count, threadCount()) - 1;
+    if (helpers <= 0) {
+        for (int i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    // items are handed out one by one, so uneven items (empty tiles...) balance themselves
+    std::atomic<int> next{0};
+    QSemaphore done;
+    auto drain = [&] {
+        for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            fn(i);
+    };
+
+    // tryStart never queues: a call made from a pool thread cannot wait on
+    // helpers stuck behind it, at worst the caller does everything itself
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int started = 0;
+    for (; started < helpers; ++started) {
+        if (!pool->tryStart([&] { drain(); done.release(); })) break;
+    }
+    drain();
+    done.acquire(started);
+}
+
+void parallelForRows(int begin, int end, const std::function<void(int, int)> &fn, int minRows)
+{
+    const int rows = end - begin;
+    if (rows <= 0) return;
+    // a few bands per thread so that a slow band does not hold the others
+    const int bandRows = std::max(std::max(1, minRows), (rows + threadCount() * 4 - 1) / (threadCount() * 4));
+    const int bands = (rows + bandRows - 1) / bandRows;
+    if (bands == 1) {
+        fn(begin, end);
+        return;
+    }
+    parallelFor(bands, [&](int b) {
+        const int y0 = begin + b * bandRows;
+        fn(y0, std::min(end, y0 + bandRows));
+    });
+}
+
+} // namespace WorkScheduler
@@ -0,0 +1,157 @@
+// BlendKernels: every (mode, opacity) span kernel against the W3C formulas in
+// doubles, and a layer blended tile by tile into composite tiles (dstOrigin)
+// against the same layer blended into one whole image.
+
+#include <QTest>
+#include <QVector>
+
+#include "blendkernels.h"
+#include "tiledimage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// B(cb, cs) of the separable modes, unpremultiplied 0..1
+double blendFunction(BlendMode mode, double cs, double cb)
+{
+    switch (mode) {
+    case BlendMode::Normal: return cs;
+    case BlendMode::Multiply: return cs * cb;
+    case BlendMode::Screen: return cs + cb - cs * cb;
+    case BlendMode::Overlay: return cb <= 0.5 ? 2 * cs * cb : 1 - 2 * (1 - cs) * (1 - cb);
+    case BlendMode::Darken: return std::min(cs, cb);
+    case BlendMode::Lighten: return std::max(cs, cb);
+    case BlendMode::Add: return cs + cb;
+    case BlendMode::Difference: return std::fabs(cs - cb);
+    }
+    return cs;
+}
+
+// premultiplied s over d with opacity, rounded from doubles
+quint32 referencePixel(quint32 s, quint32 d, BlendMode mode, int opacity)
+{
+    if ((s >> 24) == 0) return d; // transparent source runs are skipped
+    const double sa = (s >> 24) / 255.0 * opacity / 255.0, da = (d >> 24) / 255.0;
+    const double ra = sa + da - sa * da;
+    quint32 out = quint32(std::lround(ra * 255)) << 24;
+    for (int shift = 0; shift < 24; shift += 8) {
+        const double sc = ((s >> shift) & 0xff) / 255.0 * opacity / 255.0, dc = ((d >> shift) & 0xff) / 255.0;
+        const double cs = sa > 0 ? sc / sa : 0, cb = da > 0 ? dc / da : 0;
+        double v = sc * (1 - da) + dc * (1 - sa) + sa * da * blendFunction(mode, cs, cb);
+        if (mode == BlendMode::Add) v = std::min(ra, sc + dc); // clamped to the result alpha
+        out |= quint32(std::lround(std::clamp(v, 0.0, ra) * 255)) << shift;
+    }
+    return out;
+}
+
+quint32 randomPixel(std::mt19937 &rng)
+{
+    quint32 a = rng() % 256;
+    if (rng() % 4 == 0) a = 255;
+    if (rng() % 8 == 0) a = 0;
+    const auto c = [&] { return a ? quint32(rng() % (a + 1)) : 0u; };
+    return a << 24 | c() << 16 | c() << 8 | c();
+}
+
+int channelError(quint32 a, quint32 b)
+{
+    int worst = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+        worst = std::max(worst, std::abs(int((a >> shift) & 0xff) - int((b >> shift) & 0xff)));
+    return worst;
+}
+
+QImage noise(const QSize &size, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < img.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x) line[x] = randomPixel(rng);
+    }
+    return img;
+}
+
+} // namespace
+
+class TestBlendKernels : public QObject {
+    Q_OBJECT
+
+private slots:
+    void spanMatchesReference_data();
+    void spanMatchesReference();
+    void layerIntoTiles_data();
+    void layerIntoTiles();
+};
+
+void TestBlendKernels::spanMatchesReference_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::addColumn<int>("opacity");
+    const QStringList names = BlendKernels::modeNames();
+    for (int mode = 0; mode < names.size(); ++mode)
+        for (int opacity : {255, 200, 128, 1})
+            QTest::newRow(qPrintable(QString("%1 %2").arg(names[mode]).arg(opacity))) << mode << opacity;
+}
+
+void TestBlendKernels::spanMatchesReference()
+{
+    QFETCH(int, mode);
+    QFETCH(int, opacity);
+    std::mt19937 rng(7 + unsigned(mode * 256 + opacity));
+    const int n = 4096;
+    QVector<quint32> src(n), dst(n);
+    for (int i = 0; i < n; ++i) {
+        src[i] = randomPixel(rng);
+        dst[i] = randomPixel(rng);
+    }
+    QVector<quint32> got = dst;
+    BlendKernels::blendSpan(got.data(), src.constData(), n, BlendMode(mode), opacity);
+    for (int i = 0; i < n; ++i) {
+        const quint32 expected = referencePixel(src[i], dst[i], BlendMode(mode), opacity);
+        // the integer kernels round twice (opacity, then the blend)
+        QVERIFY2(channelError(got[i], expected) <= 2,
+                 qPrintable(QString("src %1 dst %2: got %3, expected %4")
+                                .arg(src[i], 8, 16, QChar('0')).arg(dst[i], 8, 16, QChar('0'))
+                                .arg(got[i], 8, 16, QChar('0')).arg(expected, 8, 16, QChar('0'))));
+    }
+}
+
+void TestBlendKernels::layerIntoTiles_data()
+{
+    QTest::addColumn<QTransform>("transform");
+    QTest::addColumn<int>("format");
+    const int argb = QImage::Format_ARGB32_Premultiplied;
+    QTest::newRow("identity") << QTransform() << argb;
+    QTest::newRow("identity, grayscale") << QTransform() << int(QImage::Format_Grayscale8);
+    QTest::newRow("identity, alpha") << QTransform() << int(QImage::Format_Alpha8);
+    QTest::newRow("moved") << QTransform::fromTranslate(37, -90) << argb;
+    QTest::newRow("rotated 90") << QTransform(0, 1, -1, 0, 500, 20) << argb;
+    QTest::newRow("flipped") << QTransform(-1, 0, 0, 1, 610, 0) << argb;
+}
+
+void TestBlendKernels::layerIntoTiles()
+{
+    QFETCH(QTransform, transform);
+    QFETCH(int, format);
+    const QSize docSize(640, 540); // not a whole number of tiles
+    const TiledImage layer = TiledImage::fromImage(noise(QSize(600, 500), 3)).convertedTo(QImage::Format(format));
+    const QImage background = noise(docSize, 4);
+
+    QImage whole = background;
+    BlendKernels::blendLayer(whole, layer, transform, whole.rect(), BlendMode::Overlay, 0.75);
+
+    const TiledImage grid(docSize); // only for the composite's tile rects
+    for (int t = 0; t < grid.tileCount(); ++t) {
+        const QRect r = grid.tileRect(t).intersected(QRect(QPoint(), docSize));
+        QImage tile = background.copy(grid.tileRect(t)); // full size, also at the right and bottom edges
+        BlendKernels::blendLayer(tile, r.topLeft(), layer, transform, r, BlendMode::Overlay, 0.75);
+        QVERIFY2(tile.copy(QRect(QPoint(), r.size())) == whole.copy(r), qPrintable(QString("tile %1").arg(t)));
+    }
+}
+
+QTEST_GUILESS_MAIN(TestBlendKernels)
+#include "tst_blendkernels.moc"
@@ -0,0 +1,147 @@
+// Convolution: the Gaussian's box radii, and the running-sum box blur against
+// a direct average over the edge-repeated layer, across tile edges and with
+// a radius larger than a tile.
+
+#include <QTest>
+#include <QVector>
+
+#include "convolution.h"
+#include "tiledimage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+QImage noise(const QSize &size, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < img.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x)
+            line[x] = qPremultiply(qRgba(int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff)));
+    }
+    return img;
+}
+
+// horizontal then vertical mean of 2r + 1 pixels, rounded, outside pixels repeat the edge
+QImage referenceBox(const QImage &img, int r)
+{
+    const int w = img.width(), h = img.height(), d = 2 * r + 1;
+    const auto at = [](const QImage &i, int x, int y) {
+        return reinterpret_cast<const quint32 *>(i.constScanLine(y))[x];
+    };
+    const auto pass = [&](const QImage &src, bool horizontal) {
+        QImage out(src.size(), src.format());
+        for (int y = 0; y < h; ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(out.scanLine(y));
+            for (int x = 0; x < w; ++x) {
+                int sum[4] = {0, 0, 0, 0};
+                for (int k = -r; k <= r; ++k) {
+                    const quint32 q = horizontal ? at(src, std::clamp(x + k, 0, w - 1), y)
+                                                 : at(src, x, std::clamp(y + k, 0, h - 1));
+                    for (int c = 0; c < 4; ++c) sum[c] += int((q >> (8 * c)) & 0xff);
+                }
+                quint32 p = 0;
+                for (int c = 0; c < 4; ++c) p |= quint32((2 * sum[c] + d) / (2 * d)) << (8 * c);
+                line[x] = p;
+            }
+        }
+        return out;
+    };
+    return pass(pass(img, true), false);
+}
+
+} // namespace
+
+class TestConvolution : public QObject {
+    Q_OBJECT
+
+private slots:
+    void gaussianBoxes_data();
+    void gaussianBoxes();
+    void noBoxes();
+    void boxBlurMatchesReference_data();
+    void boxBlurMatchesReference();
+    void uniformStaysUniform();
+    void farTilesStayUnstored();
+};
+
+void TestConvolution::gaussianBoxes_data()
+{
+    QTest::addColumn<double>("sigma");
+    QTest::addColumn<int>("passes");
+    for (double sigma : {0.3, 1.0, 2.0, 3.3, 10.0, 25.7, 80.0})
+        for (int passes : {1, 2, 3, 4})
+            QTest::newRow(qPrintable(QString("sigma %1, %2 passes").arg(sigma).arg(passes))) << sigma << passes;
+}
+
+void TestConvolution::gaussianBoxes()
+{
+    QFETCH(double, sigma);
+    QFETCH(int, passes);
+    const QVector<int> radii = Convolution::gaussianBoxes(sigma, passes);
+    QCOMPARE(int(radii.size()), passes);
+    const auto [lo, hi] = std::minmax_element(radii.cbegin(), radii.cend());
+    QVERIFY(*lo >= 0);
+    QVERIFY(*hi - *lo <= 1); // two neighbouring widths only
+    QVERIFY(std::is_sorted(radii.cbegin(), radii.cend()));
+
+    // variances add up: within half the step between the two widths of sigma^2
+    double variance = 0;
+    for (int r : radii) variance += ((2.0 * r + 1) * (2.0 * r + 1) - 1) / 12.0;
+    const double step = (2.0 * *lo + 2) / 3.0;
+    QVERIFY2(std::abs(variance - sigma * sigma) <= step / 2 + 1e-9,
+             qPrintable(QString("variance %1 for sigma^2 %2").arg(variance).arg(sigma * sigma)));
+}
+
+void TestConvolution::noBoxes()
+{
+    QVERIFY(Convolution::gaussianBoxes(0).isEmpty());
+    QVERIFY(Convolution::gaussianBoxes(-2).isEmpty());
+    QVERIFY(Convolution::gaussianBoxes(3, 0).isEmpty());
+}
+
+void TestConvolution::boxBlurMatchesReference_data()
+{
+    QTest::addColumn<int>("radius");
+    QTest::newRow("1") << 1;
+    QTest::newRow("7") << 7;
+    QTest::newRow("300, wider than a tile") << 300;
+}
+
+void TestConvolution::boxBlurMatchesReference()
+{
+    QFETCH(int, radius);
+    const QImage src = noise(QSize(300, 270), 11); // tile edges on both axes
+    TiledImage img = TiledImage::fromImage(src);
+    Convolution::boxBlur(img, radius);
+    QVERIFY(img.toImage() == referenceBox(src, radius));
+}
+
+void TestConvolution::uniformStaysUniform()
+{
+    for (double sigma : {1.5, 4.0, 40.0}) {
+        TiledImage img(QSize(600, 300));
+        img.fill(QColor(40, 120, 200, 255));
+        const QImage before = img.toImage();
+        Convolution::gaussianBlur(img, sigma);
+        QVERIFY2(img.toImage() == before, qPrintable(QString("sigma %1").arg(sigma)));
+    }
+}
+
+void TestConvolution::farTilesStayUnstored()
+{
+    TiledImage img(QSize(1024, 256));
+    img.setTile(0, noise(QSize(TiledImage::TileSize, TiledImage::TileSize), 12));
+    Convolution::boxBlur(img, 5);
+    QVERIFY(!img.tile(0).isNull());
+    QVERIFY(!img.tile(1).isNull()); // within reach of the halo
+    QVERIFY(img.tile(2).isNull());
+    QVERIFY(img.tile(3).isNull());
+}
+
+QTEST_GUILESS_MAIN(TestConvolution)
+#include "tst_convolution.moc"
@@ -0,0 +1,122 @@
+// PixelKernels: the dispatched implementation and every SIMD one this build
+// and CPU have must give the scalar kernels' exact pixels, tails included.
+
+#include <QTest>
+#include <QVector>
+
+#include "pixelkernels.h"
+#include "pixelkernels_p.h"
+
+#include <random>
+
+using PixelKernels::detail::KernelTable;
+
+namespace {
+
+QVector<KernelTable> implementations()
+{
+    using namespace PixelKernels;
+    QVector<KernelTable> out = {{implementationName(), invert, grayscale, channelMix, applyLut}}; // dispatched
+#ifdef EPIGRIMP_HAVE_X86_KERNELS
+    out.append({"sse2", detail::invertSse2, detail::grayscaleSse2, detail::channelMixSse2, detail::applyLutScalar});
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_cpu_supports("avx2"))
+        out.append({"avx2", detail::invertAvx2, detail::grayscaleAvx2, detail::channelMixAvx2, detail::applyLutAvx2});
+#endif
+#endif
+#ifdef EPIGRIMP_HAVE_NEON_KERNELS
+    out.append({"neon", detail::invertNeon, detail::grayscaleNeon, detail::channelMixNeon, detail::applyLutNeon});
+#endif
+    return out;
+}
+
+// premultiplied pixels in runs: opaque, transparent and translucent ones, so
+// that the vector blocks see both their fast path and the mixed fallback
+QVector<quint32> pixels(std::mt19937 &rng, int n)
+{
+    QVector<quint32> px(n);
+    int i = 0;
+    while (i < n) {
+        const int run = std::min(n - i, int(rng() % 20) + 1);
+        const int kind = int(rng() % 3);
+        for (int k = 0; k < run; ++k, ++i) {
+            const int a = kind == 0 ? 255 : kind == 1 ? int(rng() % 256) : 0;
+            const auto c = [&] { return a ? int(rng() % (a + 1)) : 0; };
+            px[i] = quint32(a) << 24 | quint32(c()) << 16 | quint32(c()) << 8 | quint32(c());
+        }
+    }
+    return px;
+}
+
+template <class Op, class Ref>
+void compareAll(Op op, Ref ref)
+{
+    std::mt19937 rng(42);
+    for (const KernelTable &impl : implementations()) {
+        for (int n = 0; n < 200; n += 1 + n / 16) { // every tail length of the 4 / 8 wide blocks
+            const QVector<quint32> src = pixels(rng, n);
+            QVector<quint32> expected = src, got = src;
+            ref(expected.data(), n);
+            op(impl, got.data(), n);
+            QVERIFY2(got == expected, qPrintable(QString("%1, %2 pixels").arg(impl.name).arg(n)));
+        }
+    }
+}
+
+} // namespace
+
+class TestPixelKernels : public QObject {
+    Q_OBJECT
+
+private slots:
+    void invert();
+    void grayscale();
+    void channelMix();
+    void applyLut();
+    void identityLuts();
+};
+
+void TestPixelKernels::invert()
+{
+    compareAll([](const KernelTable &k, quint32 *px, int n) { k.invert(px, n); }, PixelKernels::detail::invertScalar);
+}
+
+void TestPixelKernels::grayscale()
+{
+    compareAll([](const KernelTable &k, quint32 *px, int n) { k.grayscale(px, n); }, PixelKernels::detail::grayscaleScalar);
+}
+
+void TestPixelKernels::channelMix()
+{
+    std::mt19937 rng(7);
+    for (int round = 0; round < 8; ++round) {
+        PixelKernels::ChannelMatrix m;
+        for (auto &row : m.m)
+            for (qint16 &v : row) v = qint16(int(rng() % 1025) - 512); // -2.0 .. 2.0, clamping included
+        compareAll([&](const KernelTable &k, quint32 *px, int n) { k.channelMix(px, n, m); },
+                   [&](quint32 *px, int n) { PixelKernels::detail::channelMixScalar(px, n, m); });
+    }
+}
+
+void TestPixelKernels::applyLut()
+{
+    std::mt19937 rng(9);
+    quint8 lut[256];
+    for (quint8 &v : lut) v = quint8(rng());
+    compareAll([&](const KernelTable &k, quint32 *px, int n) { k.applyLut(px, n, lut); },
+               [&](quint32 *px, int n) { PixelKernels::detail::applyLutScalar(px, n, lut); });
+}
+
+void TestPixelKernels::identityLuts()
+{
+    quint8 levels[256], bc[256];
+    PixelKernels::makeLevelsLut(levels, 0, 255, 1.0, 0, 255);
+    PixelKernels::makeBrightnessContrastLut(bc, 0, 0);
+    for (int i = 0; i < 256; ++i) {
+        QCOMPARE(int(levels[i]), i);
+        QCOMPARE(int(bc[i]), i);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestPixelKernels)
+#include "tst_pixelkernels.moc"
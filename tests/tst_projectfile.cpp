@@ -0,0 +1,196 @@
+// .grimp projects: what saveProject writes, loadProject gives back (pixels in
+// every storage format, the layer settings, adjustment layers), and a save
+// to the file a project came from only appends the tiles that changed.
+// No text items here: QFont needs a QGuiApplication.
+
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "projectfile.h"
+
+#include <random>
+
+namespace {
+
+const QSize DocSize(700, 600);
+
+TiledImage noiseLayer(const QSize &size, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < img.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x)
+            line[x] = qPremultiply(qRgba(int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff)));
+    }
+    return TiledImage::fromImage(img);
+}
+
+ProjectData sampleProject()
+{
+    ProjectData d;
+    d.size = DocSize;
+
+    ProjectLayer background;
+    background.name = "Background";
+    background.image = noiseLayer(DocSize, 1);
+    d.layers.append(background);
+
+    ProjectLayer sparse; // a single stored tile, the others stay transparent
+    sparse.name = "Sparse";
+    sparse.image = TiledImage(DocSize);
+    sparse.image.paint(QRect(300, 280, 50, 40), [](QPainter &p) { p.fillRect(QRect(300, 280, 50, 40), Qt::red); });
+    sparse.opacity = 0.6;
+    sparse.blendMode = BlendMode::Multiply;
+    sparse.transform = QTransform(0, 1, -1, 0, 650, 10);
+    d.layers.append(sparse);
+
+    ProjectLayer mask;
+    mask.name = "Mask";
+    mask.image = noiseLayer(QSize(300, 200), 2).convertedTo(QImage::Format_Alpha8);
+    mask.blendMode = BlendMode::Screen;
+    mask.transform = QTransform::fromTranslate(40, 90);
+    d.layers.append(mask);
+
+    ProjectLayer gray;
+    gray.name = "Gray";
+    gray.image = noiseLayer(DocSize, 3).convertedTo(QImage::Format_Grayscale8);
+    gray.blendMode = BlendMode::Overlay;
+    d.layers.append(gray);
+
+    ProjectLayer adjustment;
+    adjustment.name = "Brightness / Contrast";
+    adjustment.image = TiledImage(DocSize);
+    adjustment.adjustment.kind = AdjustmentKind::BrightnessContrast;
+    adjustment.adjustment.values = {25, -40};
+    d.layers.append(adjustment);
+
+    d.activeLayer = 2;
+    return d;
+}
+
+void compareProjects(const ProjectData &got, const ProjectData &expected)
+{
+    QCOMPARE(got.size, expected.size);
+    QCOMPARE(got.activeLayer, expected.activeLayer);
+    QCOMPARE(got.layers.size(), expected.layers.size());
+    for (int l = 0; l < expected.layers.size(); ++l) {
+        const ProjectLayer &a = got.layers[l], &b = expected.layers[l];
+        QCOMPARE(a.name, b.name);
+        QCOMPARE(a.opacity, b.opacity);
+        QCOMPARE(int(a.blendMode), int(b.blendMode));
+        QCOMPARE(a.transform, b.transform);
+        QCOMPARE(int(a.adjustment.kind), int(b.adjustment.kind));
+        QCOMPARE(a.adjustment.values, b.adjustment.values);
+        QCOMPARE(a.image.size(), b.image.size());
+        QCOMPARE(int(a.image.format()), int(b.image.format()));
+        for (int i = 0; i < b.image.tileCount(); ++i)
+            QCOMPARE(a.image.tile(i).isNull(), b.image.tile(i).isNull()); // transparent tiles are not stored
+        QVERIFY2(a.image.toImage() == b.image.toImage(), qPrintable(a.name));
+    }
+}
+
+int storedTiles(const ProjectData &d)
+{
+    int n = 0;
+    for (const ProjectLayer &layer : d.layers)
+        for (int i = 0; i < layer.image.tileCount(); ++i)
+            n += layer.image.tile(i).isNull() ? 0 : 1;
+    return n;
+}
+
+} // namespace
+
+class TestProjectFile : public QObject {
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void appendAfterSave();
+    void appendAfterLoad();
+};
+
+void TestProjectFile::roundTrip_data()
+{
+    QTest::addColumn<bool>("compressed");
+    QTest::newRow("raw") << false;
+    QTest::newRow("zlib") << true;
+}
+
+void TestProjectFile::roundTrip()
+{
+    QFETCH(bool, compressed);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("project.grimp");
+    const ProjectData saved = sampleProject();
+
+    const ProjectSaveResult result = saveProject(saved, fileName, ProjectFileState(), compressed);
+    QVERIFY2(result.error.isEmpty(), qPrintable(result.error));
+    QVERIFY(result.rewritten);
+    QCOMPARE(result.tilesWritten, storedTiles(saved));
+    QCOMPARE(result.tilesReused, 0);
+
+    ProjectData loaded;
+    ProjectFileState state;
+    const QString error = loadProject(fileName, &loaded, &state);
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+    compareProjects(loaded, saved);
+}
+
+void TestProjectFile::appendAfterSave()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("project.grimp");
+    ProjectData project = sampleProject();
+    const ProjectSaveResult first = saveProject(project, fileName, ProjectFileState(), true);
+    QVERIFY2(first.error.isEmpty(), qPrintable(first.error));
+
+    // one tile of the background painted: the rest is known by its cache key
+    project.layers[0].image.paint(QRect(10, 10, 20, 20), [](QPainter &p) { p.fillRect(QRect(10, 10, 20, 20), Qt::blue); });
+    const ProjectSaveResult second = saveProject(project, fileName, first.state, true);
+    QVERIFY2(second.error.isEmpty(), qPrintable(second.error));
+    QVERIFY(!second.rewritten);
+    QCOMPARE(second.tilesWritten, 1);
+    QCOMPARE(second.tilesReused, storedTiles(project) - 1);
+
+    ProjectData loaded;
+    ProjectFileState state;
+    const QString error = loadProject(fileName, &loaded, &state);
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+    compareProjects(loaded, project);
+}
+
+void TestProjectFile::appendAfterLoad()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("project.grimp");
+    const ProjectSaveResult first = saveProject(sampleProject(), fileName, ProjectFileState(), false);
+    QVERIFY2(first.error.isEmpty(), qPrintable(first.error));
+
+    ProjectData project;
+    ProjectFileState state;
+    QString error = loadProject(fileName, &project, &state);
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+
+    // tiles still in the file are reused without being paged in
+    project.layers[0].image.paint(QRect(520, 520, 30, 30), [](QPainter &p) { p.fillRect(QRect(520, 520, 30, 30), Qt::white); });
+    project.layers[1].opacity = 0.25;
+    const ProjectSaveResult second = saveProject(project, fileName, state, false);
+    QVERIFY2(second.error.isEmpty(), qPrintable(second.error));
+    QVERIFY(!second.rewritten);
+    QCOMPARE(second.tilesWritten, 1);
+    QCOMPARE(second.tilesReused, storedTiles(project) - 1);
+
+    ProjectData loaded;
+    error = loadProject(fileName, &loaded, &state);
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+    compareProjects(loaded, project);
+}
+
+QTEST_GUILESS_MAIN(TestProjectFile)
+#include "tst_projectfile.moc"
@@ -0,0 +1,236 @@
+// SelectionMask: the spans against a per-pixel reference (pixel centers in
+// the polygon, pixel centers mapped back through the transform), and the
+// span operations on a layer against the same edit pixel by pixel.
+
+#include <QTest>
+
+#include "selectionmask.h"
+#include "tiledimage.h"
+
+#include <cmath>
+#include <random>
+#include <utility>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+// odd-even rule at the pixel center, with the crossings computed like the scanline fill
+bool insidePolygon(const QPolygon &poly, int x, int y)
+{
+    const double cx = x + 0.5, cy = y + 0.5;
+    bool inside = false;
+    for (int i = 0; i < poly.size(); ++i) {
+        QPoint a = poly[i], b = poly[(i + 1) % poly.size()];
+        if (a.y() == b.y()) continue;
+        if (a.y() > b.y()) std::swap(a, b);
+        if (y < a.y() || y >= b.y()) continue;
+        const double dxdy = double(b.x() - a.x()) / (b.y() - a.y());
+        if (a.x() + (cy - a.y()) * dxdy <= cx) inside = !inside;
+    }
+    return inside;
+}
+
+// a five pointed star: odd-even leaves the pentagon in the middle out, so
+// most rows hold two or more spans
+QPolygon star(const QPoint &center, int radius)
+{
+    QPolygon poly;
+    for (int k = 0; k < 5; ++k) {
+        const double a = (k * 2 % 5) * 2 * Pi / 5 - Pi / 2;
+        poly << center + QPoint(int(std::lround(radius * std::cos(a))), int(std::lround(radius * std::sin(a))));
+    }
+    return poly;
+}
+
+quint32 pixelAt(const QImage &img, int x, int y)
+{
+    return reinterpret_cast<const quint32 *>(img.constScanLine(y))[x];
+}
+
+QImage noise(const QSize &size, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < img.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x)
+            line[x] = qPremultiply(qRgba(int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff)));
+    }
+    return img;
+}
+
+} // namespace
+
+class TestSelectionMask : public QObject {
+    Q_OBJECT
+
+private slots:
+    void fromRect();
+    void fromPolygon_data();
+    void fromPolygon();
+    void clipped();
+    void mapped_data();
+    void mapped();
+    void copy_data();
+    void copy();
+    void fillAndClear();
+};
+
+void TestSelectionMask::fromRect()
+{
+    const SelectionMask m = SelectionMask::fromRect(QRect(10, 20, 41, 21));
+    QCOMPARE(m.bounds(), QRect(10, 20, 41, 21));
+    for (int y = 15; y < 45; ++y)
+        for (int x = 5; x < 55; ++x)
+            QCOMPARE(int(m.coverageAt(x, y)), m.bounds().contains(x, y) ? 255 : 0);
+    QVERIFY(SelectionMask::fromRect(QRect()).isEmpty());
+}
+
+void TestSelectionMask::fromPolygon_data()
+{
+    QTest::addColumn<QPolygon>("polygon");
+    QTest::newRow("triangle") << QPolygon({QPoint(3, 2), QPoint(90, 30), QPoint(20, 75)});
+    QTest::newRow("star") << star(QPoint(300, 260), 200); // across tile edges
+    QTest::newRow("thin") << QPolygon({QPoint(0, 0), QPoint(100, 1), QPoint(0, 2)});
+    QTest::newRow("concave") << QPolygon({QPoint(10, 10), QPoint(80, 10), QPoint(80, 70), QPoint(45, 30), QPoint(10, 70)});
+}
+
+void TestSelectionMask::fromPolygon()
+{
+    QFETCH(QPolygon, polygon);
+    const SelectionMask m = SelectionMask::fromPolygon(polygon);
+    QVERIFY(!m.isEmpty());
+    const QRect area = polygon.boundingRect().adjusted(-2, -2, 2, 2);
+    QRect covered;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            const bool inside = insidePolygon(polygon, x, y);
+            QVERIFY2(m.coverageAt(x, y) == (inside ? 255 : 0), qPrintable(QString("%1, %2").arg(x).arg(y)));
+            if (inside) covered |= QRect(x, y, 1, 1);
+        }
+        // sorted, disjoint spans
+        const QVector<SelectionMask::Span> &row = m.spans(y);
+        for (int k = 0; k < row.size(); ++k) {
+            QVERIFY(row[k].x0 < row[k].x1);
+            if (k > 0) QVERIFY(row[k - 1].x1 < row[k].x0);
+        }
+    }
+    QCOMPARE(m.bounds(), covered);
+}
+
+void TestSelectionMask::clipped()
+{
+    const SelectionMask m = SelectionMask::fromPolygon(star(QPoint(100, 100), 90));
+    const QRect r(60, 30, 100, 50);
+    const SelectionMask c = m.clipped(r);
+    for (int y = 0; y < 200; ++y)
+        for (int x = 0; x < 200; ++x)
+            QCOMPARE(c.coverageAt(x, y), r.contains(x, y) ? m.coverageAt(x, y) : quint8(0));
+    QVERIFY(m.clipped(QRect(500, 500, 10, 10)).isEmpty());
+}
+
+void TestSelectionMask::mapped_data()
+{
+    QTest::addColumn<QTransform>("transform");
+    QTest::newRow("moved") << QTransform::fromTranslate(17, -9);
+    QTest::newRow("flipped horizontally") << QTransform(-1, 0, 0, 1, 400, 0);
+    QTest::newRow("flipped vertically") << QTransform(1, 0, 0, -1, 0, 300);
+    QTest::newRow("rotated 90") << QTransform(0, 1, -1, 0, 350, 0);
+    QTest::newRow("rotated 180") << QTransform(-1, 0, 0, -1, 400, 300);
+    QTest::newRow("rotated 270") << QTransform(0, -1, 1, 0, 5, 420);
+    QTest::newRow("transposed") << QTransform(0, 1, 1, 0, 0, 0);
+    QTest::newRow("rotated 30 (sampled)") << QTransform().translate(200, 20).rotate(30);
+    QTest::newRow("scaled (sampled)") << QTransform::fromScale(1.5, 0.75);
+}
+
+void TestSelectionMask::mapped()
+{
+    QFETCH(QTransform, transform);
+    // a star with a rectangle hole punched in by odd-even: several runs per row and column
+    QPolygon poly = star(QPoint(160, 150), 140);
+    poly << poly.first() << QPoint(150, 100) << QPoint(190, 100) << QPoint(190, 260) << QPoint(150, 260)
+         << QPoint(150, 100) << poly.first();
+    const SelectionMask m = SelectionMask::fromPolygon(poly);
+    const SelectionMask out = m.mapped(transform);
+
+    // every pixel of the result: its center mapped back into the mask
+    const QTransform inv = transform.inverted();
+    const QRect area = transform.mapRect(m.bounds()).adjusted(-3, -3, 3, 3);
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            const QPointF p = inv.map(QPointF(x + 0.5, y + 0.5));
+            const quint8 expected = m.coverageAt(int(std::floor(p.x())), int(std::floor(p.y())));
+            QVERIFY2(out.coverageAt(x, y) == expected, qPrintable(QString("%1, %2").arg(x).arg(y)));
+        }
+    }
+    for (int y = out.bounds().top(); y <= out.bounds().bottom(); ++y) {
+        const QVector<SelectionMask::Span> &row = out.spans(y);
+        for (int k = 1; k < row.size(); ++k)
+            QVERIFY(row[k - 1].x1 <= row[k].x0);
+    }
+}
+
+void TestSelectionMask::copy_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::newRow("argb") << int(QImage::Format_ARGB32_Premultiplied);
+    QTest::newRow("grayscale") << int(QImage::Format_Grayscale8);
+    QTest::newRow("alpha") << int(QImage::Format_Alpha8);
+}
+
+void TestSelectionMask::copy()
+{
+    QFETCH(int, format);
+    const TiledImage img = TiledImage::fromImage(noise(QSize(600, 520), 5)).convertedTo(QImage::Format(format));
+    const QImage pixels = img.toImage().convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    // partly outside the image
+    const SelectionMask m = SelectionMask::fromPolygon(star(QPoint(500, 300), 260));
+
+    const QImage out = m.copy(img);
+    QCOMPARE(out.size(), m.bounds().size());
+    const QRect b = m.bounds();
+    for (int y = b.top(); y <= b.bottom(); ++y) {
+        for (int x = b.left(); x <= b.right(); ++x) {
+            const bool selected = m.coverageAt(x, y) && img.rect().contains(x, y);
+            QCOMPARE(pixelAt(out, x - b.left(), y - b.top()), selected ? pixelAt(pixels, x, y) : 0u);
+        }
+    }
+}
+
+void TestSelectionMask::fillAndClear()
+{
+    const TiledImage before = TiledImage::fromImage(noise(QSize(600, 520), 6));
+    const QImage original = before.toImage();
+    const SelectionMask m = SelectionMask::fromPolygon(star(QPoint(250, 240), 230));
+    const SelectionMask corner = SelectionMask::fromRect(QRect(0, 0, 300, 300)); // covers tile 0
+
+    TiledImage filled = before;
+    m.fill(filled, QColor(10, 200, 30));
+    TiledImage cleared = before;
+    m.clear(cleared);
+    const QImage f = filled.toImage(), c = cleared.toImage();
+    const quint32 green = qPremultiply(qRgb(10, 200, 30));
+    for (int y = 0; y < original.height(); ++y) {
+        for (int x = 0; x < original.width(); ++x) {
+            const bool selected = m.coverageAt(x, y) != 0;
+            QCOMPARE(pixelAt(f, x, y), selected ? green : pixelAt(original, x, y));
+            QCOMPARE(pixelAt(c, x, y), selected ? 0u : pixelAt(original, x, y));
+        }
+    }
+
+    // tiles the mask does not touch stay shared with the original
+    for (int i = 0; i < before.tileCount(); ++i) {
+        if (m.bounds().intersects(before.tileRect(i))) continue;
+        QVERIFY(filled.sameTile(before, i));
+        QVERIFY(cleared.sameTile(before, i));
+    }
+    // a wholly cleared tile is dropped
+    TiledImage cut = before;
+    corner.clear(cut);
+    QVERIFY(cut.tile(0).isNull());
+    QVERIFY(!cut.tile(1).isNull());
+}
+
+QTEST_GUILESS_MAIN(TestSelectionMask)
+#include "tst_selectionmask.moc"
@@ -0,0 +1,140 @@
+// UndoDelta: tile deltas and the whole-image steps (resize, repack) swapped
+// back and forth must give back the exact layer each time.
+
+#include <QPainter>
+#include <QTest>
+
+#include "tiledimage.h"
+#include "undohistory.h"
+
+#include <random>
+
+namespace {
+
+TiledImage noiseLayer(const QSize &size, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    QImage img(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < img.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x)
+            line[x] = qPremultiply(qRgba(int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff), int(rng() & 0xff)));
+    }
+    return TiledImage::fromImage(img);
+}
+
+void fillRect(TiledImage &img, const QRect &r, const QColor &color)
+{
+    img.paint(r, [&](QPainter &p) { p.fillRect(r, color); });
+}
+
+} // namespace
+
+class TestUndoDelta : public QObject {
+    Q_OBJECT
+
+private slots:
+    void tileDeltaRoundTrip_data();
+    void tileDeltaRoundTrip();
+    void onlyWrittenTilesStored();
+    void wholeImageOnFormatChange();
+    void wholeImageOnResize();
+    void transformOnly();
+};
+
+void TestUndoDelta::tileDeltaRoundTrip_data()
+{
+    QTest::addColumn<bool>("compressed");
+    QTest::newRow("raw") << false;
+    QTest::newRow("zlib") << true;
+}
+
+void TestUndoDelta::tileDeltaRoundTrip()
+{
+    QFETCH(bool, compressed);
+    const TiledImage before = noiseLayer(QSize(700, 600), 1);
+    TiledImage img = before; // shared, like LayerHistory's snapshot
+    fillRect(img, QRect(250, 240, 40, 300), Qt::red);
+    img.tileForWrite(img.tileCount() - 1).fill(Qt::transparent);
+    const QImage edited = img.toImage();
+
+    QTransform t;
+    UndoDelta d = UndoDelta::between(before, t, img, t);
+    QVERIFY(!d.isEmpty());
+    QVERIFY(d.affectedRect().contains(QRect(250, 240, 40, 300)));
+    if (compressed) d.compress();
+
+    d.swapWith(img, t); // undo
+    QCOMPARE(img.toImage(), before.toImage());
+    if (compressed) d.compress();
+    d.swapWith(img, t); // redo
+    QCOMPARE(img.toImage(), edited);
+}
+
+void TestUndoDelta::onlyWrittenTilesStored()
+{
+    const TiledImage before = noiseLayer(QSize(1024, 1024), 2);
+    TiledImage img = before;
+    fillRect(img, QRect(10, 10, 20, 20), Qt::blue); // one tile
+
+    const UndoDelta d = UndoDelta::between(before, QTransform(), img, QTransform());
+    const qint64 tileBytes = qint64(TiledImage::TileSize) * TiledImage::TileSize * 4;
+    QCOMPARE(d.byteSize(), tileBytes);
+    QCOMPARE(d.affectedRect(), QRect(0, 0, TiledImage::TileSize, TiledImage::TileSize));
+}
+
+void TestUndoDelta::wholeImageOnFormatChange()
+{
+    // repacked to gray: every tile changes and the format with them
+    const TiledImage before = noiseLayer(QSize(520, 300), 3);
+    TiledImage img = before.convertedTo(QImage::Format_Grayscale8);
+    const QImage packed = img.toImage();
+
+    QTransform t;
+    UndoDelta d = UndoDelta::between(before, t, img, t);
+    QCOMPARE(d.affectedRect(), before.rect());
+    d.compress();
+
+    d.swapWith(img, t);
+    QCOMPARE(img.format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(img.toImage(), before.toImage());
+    d.swapWith(img, t);
+    QCOMPARE(img.format(), QImage::Format_Grayscale8);
+    QCOMPARE(img.toImage(), packed);
+}
+
+void TestUndoDelta::wholeImageOnResize()
+{
+    const TiledImage before = noiseLayer(QSize(300, 300), 4);
+    TiledImage img = before;
+    img.resize(QSize(800, 500));
+    fillRect(img, QRect(600, 400, 100, 50), Qt::green);
+    const QImage grown = img.toImage();
+
+    QTransform t;
+    UndoDelta d = UndoDelta::between(before, t, img, t);
+    d.swapWith(img, t);
+    QCOMPARE(img.size(), QSize(300, 300));
+    QCOMPARE(img.toImage(), before.toImage());
+    d.swapWith(img, t);
+    QCOMPARE(img.size(), QSize(800, 500));
+    QCOMPARE(img.toImage(), grown);
+}
+
+void TestUndoDelta::transformOnly()
+{
+    TiledImage img = noiseLayer(QSize(400, 400), 5);
+    const QTransform before;
+    QTransform t = QTransform(0, 1, -1, 0, 400, 0); // a quarter turn, no pixel written
+
+    UndoDelta d = UndoDelta::between(img, before, img, t);
+    QVERIFY(!d.isEmpty());
+    QCOMPARE(d.byteSize(), qint64(0));
+    d.swapWith(img, t);
+    QCOMPARE(t, before);
+    d.swapWith(img, t);
+    QCOMPARE(t, QTransform(0, 1, -1, 0, 400, 0));
+}
+
+QTEST_GUILESS_MAIN(TestUndoDelta)
+#include "tst_undodelta.moc"